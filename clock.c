@@ -0,0 +1,332 @@
+/*
+ * clock.c
+ *
+ * Created: 14-10-2026 20:12:31
+ *  Author: Tim Dorssers
+ *
+ * Sub-second time keeping on top of the AVR Libc system time. TIMER1 runs
+ * in CTC mode and its counter holds the fraction of the current second. The
+ * compare match flag is set when the counter clears, so a second starts at
+ * counter value zero. The compare match interrupt steps the system time.
+ *
+ * The clock is disciplined by a frequency locked loop. Each NTP answer gives
+ * an offset: large offsets are stepped, small ones are slewed out by making
+ * the next seconds a few timer ticks shorter or longer. The offset divided by
+ * the time since the previous update is the frequency error of the crystal,
+ * which is corrected on every second with a fractional tick accumulator.
+ *
+ * The local time is cached and advanced by the seconds elapsed, it is only
+ * computed again at the next local hour, at the next dst switch or when the
+ * clock was stepped.
+ *
+ * A separate count of seconds is never stepped and gives the milliseconds
+ * for timers. Compare match B wakes the cpu from sleep within a second.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <time.h>
+#include "clock.h"
+
+// corrections in units of 1/65536 timer tick
+#define CLOCK_MAX_FREQ ((int32_t)CLOCK_TICKS_PER_SEC*65536/2000) // 500 ppm
+#define CLOCK_MAX_SLEW ((int32_t)CLOCK_TICKS_PER_SEC*65536/2000) // 500 us/s
+// offsets beyond 128 ms are stepped and not taken as frequency error,
+// in units of 1/65536 second
+#define CLOCK_STEP_LIMIT 8389
+// minimum seconds between two updates to estimate the frequency
+#define CLOCK_FLL_MIN_INTERVAL 64
+
+static void (*clock_tick_callback)(void);
+static volatile int32_t clock_freq; // frequency correction per second
+static volatile int32_t clock_slew; // phase correction still to apply
+static uint16_t clock_rem; // fraction of a tick carried to the next second
+static time_t clock_update_t; // time of last update, 0 if never synced
+static struct tm clock_tm; // cached local time
+static time_t clock_tm_t; // time of clock_tm
+static time_t clock_tm_next; // clock_tm is computed again from this time on
+static uint8_t clock_tm_valid=0;
+static time_t (*clock_dst_next)(time_t t); // next dst switch after t
+static volatile uint32_t clock_uptime=0; // seconds since clock_init
+
+// interrupt, step seconds counter
+ISR(TIMER1_COMPA_vect){
+	int32_t adj;
+
+	system_tick();
+	clock_uptime++;
+	// the counter just cleared, the new top sets the length of this second
+	adj=clock_slew;
+	if (adj>CLOCK_MAX_SLEW) adj=CLOCK_MAX_SLEW;
+	if (adj<-CLOCK_MAX_SLEW) adj=-CLOCK_MAX_SLEW;
+	clock_slew-=adj;
+	adj+=clock_freq+clock_rem;
+	clock_rem=adj & 0xffff;
+	OCR1A=CLOCK_TICKS_PER_SEC-1-(int16_t)(adj>>16);
+	if (clock_tick_callback){
+		(*clock_tick_callback)();
+	}
+}
+
+// interrupt, only wakes the cpu
+EMPTY_INTERRUPT(TIMER1_COMPB_vect);
+
+// Generate a 1s clock signal as interrupt
+void clock_init(void (*tick_callback)(void))
+{
+	clock_tick_callback=tick_callback;
+	/* write high byte first for 16 bit register access: */
+	TCNT1H=0;  /* set counter to zero*/
+	TCNT1L=0;
+	// Mode 4 table 14-4 page 132. CTC mode and top in OCR1A
+	// WGM13=0, WGM12=1, WGM11=0, WGM10=0
+	TCCR1A=(0<<COM1B1)|(0<<COM1B0)|(0<<WGM11);
+	TCCR1B=(1<<CS12)|(1<<CS10)|(1<<WGM12)|(0<<WGM13); // crystal clock/1024
+
+	// divide crystal clock:
+	// At what value to cause interrupt. Since we count from zero we have to subtract one.
+	OCR1A = CLOCK_TICKS_PER_SEC - 1;
+	// interrupt mask bit:
+	TIMSK1 = (1 << OCIE1A);
+}
+
+// reads the system time and the ticks elapsed in that second
+// must be called with interrupts disabled, returns 1 if the interrupt
+// of the second that just started is still pending
+static uint8_t clock_read(time_t *t, uint16_t *ticks)
+{
+	uint8_t pending=0;
+
+	*t=time(NULL);
+	*ticks=TCNT1;
+	if (TIFR1 & (1<<OCF1A)){
+		// a second elapsed but is not counted yet
+		*ticks=TCNT1;
+		pending=1;
+	}
+	return(pending);
+}
+
+// steps the clock by sec seconds plus frac/65536 second
+static void clock_step(int32_t sec, uint16_t frac)
+{
+	time_t t;
+	uint16_t ticks;
+	uint16_t step;
+
+	step=((uint32_t)frac*CLOCK_TICKS_PER_SEC)>>16;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		clock_read(&t,&ticks);
+		// a pending interrupt still adds its second after this block
+		ticks+=step;
+		if (ticks>=CLOCK_TICKS_PER_SEC){
+			ticks-=CLOCK_TICKS_PER_SEC;
+			sec++;
+		}
+		// writing the top value would block the compare match
+		if (ticks>=OCR1A) ticks=OCR1A-1;
+		TCNT1=ticks;
+		clock_slew=0;
+		set_system_time(t+sec);
+	}
+	clock_tm_valid=0;
+}
+
+void clock_get_stamp(struct clock_stamp *s)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (clock_read(&s->t,&s->ticks)) s->t++;
+	}
+}
+
+void clock_stamp_to_ntp(const struct clock_stamp *s, struct ntp_ts *ts)
+{
+	ts->sec=s->t+NTP_OFFSET;
+	ts->frac=((uint32_t)s->ticks<<16)/CLOCK_TICKS_PER_SEC;
+}
+
+void clock_get_ntp_time(struct ntp_ts *ts)
+{
+	struct clock_stamp s;
+
+	clock_get_stamp(&s);
+	clock_stamp_to_ntp(&s,ts);
+}
+
+int32_t clock_ntp_diff(const struct ntp_ts *a, const struct ntp_ts *b)
+{
+	int32_t sec;
+
+	sec=a->sec-b->sec;
+	if (sec>0x7ffe) return(INT32_MAX);
+	if (sec<-0x7ffe) return(-INT32_MAX);
+	return((sec<<16)+(int32_t)a->frac-(int32_t)b->frac);
+}
+
+void clock_ntp_add(struct ntp_ts *ts, int32_t d)
+{
+	uint32_t frac;
+
+	frac=(uint32_t)ts->frac+(d & 0xffff);
+	ts->frac=frac;
+	ts->sec+=(d>>16)+(frac>>16);
+}
+
+int32_t clock_to_ms(int32_t d)
+{
+	return((d>>16)*1000+(((d & 0xffff)*1000)>>16));
+}
+
+uint8_t clock_set_ntp_time(const struct ntp_ts *local, const struct ntp_ts *ref)
+{
+	int32_t sec;
+	int32_t offset;
+	int32_t interval;
+	int32_t freq;
+	int32_t fll;
+	uint8_t stepped;
+
+	offset=clock_ntp_diff(ref,local);
+	stepped=(clock_update_t==0 || offset>CLOCK_STEP_LIMIT || offset<-CLOCK_STEP_LIMIT);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		// leave out the part of the last offset that is not slewed out yet
+		fll=offset-clock_slew/(int32_t)CLOCK_TICKS_PER_SEC;
+	}
+	interval=local->sec-NTP_OFFSET-clock_update_t;
+	// a step is a hiccup of the network or a restart, not a frequency error
+	if (!stepped && interval>=CLOCK_FLL_MIN_INTERVAL && fll<=CLOCK_STEP_LIMIT && fll>=-CLOCK_STEP_LIMIT){
+		// frequency error in ticks per second, corrected with half gain
+		freq=clock_freq+fll*(int32_t)CLOCK_TICKS_PER_SEC/interval/2;
+		if (freq>CLOCK_MAX_FREQ) freq=CLOCK_MAX_FREQ;
+		if (freq<-CLOCK_MAX_FREQ) freq=-CLOCK_MAX_FREQ;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			clock_freq=freq;
+		}
+	}
+	if (stepped){
+		sec=ref->sec-local->sec;
+		if (ref->frac<local->frac) sec--;
+		clock_step(sec,ref->frac-local->frac);
+	}else{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			clock_slew=offset*(int32_t)CLOCK_TICKS_PER_SEC;
+		}
+	}
+	clock_update_t=time(NULL);
+	return(stepped);
+}
+
+const struct tm *clock_localtime(void)
+{
+	time_t now;
+	time_t t;
+	uint16_t sec;
+
+	now=time(NULL);
+	if (clock_tm_valid && now>=clock_tm_t && now<clock_tm_next){
+		// only the minutes and seconds change within the local hour
+		sec=clock_tm.tm_min*60+clock_tm.tm_sec+(uint16_t)(now-clock_tm_t);
+		clock_tm.tm_min=sec/60;
+		clock_tm.tm_sec=sec%60;
+		clock_tm_t=now;
+		return(&clock_tm);
+	}
+	localtime_r(&now,&clock_tm);
+	clock_tm_t=now;
+	// the local hour ends at its own minute 0, whatever the time zone
+	clock_tm_next=now+3600-(clock_tm.tm_min*60+clock_tm.tm_sec);
+	if (clock_dst_next){
+		t=(*clock_dst_next)(now);
+		if (t>now && t<clock_tm_next) clock_tm_next=t;
+	}
+	clock_tm_valid=1;
+	return(&clock_tm);
+}
+
+void clock_localtime_invalidate(void)
+{
+	clock_tm_valid=0;
+}
+
+void clock_set_dst(int (*dst)(const time_t *timer, int32_t *z), time_t (*next_switch)(time_t t))
+{
+	set_dst(dst);
+	clock_dst_next=next_switch;
+	clock_tm_valid=0;
+}
+
+// reads the seconds since clock_init and the ticks into the current second
+static void clock_get_uptime(uint32_t *sec, uint16_t *ticks)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		*sec=clock_uptime;
+		*ticks=TCNT1;
+		if (TIFR1 & (1<<OCF1A)){
+			*ticks=TCNT1;
+			(*sec)++;
+		}
+	}
+	// a slewed second may have a few ticks more
+	if (*ticks>=CLOCK_TICKS_PER_SEC) *ticks=CLOCK_TICKS_PER_SEC-1;
+}
+
+uint32_t clock_get_ms(void)
+{
+	uint32_t sec;
+	uint16_t ticks;
+
+	clock_get_uptime(&sec,&ticks);
+	return(sec*1000+(uint32_t)ticks*1000/CLOCK_TICKS_PER_SEC);
+}
+
+void clock_set_wakeup(uint16_t ms)
+{
+	uint32_t top;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		// at least one tick ahead, so the match is not missed
+		top=TCNT1+(uint32_t)ms*CLOCK_TICKS_PER_SEC/1000+1;
+		if (top<OCR1A && !(TIFR1 & (1<<OCF1A))){
+			OCR1B=top;
+			TIFR1=(1<<OCF1B);
+			TIMSK1|=(1<<OCIE1B);
+		}else{
+			TIMSK1&=~(1<<OCIE1B);
+		}
+	}
+}
+
+int32_t clock_get_freq(void)
+{
+	int32_t freq;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		freq=clock_freq;
+	}
+	return(freq);
+}
+
+void clock_restore(time_t t, int32_t freq)
+{
+	if (freq>CLOCK_MAX_FREQ) freq=CLOCK_MAX_FREQ;
+	if (freq<-CLOCK_MAX_FREQ) freq=-CLOCK_MAX_FREQ;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		clock_freq=freq;
+		if (t) set_system_time(t);
+	}
+	// the next update steps the clock and does not estimate the frequency
+	clock_update_t=0;
+	clock_tm_valid=0;
+}
+
+int32_t clock_get_drift(void)
+{
+	int32_t freq;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		freq=clock_freq;
+	}
+	// 1/65536 tick per second to parts per billion
+	return(freq*(1000000000/((int32_t)CLOCK_TICKS_PER_SEC*65536/1000))/1000);
+}
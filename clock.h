@@ -0,0 +1,61 @@
+/*
+ * clock.h
+ *
+ * Created: 14-10-2026 20:12:47
+ *  Author: Tim Dorssers
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <avr/io.h>
+#include <time.h>
+#include "ip_arp_udp_tcp.h"
+
+// TIMER1 counts at crystal clock/1024, one compare match per second
+#define CLOCK_TICKS_PER_SEC (F_CPU / 1024)
+
+// raw reading of the clock
+struct clock_stamp {
+	time_t t;
+	uint16_t ticks; // timer ticks into second t
+};
+
+// the callback is executed from interrupt once every second
+extern void clock_init(void (*tick_callback)(void));
+// current local time as NTP time stamp
+extern void clock_get_ntp_time(struct ntp_ts *ts);
+// reads the clock without conversion, can be called from interrupt
+extern void clock_get_stamp(struct clock_stamp *s);
+// converts a raw reading to an NTP time stamp
+extern void clock_stamp_to_ntp(const struct clock_stamp *s, struct ntp_ts *ts);
+// returns a-b in units of 1/65536 second, saturated beyond 32767 seconds
+extern int32_t clock_ntp_diff(const struct ntp_ts *a, const struct ntp_ts *b);
+// adds d units of 1/65536 second to the time stamp
+extern void clock_ntp_add(struct ntp_ts *ts, int32_t d);
+// converts units of 1/65536 second to milliseconds
+extern int32_t clock_to_ms(int32_t d);
+// corrects the clock so that the instant that was read as local becomes ref,
+// large offsets are stepped and small ones slewed, returns 1 if stepped
+extern uint8_t clock_set_ntp_time(const struct ntp_ts *local, const struct ntp_ts *ref);
+// milliseconds since clock_init, not affected by setting the clock
+extern uint32_t clock_get_ms(void);
+// makes the compare match B interrupt wake the cpu after ms milliseconds
+// if that is within the current second, the next second wakes it otherwise
+extern void clock_set_wakeup(uint16_t ms);
+// estimated frequency correction in parts per billion
+extern int32_t clock_get_drift(void);
+// frequency correction in internal units, to be saved for clock_restore
+extern int32_t clock_get_freq(void);
+// sets the time, unless t is 0, and the frequency correction saved before a
+// reset, the next NTP update sets the clock
+extern void clock_restore(time_t t, int32_t freq);
+// current local time, cached between calls
+extern const struct tm *clock_localtime(void);
+// call this after the time zone was changed
+extern void clock_localtime_invalidate(void);
+// sets the dst function of set_dst and a function that returns the first
+// dst switch after t, which ends the cached local time. Both may be NULL.
+extern void clock_set_dst(int (*dst)(const time_t *timer, int32_t *z), time_t (*next_switch)(time_t t));
+
+#endif /* CLOCK_H_ */
@@ -21,6 +21,8 @@
  * - Added init_dhcp()
  * - Added dhcp_tick()
  * - Removed dhcp_6sec_tick()
+ * - Randomized the retransmissions and the renewal, so clocks that start
+ *   together spread their requests
  *
  * A DHCP client.
  * This code uses the UDP_client framework. You need to enable UDP_client in ip_config.h to use this.
@@ -39,6 +41,7 @@
 #include "enc28j60.h"
 #include "ip_arp_udp_tcp.h"
 #include "ip_config.h"
+#include "jitter.h"
 
 #ifndef UDP_client
 #error "ERROR: you need to enable UDP_client support in ip_config.h to use the DHCP client"
@@ -325,17 +328,21 @@ uint8_t is_dhcp_cnt_down_zero(void) {
 }
 
 // set count down timer to specified divisor of lease time
+// minus up to a sixteenth at random
 void set_dhcp_renew_timer(uint8_t divisor) {
 	dhcp_cnt_down=dhcp_opt_leasetime/divisor;
 	if (is_dhcp_cnt_down_zero()) {
 		// quotient is zero, reinitialize:
 		dhcp_state=0;
+		return;
 	}
+	dhcp_cnt_down-=jitter_below(dhcp_cnt_down/16);
 }
 
-// set count down timer to exponential back-off value
+// set count down timer to exponential back-off value, plus or minus a
+// quarter at random
 void set_dhcp_retry_timer(void) {
-	dhcp_cnt_down=dhcp_retry;
+	dhcp_cnt_down=jitter_spread(dhcp_retry);
 }
 
 // init_dhcp() must be called before calling this function in your packetloop.
@@ -5,85 +5,138 @@ copyright (c) Davide Gironi, 2012
 
 Released under GPLv3.
 Please refer to LICENSE file for licensing information.
+
+Modified by: Tim Dorssers
+- Read out in the background, driven by the pin change interrupt and TIMER2
+- The clock interrupt is held off while the bits are read, so it cannot delay
+  the edges. Its flag stays set and it is served at the end of the read out.
+- A bad checksum is returned as -2
 */
 
 #include <stdio.h>
 #include <string.h>
 #include <avr/io.h>
-#include <util/delay.h>
+#include <avr/interrupt.h>
 #include "dht.h"
 
+#define DHT_STATE_IDLE 0
+#define DHT_STATE_START 1
+#define DHT_STATE_READ 2
+#define DHT_STATE_DONE 3
+#define DHT_STATE_ERROR 4
+
+static volatile uint8_t dht_state = DHT_STATE_IDLE;
+static volatile uint8_t dht_edges; //falling edges since the start signal
+static volatile uint8_t dht_rise; //timer value at the last rising edge
+static volatile uint8_t dht_bits[5];
+
 /*
- * get data from sensor
+ * end the read out and release the bus
  */
-#if DHT_FLOAT == 1
-int8_t dht_getdata(float *temperature, float *humidity) {
-#elif DHT_FLOAT == 0
-int8_t dht_getdata(int8_t *temperature, int8_t *humidity) {
-#endif
-	uint8_t bits[5];
-	uint8_t i,j = 0;
+static void dht_finish(uint8_t state) {
+	DHT_PCMSK &= ~(1<<DHT_PCINT);
+	TIMSK2 = 0;
+	TCCR2B = 0; //stop timer
+	TIMSK1 |= (1<<OCIE1A); //clock interrupt back on
+	DHT_DDR &= ~(1<<DHT_INPUTPIN); //input
+	DHT_PORT |= (1<<DHT_INPUTPIN); //pull-up
+	dht_state = state;
+}
 
-	memset(bits, 0, sizeof(bits));
+/*
+ * end of start signal or timeout
+ */
+ISR(TIMER2_COMPA_vect) {
+	if (dht_state == DHT_STATE_START) {
+		//release the bus and wait for the response
+		DHT_PORT |= (1<<DHT_INPUTPIN); //high
+		DHT_DDR &= ~(1<<DHT_INPUTPIN); //input
+		TCCR2A = 0; //normal mode
+		TCNT2 = 0;
+		TCCR2B = DHT_TIMER_PRESCALE;
+		OCR2A = DHT_TIMEOUT_TICKS;
+		TIFR2 = (1<<OCF2A);
+		PCIFR = (1<<DHT_PCIF);
+		DHT_PCMSK |= (1<<DHT_PCINT);
+		PCICR |= (1<<DHT_PCIE);
+		//the clock interrupt is the longest, hold it off for the ~5 ms of bits
+		TIMSK1 &= ~(1<<OCIE1A);
+		dht_state = DHT_STATE_READ;
+	} else {
+		//no edge in time
+		dht_finish(DHT_STATE_ERROR);
+	}
+}
 
-	//reset port
-	DHT_DDR |= (1<<DHT_INPUTPIN); //output
-	DHT_PORT |= (1<<DHT_INPUTPIN); //high
-	_delay_ms(100);
+/*
+ * edge of the data line
+ */
+ISR(DHT_PCINT_vect) {
+	uint8_t t = TCNT2;
+	uint8_t i;
+
+	if (dht_state != DHT_STATE_READ)
+		return;
+	if (DHT_PIN & (1<<DHT_INPUTPIN)) {
+		//rising edge, start of a high pulse
+		dht_rise = t;
+	} else {
+		//falling edge, the first two end the response of the sensor
+		//and each next one a bit, that is one if the high pulse was long
+		if (dht_edges >= 2) {
+			i = dht_edges - 2;
+			if ((uint8_t)(t - dht_rise) > DHT_ONE_TICKS)
+				dht_bits[i>>3] |= (1<<(7-(i&7)));
+		}
+		if (++dht_edges == 42) {
+			dht_finish(DHT_STATE_DONE);
+			return;
+		}
+	}
+	OCR2A = t + DHT_TIMEOUT_TICKS;
+}
+
+/*
+ * start a read out in the background
+ */
+void dht_start(void) {
+	if (dht_state == DHT_STATE_START || dht_state == DHT_STATE_READ)
+		return;
+	memset((void *)dht_bits, 0, sizeof(dht_bits));
+	dht_edges = 0;
 
 	//send request
+	DHT_DDR |= (1<<DHT_INPUTPIN); //output
 	DHT_PORT &= ~(1<<DHT_INPUTPIN); //low
-	#if DHT_TYPE == DHT_DHT11
-	_delay_ms(18);
-	#elif DHT_TYPE == DHT_DHT22
-	_delay_us(500);
-	#endif
-	DHT_PORT |= (1<<DHT_INPUTPIN); //high
-	DHT_DDR &= ~(1<<DHT_INPUTPIN); //input
-	_delay_us(40);
+	//the start signal ends in the compare interrupt
+	TCCR2B = 0;
+	TCCR2A = (1<<WGM21); //CTC mode
+	TCNT2 = 0;
+	OCR2A = DHT_START_TICKS;
+	TIFR2 = (1<<OCF2A);
+	TIMSK2 = (1<<OCIE2A);
+	dht_state = DHT_STATE_START;
+	TCCR2B = (1<<CS22)|(1<<CS21)|(1<<CS20); //clk/1024
+}
 
-	//check start condition 1
-	if((DHT_PIN & (1<<DHT_INPUTPIN))) {
-		return -1;
-	}
-	_delay_us(80);
-	//check start condition 2
-	if(!(DHT_PIN & (1<<DHT_INPUTPIN))) {
+/*
+ * get data of the last read out from sensor
+ */
+#if DHT_FLOAT == 1
+static int8_t dht_getdata(float *temperature, float *humidity) {
+#elif DHT_FLOAT == 0
+static int8_t dht_getdata(int8_t *temperature, int8_t *humidity) {
+#endif
+	uint8_t *bits = (uint8_t *)dht_bits;
+
+	if (dht_state == DHT_STATE_START || dht_state == DHT_STATE_READ)
+		return 1; //busy
+	if (dht_state != DHT_STATE_DONE) {
+		dht_state = DHT_STATE_IDLE;
 		return -1;
 	}
-	_delay_us(80);
-
-	//read the data
-	uint16_t timeoutcounter = 0;
-	for (j=0; j<5; j++) { //read 5 byte
-		uint8_t result=0;
-		for(i=0; i<8; i++) {//read every bit
-			timeoutcounter = 0;
-			while(!(DHT_PIN & (1<<DHT_INPUTPIN))) { //wait for an high input (non blocking)
-				timeoutcounter++;
-				if(timeoutcounter > DHT_TIMEOUT) {
-					return -1; //timeout
-				}
-			}
-			_delay_us(30);
-			if(DHT_PIN & (1<<DHT_INPUTPIN)) //if input is high after 30 us, get result
-				result |= (1<<(7-i));
-			timeoutcounter = 0;
-			while(DHT_PIN & (1<<DHT_INPUTPIN)) { //wait until input get low (non blocking)
-				timeoutcounter++;
-				if(timeoutcounter > DHT_TIMEOUT) {
-					return -1; //timeout
-				}
-			}
-		}
-		bits[j] = result;
-	}
+	dht_state = DHT_STATE_IDLE;
 
-	//reset port
-	DHT_DDR |= (1<<DHT_INPUTPIN); //output
-	DHT_PORT |= (1<<DHT_INPUTPIN); //low
-	_delay_ms(100);
-
 	//check checksum
 	if ((uint8_t)(bits[0] + bits[1] + bits[2] + bits[3]) == bits[4]) {
 		//return temperature and humidity
@@ -103,7 +156,7 @@ int8_t dht_getdata(int8_t *temperature, int8_t *humidity) {
 		return 0;
 	}
 
-	return -1;
+	return -2;
 }
 
 /*
@@ -23,6 +23,13 @@ References:
 #define DHT_PIN PINC
 #define DHT_INPUTPIN PINC4
 
+//setup pin change interrupt of the input pin
+#define DHT_PCMSK PCMSK1
+#define DHT_PCINT PCINT12
+#define DHT_PCIE PCIE1
+#define DHT_PCIF PCIF1
+#define DHT_PCINT_vect PCINT1_vect
+
 //sensor type
 #define DHT_DHT11 1
 #define DHT_DHT22 2
@@ -35,10 +42,24 @@ References:
 #define DHT_FLOAT 1
 #endif
 
-//timeout retries
-#define DHT_TIMEOUT 200
+//TIMER2 ticks of the start signal at clk/1024
+#if DHT_TYPE == DHT_DHT11
+#define DHT_START_TICKS (F_CPU/1024/50) //20 ms
+#elif DHT_TYPE == DHT_DHT22
+#define DHT_START_TICKS (F_CPU/1024/1000+1) //1 ms
+#endif
+
+//TIMER2 ticks at clk/32 while reading
+#define DHT_TIMER_PRESCALE ((1<<CS21)|(1<<CS20))
+#define DHT_ONE_TICKS (F_CPU/32000*48/1000) //high pulse of a one bit is longer than 48 us
+#define DHT_TIMEOUT_TICKS (F_CPU/32000*250/1000) //no edge for 250 us ends the read out
 
 //functions
+//a read out takes about 25 ms, the sensor must not be read more than once a second
+extern void dht_start(void);
+//the get functions return 0 with the values of the last read out, -1 if it
+//failed or there are no new values, -2 if the checksum was bad and 1 while
+//reading out
 #if DHT_FLOAT == 1
 extern int8_t dht_gettemperature(float *temperature);
 extern int8_t dht_gethumidity(float *humidity);
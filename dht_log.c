@@ -0,0 +1,214 @@
+/*
+ * dht_log.c
+ *
+ * Created: 14-10-2026 22:39:52
+ *  Author: Tim Dorssers
+ *
+ * Ring buffer of temperature and humidity samples, one sample every
+ * DHT_LOG_INTERVAL seconds. Only the oldest and the newest sample are kept
+ * as values, a sample is stored in one byte as the difference to the
+ * previous sample: temperature in the high nibble, humidity in the low
+ * nibble, both from -8 to 7. A larger change is stored as DHT_LOG_ESCAPE
+ * followed by the temperature and the humidity, so the ring holds fewer than
+ * DHT_LOG_SIZE samples after fast changes. The time of a sample follows from
+ * its position and the time of the newest sample.
+ */
+
+#include <avr/io.h>
+#include <string.h>
+#include <time.h>
+#include "dht_log.h"
+
+#define DHT_LOG_SPAN ((time_t)DHT_LOG_SIZE*DHT_LOG_INTERVAL)
+// the differences in a byte of the ring
+#define DHT_LOG_TEMP(d) ((int8_t)(d)>>4)
+#define DHT_LOG_HUM(d) ((int8_t)((d)<<4)>>4)
+// a temperature difference of -8 without humidity difference, which is
+// stored as an escaped sample instead
+#define DHT_LOG_ESCAPE 0x80
+
+static uint8_t dht_log_data[DHT_LOG_SIZE]; // difference to the previous sample
+static uint16_t dht_log_head=0; // ring position of the oldest sample
+static uint16_t dht_log_bytes=0; // bytes used from the head on
+static uint16_t dht_log_count=0;
+static int8_t dht_log_temp; // oldest sample
+static int8_t dht_log_hum;
+static int8_t dht_log_last_temp; // newest sample
+static int8_t dht_log_last_hum;
+static time_t dht_log_t; // time of the newest sample
+
+// returns the byte at offset i from the head
+static uint8_t dht_log_byte(uint16_t i)
+{
+	return(dht_log_data[(dht_log_head+i)%DHT_LOG_SIZE]);
+}
+
+// returns the length of the sample at offset i
+static uint8_t dht_log_len(uint16_t i)
+{
+	return((dht_log_byte(i)==DHT_LOG_ESCAPE) ? DHT_LOG_MAX_LEN : 1);
+}
+
+// applies the sample at offset i to the previous values
+static void dht_log_apply(uint16_t i, int8_t *temperature, int8_t *humidity)
+{
+	uint8_t d;
+
+	d=dht_log_byte(i);
+	if (d==DHT_LOG_ESCAPE){
+		*temperature=dht_log_byte(i+1);
+		*humidity=dht_log_byte(i+2);
+	}else{
+		*temperature+=DHT_LOG_TEMP(d);
+		*humidity+=DHT_LOG_HUM(d);
+	}
+}
+
+// appends a byte to the ring
+static void dht_log_put(uint8_t d)
+{
+	dht_log_data[(dht_log_head+dht_log_bytes)%DHT_LOG_SIZE]=d;
+	dht_log_bytes++;
+}
+
+// appends a sample, the oldest ones are dropped to make room
+static void dht_log_push(int8_t temperature, int8_t humidity)
+{
+	int16_t dt;
+	int16_t dh;
+	uint8_t len=1;
+	uint8_t l;
+
+	if (dht_log_count==0){
+		dht_log_temp=dht_log_last_temp=temperature;
+		dht_log_hum=dht_log_last_hum=humidity;
+		dht_log_bytes=0;
+		dht_log_put(0);
+		dht_log_count=1;
+		return;
+	}
+	dt=temperature-dht_log_last_temp;
+	dh=humidity-dht_log_last_hum;
+	if (dt<-8 || dt>7 || dh<-8 || dh>7 || (dt==-8 && dh==0)) len=DHT_LOG_MAX_LEN;
+	while(dht_log_bytes+len>DHT_LOG_SIZE){
+		// the second oldest sample becomes the oldest
+		l=dht_log_len(0);
+		dht_log_apply(l,&dht_log_temp,&dht_log_hum);
+		dht_log_head=(dht_log_head+l)%DHT_LOG_SIZE;
+		dht_log_bytes-=l;
+		dht_log_count--;
+	}
+	if (len==1){
+		dht_log_put(((uint8_t)dt<<4)|(dh & 0x0f));
+	}else{
+		dht_log_put(DHT_LOG_ESCAPE);
+		dht_log_put(temperature);
+		dht_log_put(humidity);
+	}
+	dht_log_last_temp=temperature;
+	dht_log_last_hum=humidity;
+	dht_log_count++;
+}
+
+void dht_log_clear(void)
+{
+	dht_log_head=0;
+	dht_log_bytes=0;
+	dht_log_count=0;
+}
+
+void dht_log_add(time_t t, int8_t temperature, int8_t humidity)
+{
+	time_t slot;
+
+	slot=t-t%DHT_LOG_INTERVAL;
+	if (dht_log_count){
+		if (slot<=dht_log_t){
+			// this interval has its sample or the clock was set back
+			if (dht_log_t-slot<DHT_LOG_SPAN) return;
+			dht_log_clear();
+		}else if (slot-dht_log_t>=DHT_LOG_SPAN){
+			// nothing left of the old samples
+			dht_log_clear();
+		}else{
+			// repeat the newest sample for the missed intervals
+			while(dht_log_t+DHT_LOG_INTERVAL<slot){
+				dht_log_push(dht_log_last_temp,dht_log_last_hum);
+				dht_log_t+=DHT_LOG_INTERVAL;
+			}
+		}
+	}
+	dht_log_push(temperature,humidity);
+	dht_log_t=slot;
+}
+
+uint16_t dht_log_get_count(void)
+{
+	return(dht_log_count);
+}
+
+uint16_t dht_log_get_free(void)
+{
+	return(DHT_LOG_SIZE-dht_log_bytes);
+}
+
+uint8_t dht_log_seek(struct dht_log_pos *pos, uint16_t n)
+{
+	pos->n=0;
+	pos->i=0;
+	pos->t=dht_log_t-(time_t)(dht_log_count-1)*DHT_LOG_INTERVAL;
+	pos->temperature=dht_log_temp;
+	pos->humidity=dht_log_hum;
+	if (dht_log_count==0){
+		return(0);
+	}
+	while(pos->n<n){
+		if (!dht_log_next(pos)) return(0);
+	}
+	return(1);
+}
+
+uint8_t dht_log_next(struct dht_log_pos *pos)
+{
+	if (pos->n+1>=dht_log_count){
+		pos->n=dht_log_count;
+		return(0);
+	}
+	pos->n++;
+	pos->i+=dht_log_len(pos->i);
+	pos->t+=DHT_LOG_INTERVAL;
+	dht_log_apply(pos->i,&pos->temperature,&pos->humidity);
+	return(1);
+}
+
+uint16_t dht_log_get_stat(struct dht_log_stat *stat)
+{
+	struct dht_log_pos pos;
+
+	memset(stat,0,sizeof(struct dht_log_stat));
+	if (!dht_log_seek(&pos,0)){
+		return(0);
+	}
+	stat->low_temp=stat->high_temp=pos.temperature;
+	stat->low_hum=stat->high_hum=pos.humidity;
+	stat->low_temp_t=stat->high_temp_t=stat->low_hum_t=stat->high_hum_t=pos.t;
+	while(dht_log_next(&pos)){
+		if (pos.temperature>stat->high_temp){
+			stat->high_temp=pos.temperature;
+			stat->high_temp_t=pos.t;
+		}
+		if (pos.temperature<stat->low_temp){
+			stat->low_temp=pos.temperature;
+			stat->low_temp_t=pos.t;
+		}
+		if (pos.humidity>stat->high_hum){
+			stat->high_hum=pos.humidity;
+			stat->high_hum_t=pos.t;
+		}
+		if (pos.humidity<stat->low_hum){
+			stat->low_hum=pos.humidity;
+			stat->low_hum_t=pos.t;
+		}
+	}
+	return(dht_log_count);
+}
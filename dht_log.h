@@ -0,0 +1,59 @@
+/*
+ * dht_log.h
+ *
+ * Created: 14-10-2026 22:41:07
+ *  Author: Tim Dorssers
+ */
+
+#ifndef DHT_LOG_H_
+#define DHT_LOG_H_
+
+#include <avr/io.h>
+#include <time.h>
+
+// bytes in the ring, a sample takes one byte or DHT_LOG_MAX_LEN bytes if it
+// changed by more than a nibble
+#define DHT_LOG_SIZE 288
+#define DHT_LOG_MAX_LEN 3
+// seconds between two samples, 24 hours in one byte samples
+#define DHT_LOG_INTERVAL 300
+
+// a position in the log
+struct dht_log_pos {
+	uint16_t n; // sample number, 0 is the oldest
+	uint16_t i; // offset of the sample in the ring
+	time_t t;
+	int8_t temperature;
+	int8_t humidity;
+};
+
+// extremes in the log and their time stamps
+struct dht_log_stat {
+	int8_t low_temp;
+	int8_t high_temp;
+	int8_t low_hum;
+	int8_t high_hum;
+	time_t low_temp_t;
+	time_t high_temp_t;
+	time_t low_hum_t;
+	time_t high_hum_t;
+};
+
+// forgets all samples
+extern void dht_log_clear(void);
+// stores the first reading of every interval, gaps are filled with the
+// previous sample
+extern void dht_log_add(time_t t, int8_t temperature, int8_t humidity);
+// returns the number of samples
+extern uint16_t dht_log_get_count(void);
+// returns the free bytes, the oldest samples are dropped when a new one
+// does not fit
+extern uint16_t dht_log_get_free(void);
+// moves pos to sample n, returns 0 if there is no such sample
+extern uint8_t dht_log_seek(struct dht_log_pos *pos, uint16_t n);
+// moves pos to the next sample, returns 0 past the newest sample
+extern uint8_t dht_log_next(struct dht_log_pos *pos);
+// computes the extremes, returns the number of samples
+extern uint16_t dht_log_get_stat(struct dht_log_stat *stat);
+
+#endif /* DHT_LOG_H_ */
@@ -6,6 +6,8 @@
  * Modified by: Tim Dorssers
  * - Added init_dnslkup() to specify the dns server to query
  * - Removed unused function string_is_ipv4()
+ * - Store up to DNSLKUP_MAX_ANSWERS addresses of the answer
+ * - Keep the lowest TTL of the stored addresses
  *
  * DNS look-up functions based on the udp client
  *
@@ -19,6 +21,7 @@
 #include "enc28j60.h"
 #include "ip_arp_udp_tcp.h"
 #include "ip_config.h"
+#include "dnslkup.h"
 
 #ifndef UDP_client
 #error "ERROR: you need to enable UDP_client support in ip_config.h to use the DNS look-up"
@@ -29,7 +32,9 @@ static uint8_t dnstid_l=0; // a counter for transaction ID
 #define DNSCLIENT_SRC_PORT_H 0xe0 
 static uint8_t dnsip[4]={0,0,0,0};
 static uint8_t haveDNSanswer=0;
-static uint8_t dns_answerip[4];
+static uint8_t dns_answerip[DNSLKUP_MAX_ANSWERS][4];
+static uint8_t dns_answercnt=0;
+static uint32_t dns_answerttl=0;
 static uint8_t dns_ansError=0;
 
 void init_dnslkup(uint8_t *mydns){
@@ -52,8 +57,24 @@ uint8_t dnslkup_get_error_info(void)
 // ip is the return value
 void dnslkup_get_ip(uint8_t *ip)
 {       
+	dnslkup_get_ip_n(0,ip);
+}
+
+uint8_t dnslkup_get_ip_count(void)
+{
+	return(dns_answercnt);
+}
+
+uint32_t dnslkup_get_ttl(void)
+{
+	return(dns_answerttl);
+}
+
+// ip is the return value
+void dnslkup_get_ip_n(uint8_t n,uint8_t *ip)
+{
 	uint8_t i=0;
-	while(i<4){ip[i]=dns_answerip[i];i++;}
+	while(i<4){ip[i]=dns_answerip[n][i];i++;}
 }
 
 // send a DNS udp request packet
@@ -126,6 +147,8 @@ uint8_t dnslkup_request(uint8_t *buf,const char *hostname,const uint8_t *gwmac)
 // We set also the variable haveDNSanswer
 uint8_t udp_client_check_for_dns_answer(uint8_t *buf,uint16_t plen){
 	uint8_t i;
+	uint8_t ancount;
+	uint32_t ttl;
 	if (plen<70){
 		return(0);
 	}
@@ -159,13 +182,20 @@ uint8_t udp_client_check_for_dns_answer(uint8_t *buf,uint16_t plen){
 		dns_ansError=1;
 		return(0);
 	}
-	// there might be multiple answers, we use only the first one
+	// there might be multiple answers, we use the first DNSLKUP_MAX_ANSWERS
+	// A records of the answer section
 	//
 	// UDP_DATA_P+12+querylen is first byte of first answer.
 	// The answer contains again the domain name and we need to
 	// jump over it to find the IP. This part can be abbreviated by
 	// the use of 2 byte pointers. See RFC 1035.
 	i=12+buf[UDP_DATA_P]; // we encoded the query len into tid
+	ancount=buf[UDP_DATA_P+7]; // lower byte of the answer count
+	dns_answercnt=0;
+	if (ancount==0){
+		dns_ansError=3; // no answer records
+		return(0);
+	}
 ChecNextResp:
 	if (buf[UDP_DATA_P+i] & 0xc0){
 		// pointer
@@ -187,9 +217,12 @@ ChecNextResp:
 	if (buf[UDP_DATA_P+i+1] != 1){    // check type == 1 for "A"
 		i += 2 + 2 + 4;    // skip type & class & TTL
 		i += buf[UDP_DATA_P+i+1] + 2;    // skip data length bytes
-		if (i < plen-UDP_DATA_P-7){
+		if (--ancount && i < plen-UDP_DATA_P-7){
 			goto ChecNextResp;
 		}
+		if (dns_answercnt){
+			goto HaveAnswer;
+		}
 		dns_ansError=3; // no A record found but packet ends 
 		return(0);
 	} 
@@ -199,8 +232,18 @@ ChecNextResp:
 		dns_ansError=2; // not IPv4
 		return(0);
 	}
+	ttl=((uint32_t)buf[UDP_DATA_P+i+4]<<24)|((uint32_t)buf[UDP_DATA_P+i+5]<<16)|((uint16_t)buf[UDP_DATA_P+i+6]<<8)|buf[UDP_DATA_P+i+7];
+	if (dns_answercnt==0 || ttl<dns_answerttl){
+		dns_answerttl=ttl;
+	}
 	i+=10;
-	memcpy(dns_answerip,buf+UDP_DATA_P+i,4);
+	memcpy(dns_answerip[dns_answercnt],buf+UDP_DATA_P+i,4);
+	dns_answercnt++;
+	i+=4;
+	if (--ancount && dns_answercnt<DNSLKUP_MAX_ANSWERS && i < plen-UDP_DATA_P-7){
+		goto ChecNextResp;
+	}
+HaveAnswer:
 	haveDNSanswer=1;
 	return(1);
 }
@@ -12,6 +12,9 @@
 #ifndef DNSLKUP_H
 #define DNSLKUP_H 1
 
+// number of addresses that are kept of an answer
+#define DNSLKUP_MAX_ANSWERS 4
+
 // to use this you need to enable UDP_client in the file ip_config.h
 //
 extern void init_dnslkup(uint8_t *mydns);
@@ -32,6 +35,12 @@ uint8_t udp_client_check_for_dns_answer(uint8_t *buf,uint16_t plen);
 // returns the host IP of the name that we looked up if dnslkup_haveanswer did return 1
 // ip is the return value
 extern void dnslkup_get_ip(uint8_t *ip);
+// returns the number of host IPs in the answer
+extern uint8_t dnslkup_get_ip_count(void);
+// returns host IP number n of the answer, n is below dnslkup_get_ip_count
+extern void dnslkup_get_ip_n(uint8_t n,uint8_t *ip);
+// returns the lowest time to live in seconds of the host IPs in the answer
+extern uint32_t dnslkup_get_ttl(void);
 // Determine if the string is a hostname or an IP address
 // A valid IP is e.g. "10.10.11.22"
 extern uint8_t string_is_ipv4(const char *str);
@@ -0,0 +1,75 @@
+/*
+ * eewrite.c
+ *
+ * Created: 15-10-2026 00:47:36
+ *  Author: Tim Dorssers
+ *
+ * Writes to eeprom from the EEPROM ready interrupt, one byte per interrupt.
+ * A byte takes 3.4 ms to write, the cpu goes on meanwhile. The interrupt
+ * skips the bytes that do not change, so they are not worn.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "eewrite.h"
+
+struct eewrite_region {
+	uint16_t ee;
+	const uint8_t *ram;
+	uint8_t len;
+};
+
+static struct eewrite_region eewrite_queue[EEWRITE_QUEUE];
+static volatile uint8_t eewrite_head=0; // region being written
+static volatile uint8_t eewrite_count=0;
+
+// interrupt, eeprom is ready for the next byte
+ISR(EE_READY_vect)
+{
+	struct eewrite_region *r;
+	uint8_t d;
+
+	while(eewrite_count){
+		r=&eewrite_queue[eewrite_head];
+		while(r->len){
+			EEAR=r->ee;
+			EECR|=(1<<EERE);
+			d=*r->ram;
+			r->ee++;
+			r->ram++;
+			r->len--;
+			if (EEDR!=d){
+				EEDR=d;
+				EECR|=(1<<EEMPE);
+				EECR|=(1<<EEPE);
+				return;
+			}
+		}
+		eewrite_head=(eewrite_head+1)%EEWRITE_QUEUE;
+		eewrite_count--;
+	}
+	// all done
+	EECR&=~(1<<EERIE);
+}
+
+uint8_t eewrite(void *ee, const void *ram, uint8_t len)
+{
+	struct eewrite_region *r;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (eewrite_count==EEWRITE_QUEUE) return(0);
+		r=&eewrite_queue[(eewrite_head+eewrite_count)%EEWRITE_QUEUE];
+		r->ee=(uint16_t)ee;
+		r->ram=ram;
+		r->len=len;
+		eewrite_count++;
+		EECR|=(1<<EERIE);
+	}
+	return(1);
+}
+
+uint8_t eewrite_busy(void)
+{
+	return(eewrite_count || (EECR & (1<<EEPE)));
+}
@@ -0,0 +1,25 @@
+/*
+ * eewrite.h
+ *
+ * Created: 15-10-2026 00:48:12
+ *  Author: Tim Dorssers
+ */
+
+#ifndef EEWRITE_H_
+#define EEWRITE_H_
+
+#include <avr/io.h>
+
+// number of regions that can wait to be written
+#define EEWRITE_QUEUE 8
+
+// copies len bytes from ram to eeprom in the background, bytes that are
+// already equal are not written. The regions are written in the order they
+// were queued. The bytes are read from ram when they are written, the ram
+// must stay valid until then. Returns 0 if the queue is full. Do not use the
+// avr-libc eeprom functions while eewrite_busy().
+extern uint8_t eewrite(void *ee, const void *ram, uint8_t len);
+// returns 1 while regions are waiting or being written
+extern uint8_t eewrite_busy(void);
+
+#endif /* EEWRITE_H_ */
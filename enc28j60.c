@@ -10,6 +10,12 @@
  * - Removed timeout.h
  * - Changed enc28j60PacketSend() properly implement errata 13
  * - Changed enc28j60Init() to set duplex operation independent from led configuration
+ * - Added ENC28J60_INT option to receive on the INT line
+ * - Added ENC28J60_TIMESTAMP option to time stamp received and sent packets
+ * - Added ENC28J60_RX_FILTER option to skip unwanted packets after their headers
+ * - Changed enc28j60ReadBuffer() and enc28j60WriteBuffer() to overlap the loop with the transfer
+ * - Added enc28j60PacketSendP() to append data from flash to a packet
+ * - Added ENC28J60_STATS option to count packets and errors
  *
  * Based on the enc28j60.c file from the AVRlib library by Pascal Stang.
  * For AVRlib See http://www.procyonengineering.com/
@@ -19,9 +25,17 @@
  * Chip type	   : ATMEGA88/ATMEGA168/ATMEGA328/ATMEGA644/ATMEGA1284 with ENC28J60
  *********************************************/
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 #include "ip_config.h"
 #include "enc28j60.h"
+#ifdef ENC28J60_TIMESTAMP
+#include "clock.h"
+#endif
+#ifdef ENC28J60_STATS
+#include "stats.h"
+#endif
 
 
 static uint8_t Enc28j60Bank;
@@ -40,6 +54,29 @@ static int16_t gNextPacketPtr;
 #define ENC28J60_CONTROL_SI PORTB5
 #define ENC28J60_CONTROL_SCK PORTB7
 #endif
+#ifdef ENC28J60_INT
+// The INT line goes low when a packet arrived. Wire it to INT0 (PD2), on the
+// NTP clock board this pin is display D0 which must then be moved.
+#define ENC28J60_INT_PORT PORTD
+#define ENC28J60_INT_DDR DDRD
+#define ENC28J60_INT_PIN PORTD2
+#define ENC28J60_INT_vect INT0_vect
+// set by the interrupt, the receive buffer may hold a packet
+static volatile uint8_t gRxPending=1;
+#endif
+#ifdef ENC28J60_RX_FILTER
+// decides on the headers if a packet is read
+static uint8_t (*gRxFilter)(uint8_t *buf,uint16_t len);
+#endif
+#ifdef ENC28J60_TIMESTAMP
+static struct clock_stamp gRxStamp; // last received packet
+static struct clock_stamp gTxStamp; // last sent packet
+#ifdef ENC28J60_INT
+// taken by the interrupt, valid while gIntStamped is set
+static struct clock_stamp gIntStamp;
+static volatile uint8_t gIntStamped=0;
+#endif
+#endif
 // set CS to 0 = active
 #define CSACTIVE ENC28J60_CONTROL_PORT&=~(1<<ENC28J60_CONTROL_CS)
 // set CS to 1 = passive
@@ -79,17 +116,30 @@ void enc28j60WriteOp(uint8_t op, uint8_t address, uint8_t data)
 	CSPASSIVE;
 }
 
+// The bulk transfers start the next byte as soon as the previous one is
+// done and do the pointer and counter work while it is shifted out. The
+// received byte is double buffered, so it is read before the next transfer
+// is started and stored during it. At SPI2X a byte takes 16 cycles, the
+// loop adds about 4 cycles of SPIF polling instead of about 10 cycles.
 void enc28j60ReadBuffer(uint16_t len, uint8_t* data)
 {
+	uint8_t c;
 	CSACTIVE;
 	// issue read command
 	SPDR = ENC28J60_READ_BUF_MEM;
 	waitspi();
-	while(len)
+	if (len)
 	{
-		len--;
-		// read data
 		SPDR = 0x00;
+		while(--len)
+		{
+			waitspi();
+			c = SPDR;
+			// start the next byte, store this one while it is read
+			SPDR = 0x00;
+			*data = c;
+			data++;
+		}
 		waitspi();
 		*data = SPDR;
 		data++;
@@ -100,18 +150,26 @@ void enc28j60ReadBuffer(uint16_t len, uint8_t* data)
 
 void enc28j60WriteBuffer(uint16_t len, uint8_t* data)
 {
+	uint8_t c;
 	CSACTIVE;
 	// issue write command
 	SPDR = ENC28J60_WRITE_BUF_MEM;
-	waitspi();
-	while(len)
+	if (len)
 	{
-		len--;
-		// write data
-		SPDR = *data;
-		data++;
+		c = *data;
+		while(--len)
+		{
+			data++;
+			waitspi();
+			// write data, the next byte is fetched while this one is sent
+			SPDR = c;
+			c = *data;
+		}
+		// the last byte, nothing to fetch after it
 		waitspi();
+		SPDR = c;
 	}
+	waitspi();
 	CSPASSIVE;
 }
 
@@ -288,6 +346,15 @@ void enc28j60Init(uint8_t* macaddr)
 	enc28j60SetBank(ECON1);
 	// enable interrupts
 	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, EIE, EIE_INTIE|EIE_PKTIE);
+#ifdef ENC28J60_INT
+	// INT is an active low output, external interrupt on the falling edge
+	ENC28J60_INT_DDR&=~(1<<ENC28J60_INT_PIN);
+	ENC28J60_INT_PORT|=(1<<ENC28J60_INT_PIN);
+	EICRA=(EICRA & ~((1<<ISC01)|(1<<ISC00)))|(1<<ISC01);
+	EIFR=(1<<INTF0);
+	EIMSK|=(1<<INT0);
+	gRxPending=1;
+#endif
 	// enable packet reception
 	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_RXEN);
 	/* Magjack leds configuration, see enc28j60 datasheet, page 11 */
@@ -320,6 +387,32 @@ void enc28j60DisableBroadcast( void ) {
 }
 #endif
 
+#ifdef ENC28J60_RX_FILTER
+void enc28j60SetRxFilter(uint8_t (*filter)(uint8_t *buf,uint16_t len))
+{
+	gRxFilter=filter;
+}
+
+// Changes the pattern match filter to accept only the ARP broadcasts that
+// ask for ip: the pattern of enc28j60Init() plus the target IP address.
+// 06 08 -- ff ff ff ff ff ff -> bytes 0-5 and 12-13 as in enc28j60Init()
+// 38-41 target IP -> EPMM4=0xc0, EPMM5=0x03
+void enc28j60SetArpFilter(uint8_t *ip)
+{
+	uint32_t sum;
+	// ip checksum of ff ff ff ff ff ff 08 06 and the 4 bytes of the ip
+	sum=0xffffUL*3+0x0806+((uint16_t)ip[0]<<8|ip[1])+((uint16_t)ip[2]<<8|ip[3]);
+	while(sum>>16){
+		sum=(sum & 0xffff)+(sum>>16);
+	}
+	sum=~sum;
+	enc28j60Write(EPMM4, 0xc0);
+	enc28j60Write(EPMM5, 0x03);
+	enc28j60Write(EPMCSL, sum & 0xff);
+	enc28j60Write(EPMCSH, (sum>>8) & 0xff);
+}
+#endif
+
 // link status
 uint8_t enc28j60linkup(void)
 {
@@ -338,7 +431,8 @@ uint8_t enc28j60linkup(void)
 	return(0);
 }
 
-void enc28j60PacketSend(uint16_t len, uint8_t* packet)
+// prepares the transmit buffer for a packet of len bytes
+static void enc28j60TxBegin(uint16_t len)
 {
 	// wait until transmission has finished; referring to the data sheet and
 	// to the errata (Errata Issue 13; Example 1) you only need to wait until either
@@ -348,6 +442,14 @@ void enc28j60PacketSend(uint16_t len, uint8_t* packet)
 	uint16_t count = 0;
 	while ((enc28j60Read(EIR) & (EIR_TXIF | EIR_TXERIF)) == 0 && ++count < 1000U);
 	if ((enc28j60Read(EIR) & EIR_TXERIF) || count == 1000U) {
+#ifdef ENC28J60_STATS
+		// before the first transmission nothing was sent
+		if (enc28j60Read(EIR) & EIR_TXERIF) {
+			STATS_INC(tx_errors);
+		} else if (enc28j60Read(ECON1) & ECON1_TXRTS) {
+			STATS_INC(tx_timeouts);
+		}
+#endif
 		// cancel previous transmission if stuck
 		enc28j60WriteOp(ENC28J60_BIT_FIELD_CLR, ECON1, ECON1_TXRTS);
 	}
@@ -368,12 +470,92 @@ void enc28j60PacketSend(uint16_t len, uint8_t* packet)
 	enc28j60Write(ETXNDH, (TXSTART_INIT+len)>>8);
 	// write per-packet control byte (0x00 means use macon3 settings)
 	enc28j60WriteOp(ENC28J60_WRITE_BUF_MEM, 0, 0x00);
-	// copy the packet into the transmit buffer
-	enc28j60WriteBuffer(len, packet);
+}
+
+// sends the contents of the transmit buffer
+static void enc28j60TxStart(void)
+{
+#ifdef ENC28J60_TIMESTAMP
+	clock_get_stamp(&gTxStamp);
+#endif
 	// send the contents of the transmit buffer onto the network
 	enc28j60WriteOp(ENC28J60_BIT_FIELD_SET, ECON1, ECON1_TXRTS);
+#ifdef ENC28J60_STATS
+	STATS_INC(tx_packets);
+#endif
 }
 
+void enc28j60PacketSend(uint16_t len, uint8_t* packet)
+{
+	enc28j60TxBegin(len);
+	// copy the packet into the transmit buffer
+	enc28j60WriteBuffer(len, packet);
+	enc28j60TxStart();
+}
+
+// sends len bytes of packet followed by len_p bytes from flash
+void enc28j60PacketSendP(uint16_t len, uint8_t* packet, uint16_t len_p, const char *data_p)
+{
+	uint8_t c;
+	enc28j60TxBegin(len+len_p);
+	enc28j60WriteBuffer(len, packet);
+	CSACTIVE;
+	// issue write command, the buffer pointer continues after the packet
+	SPDR = ENC28J60_WRITE_BUF_MEM;
+	if (len_p)
+	{
+		c = pgm_read_byte(data_p);
+		while(--len_p)
+		{
+			data_p++;
+			waitspi();
+			SPDR = c;
+			c = pgm_read_byte(data_p);
+		}
+		waitspi();
+		SPDR = c;
+	}
+	waitspi();
+	CSPASSIVE;
+	enc28j60TxStart();
+}
+
+#ifdef ENC28J60_TIMESTAMP
+// time stamp of the packet last returned by enc28j60PacketReceive()
+void enc28j60GetRxStamp(struct clock_stamp *s)
+{
+	*s=gRxStamp;
+}
+
+// time stamp of the start of the last transmission
+void enc28j60GetTxStamp(struct clock_stamp *s)
+{
+	*s=gTxStamp;
+}
+#endif
+
+#ifdef ENC28J60_INT
+// a packet arrived
+ISR(ENC28J60_INT_vect){
+#ifdef ENC28J60_TIMESTAMP
+	// the line only falls when the buffer was empty, so this is the
+	// arrival of the next packet to be read
+	if (!gIntStamped){
+		clock_get_stamp(&gIntStamp);
+		gIntStamped=1;
+	}
+#endif
+	gRxPending=1;
+}
+
+// makes the next enc28j60PacketReceive() check the receive buffer, call it
+// periodically in case an interrupt is missed (Rev. B7 Silicon Errata point 6)
+void enc28j60RxPoll(void)
+{
+	gRxPending=1;
+}
+#endif
+
 // just probe if there might be a packet
 uint8_t enc28j60hasRxPkt(void)
 {
@@ -392,12 +574,36 @@ uint16_t enc28j60PacketReceive(uint16_t maxlen, uint8_t* packet)
 {
 	uint16_t rxstat;
 	uint16_t len;
+#ifdef ENC28J60_RX_FILTER
+	uint16_t hlen;
+#endif
 	// check if a packet has been received and buffered
 	//if( !(enc28j60Read(EIR) & EIR_PKTIF) )
 	// The above does not work. See Rev. B4 Silicon Errata point 6.
+#ifdef ENC28J60_INT
+	// no SPI access if nothing arrived, INT stays low while packets are
+	// pending so the counter is read again after every packet
+	if (!gRxPending){
+		return(0);
+	}
+	gRxPending=0;
+#endif
 	if( enc28j60Read(EPKTCNT) ==0 ){
 		return(0);
 	}
+#ifdef ENC28J60_INT
+	gRxPending=1;
+#endif
+#ifdef ENC28J60_TIMESTAMP
+	// packets that arrived while the line was low are stamped when found
+#ifdef ENC28J60_INT
+	if (gIntStamped){
+		gRxStamp=gIntStamp;
+		gIntStamped=0;
+	}else
+#endif
+	clock_get_stamp(&gRxStamp);
+#endif
 
 	// Set the read pointer to the start of the received packet
 	enc28j60Write(ERDPTL, (gNextPacketPtr &0xFF));
@@ -419,9 +625,33 @@ uint16_t enc28j60PacketReceive(uint16_t maxlen, uint8_t* packet)
 	// check CRC and symbol errors (see datasheet page 44, table 7-3):
 	// The ERXFCON.CRCEN is set by default. Normally we should not
 	// need to check this.
+#ifdef ENC28J60_STATS
+	STATS_INC(rx_packets);
+#endif
 	if ((rxstat & 0x80)==0){
 		// invalid
 		len=0;
+#ifdef ENC28J60_STATS
+		STATS_INC(rx_errors);
+#endif
+#ifdef ENC28J60_RX_FILTER
+	}else if (gRxFilter){
+		// read the headers first, the rest of a rejected packet is skipped
+		// by moving the read pointer below
+		hlen=len;
+		if (hlen>ENC28J60_HEADER_LEN){
+			hlen=ENC28J60_HEADER_LEN;
+		}
+		enc28j60ReadBuffer(hlen, packet);
+		if ((*gRxFilter)(packet,len)==0){
+			len=0;
+#ifdef ENC28J60_STATS
+			STATS_INC(rx_rejected);
+#endif
+		}else if (len>hlen){
+			enc28j60ReadBuffer(len-hlen, packet+hlen);
+		}
+#endif
 	}else{
 		// copy the packet from the receive buffer
 		enc28j60ReadBuffer(len, packet);
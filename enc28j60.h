@@ -273,8 +273,23 @@ extern void enc28j60PhyWrite(uint8_t address, uint16_t data);
 extern void enc28j60clkout(uint8_t clk);
 extern void enc28j60Init(uint8_t* macaddr);
 extern void enc28j60PacketSend(uint16_t len, uint8_t* packet);
+extern void enc28j60PacketSendP(uint16_t len, uint8_t* packet, uint16_t len_p, const char *data_p);
 extern uint8_t enc28j60hasRxPkt(void);
 extern uint16_t enc28j60PacketReceive(uint16_t maxlen, uint8_t* packet);
+#ifdef ENC28J60_INT
+extern void enc28j60RxPoll(void);
+#endif
+#ifdef ENC28J60_RX_FILTER
+// number of bytes the filter gets to see
+#define ENC28J60_HEADER_LEN 42
+extern void enc28j60SetRxFilter(uint8_t (*filter)(uint8_t *buf,uint16_t len));
+extern void enc28j60SetArpFilter(uint8_t *ip);
+#endif
+#ifdef ENC28J60_TIMESTAMP
+struct clock_stamp;
+extern void enc28j60GetRxStamp(struct clock_stamp *s);
+extern void enc28j60GetTxStamp(struct clock_stamp *s);
+#endif
 extern uint8_t enc28j60getrev(void);
 #ifdef ENC28J60_BROADCAST
 extern void enc28j60EnableBroadcast(void);
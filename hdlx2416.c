@@ -8,6 +8,7 @@
 #include "hdlx2416.h"
 
 static uint8_t hdlx2416_pos;
+static char hdlx2416_shown[8]; // characters on the display, by address
 
 void hdlx2416_data(uint8_t d) {
 	PORTC &= ~((1<<PINC0)|(1<<PINC1)|(1<<PINC2));
@@ -19,14 +20,18 @@ void hdlx2416_data(uint8_t d) {
 void hdlx2416_putc(char c) {
 	uint8_t disp = (hdlx2416_pos < 4) ? PIND6 : PIND7;
 	
-	PORTC |= 1<<PINC3; // cu high
-	PORTB &= ~((1<<PINB0)|(1<<PINB1));
-	PORTB |= hdlx2416_pos & 0x3;  // addr select
+	// only a changed character is written
+	if (hdlx2416_shown[hdlx2416_pos] != c) {
+		hdlx2416_shown[hdlx2416_pos] = c;
+		PORTC |= 1<<PINC3; // cu high
+		PORTB &= ~((1<<PINB0)|(1<<PINB1));
+		PORTB |= hdlx2416_pos & 0x3;  // addr select
+		PORTD &= ~(1<<disp); // wr low
+		hdlx2416_data(c);
+		PORTD |= 1<<disp;  // wr high
+	}
 	hdlx2416_pos--;
 	hdlx2416_pos &= 0x7;
-	PORTD &= ~(1<<disp); // wr low
-	hdlx2416_data(c);
-	PORTD |= 1<<disp;  // wr high
 }
 
 void hdlx2416_intensity(uint8_t i) {
@@ -58,14 +63,29 @@ void hdlx2416_puts_p(const char *progmem_s) {
 	}
 }
 
+void hdlx2416_flush(const char *fb) {
+	uint8_t i = 0;
+	
+	hdlx2416_pos = 7;
+	while (i < 8) {
+		hdlx2416_putc(fb[i++]);
+	}
+}
+
 void hdlx2416_goto(uint8_t pos) {
 	hdlx2416_pos = 7 - pos;
 }
 
 void hdlx2416_init(void) {
+	uint8_t i = 0;
+	
 	DDRB |= (1<<PINB0)|(1<<PINB1);
 	DDRC |= (1<<PINC0)|(1<<PINC1)|(1<<PINC2)|(1<<PINC3);
 	DDRD |= (1<<PIND2)|(1<<PIND3)|(1<<PIND4)|(1<<PIND5)|(1<<PIND6)|(1<<PIND7);
 	PORTD |= (1<<PIND6)|(1<<PIND7); // wr high
 	hdlx2416_pos = 7;
+	// unknown, so every character is written once
+	while (i < 8) {
+		hdlx2416_shown[i++] = -1;
+	}
 }
@@ -31,6 +31,8 @@ extern void hdlx2416_intensity(uint8_t i);
 extern void hdlx2416_puts(const char *s);
 extern void hdlx2416_putsn(const char *s, uint8_t n);
 extern void hdlx2416_puts_p(const char *progmem_s);
+// writes the 8 characters of the frame buffer fb, skipping unchanged ones
+extern void hdlx2416_flush(const char *fb);
 extern void hdlx2416_goto(uint8_t pos);
 extern void hdlx2416_init(void);
 
@@ -9,8 +9,9 @@
  * only if all data can be sent in one single packet. This is however
  * not a big limitation for a micro controller as you will anyhow use
  * small web-pages. The web server must send the entire web page in one
- * packet. The client "web browser" as implemented here can also receive
- * large pages.
+ * packet, unless it uses www_server_reply_stream which sends the page in
+ * parts and generates the next part when the previous one is acked. The
+ * client "web browser" as implemented here can also receive large pages.
  *
  * Chip type	   : ATMEGA88/168/328/644 with ENC28J60
  *********************************************/
@@ -21,6 +22,7 @@
 #include <stdlib.h>
 #include "net.h"
 #include "enc28j60.h"
+#include "ip_arp_udp_tcp.h"
 #include "ip_config.h"
 
 //
@@ -33,6 +35,9 @@ static void (*icmp_callback)(uint8_t *ip);
 #define ARP_MAC_resolver_client 1
 #define ALL_clients 1
 #endif
+#if defined (ARP_cache) && !defined (ARP_MAC_resolver_client)
+#error "ERROR: the ARP_cache needs one of the clients in ip_config.h"
+#endif
 #if defined (WWW_client) || defined (TCP_client) 
 // just lower byte, the upper byte is TCPCLIENT_SRC_PORT_H:
 static uint8_t tcpclient_src_port_l=1; 
@@ -78,6 +83,23 @@ static uint8_t arp_reference_number=0;
 #define WGW_INITIAL_ARP 1
 #define WGW_HAVE_MAC 2
 #define WGW_ACCEPT_ARP_REPLY 8
+#ifdef ARP_cache
+struct arp_entry {
+	uint8_t ip[4];
+	uint8_t mac[6];
+	uint8_t state;
+	uint8_t flags;
+	uint16_t age; // seconds since the entry was added or confirmed
+};
+#define ARP_FREE 0
+#define ARP_PENDING 1 // no mac yet
+#define ARP_VALID 2
+#define ARP_PINNED 1 // looked up, not just learned
+#define ARP_SEND 2 // a request is due
+static struct arp_entry arp_cache[ARP_CACHE_SIZE];
+static uint8_t arp_cache_due=0; // an entry has ARP_SEND set
+static uint8_t arp_cache_linkup=0; // link state of the last arp_cache_tick
+#endif
 #endif
 
 #ifdef WWW_server
@@ -85,11 +107,28 @@ static uint8_t wwwport_l=80; // server port
 static uint8_t wwwport_h=0;  // Note: never use same as TCPCLIENT_SRC_PORT_H
 static uint16_t info_data_len=0;
 #endif
+#ifdef WWW_server_stream
+// state of the web page that is sent in parts, one page at a time
+static uint16_t (*www_stream_callback)(uint8_t,uint8_t*); // NULL if no page is sent
+static uint8_t www_stream_mac[6];
+static uint8_t www_stream_ip[4];
+static uint8_t www_stream_port[2];
+static uint32_t www_stream_seq; // seq number of the part in flight
+static uint32_t www_stream_ack; // next seq number expected from the client
+static uint16_t www_stream_len; // seq numbers used by the part in flight
+static uint8_t www_stream_part; // number of the part in flight
+static uint8_t www_stream_fin; // the part in flight is the last one
+static uint8_t www_stream_retry;
+static volatile uint8_t www_stream_timer; // seconds until retransmission
+// retransmit after 1 to 2 seconds, give up after 3 retransmissions
+#define WWW_STREAM_TIMEOUT 2
+#define WWW_STREAM_RETRIES 3
+#endif
 
 #if defined (ALL_clients)
 static uint8_t ipnetmask[4]={255,255,255,255};
 #endif
-#if defined (ALL_clients) || defined (WOL_client)
+#if defined (ALL_clients) || defined (WOL_client) || defined (WWW_server_stream)
 static uint8_t ipid=0x2; // IP-identification, it works as well if you do not change it but it is better to fill the field, we count this number up and wrap.
 const char iphdr[] PROGMEM ={0x45,0,0,0x82,0,0,0x40,0,0x20}; // 0x82 is the total len on ip, 0x20 is ttl (time to live), the second 0,0 is IP-identification and may be changed.
 #endif
@@ -99,8 +138,33 @@ const char iphdr[] PROGMEM ={0x45,0,0,0x82,0,0,0x40,0,0x20}; // 0x82 is the tota
 const char arpreqhdr[] PROGMEM ={0,1,8,0,6,4,0,1};
 #ifdef NTP_client
 const char ntpreqhdr[] PROGMEM ={0xe3,0,4,0xfa,0,1,0,0,0,1};
+// positions of the time stamps in the ntp packet
+#define NTP_ORIGINATE_TS_P (UDP_DATA_P+24)
+#define NTP_RECEIVE_TS_P (UDP_DATA_P+32)
+#define NTP_TRANSMIT_TS_P (UDP_DATA_P+40)
 #endif
 
+// adds the 16bit words of buf to sum and returns the 1's complement
+static uint16_t checksum_add(uint8_t *buf, uint16_t len,uint32_t sum){
+	// build the sum of 16bit words
+	while(len >1){
+		sum += 0xFFFF & (((uint32_t)*buf<<8)|*(buf+1));
+		buf+=2;
+		len-=2;
+	}
+	// if there is a byte left then add it (padded with zero)
+	if (len){
+		sum += ((uint32_t)(0xFF & *buf))<<8;
+	}
+	// now calculate the sum over the bytes in the sum
+	// until the result is only 16bit long
+	while (sum>>16){
+		sum = (sum & 0xFFFF)+(sum >> 16);
+	}
+	// build 1's complement:
+	return( (uint16_t) sum ^ 0xFFFF);
+}
+
 // The Ip checksum is calculated over the ip header only starting
 // with the header length field and a total length of 20 bytes
 // until ip.dst
@@ -146,23 +210,7 @@ uint16_t checksum(uint8_t *buf, uint16_t len,uint8_t type){
 		// =length given to this function - (IP.scr+IP.dst length)
 		sum+=len-8; // = real tcp len
 	}
-	// build the sum of 16bit words
-	while(len >1){
-		sum += 0xFFFF & (((uint32_t)*buf<<8)|*(buf+1));
-		buf+=2;
-		len-=2;
-	}
-	// if there is a byte left then add it (padded with zero)
-	if (len){
-		sum += ((uint32_t)(0xFF & *buf))<<8;
-	}
-	// now calculate the sum over the bytes in the sum
-	// until the result is only 16bit long
-	while (sum>>16){
-		sum = (sum & 0xFFFF)+(sum >> 16);
-	}
-	// build 1's complement:
-	return( (uint16_t) sum ^ 0xFFFF);
+	return(checksum_add(buf,len,sum));
 }
 
 void init_mac(uint8_t *mymac){
@@ -177,10 +225,17 @@ void client_ifconfig(uint8_t *ip,uint8_t *netmask)
 	uint8_t i;
 	if (ip){
 		i=0;while(i<4){ipaddr[i]=ip[i];i++;}
+#ifdef ENC28J60_RX_FILTER
+		enc28j60SetArpFilter(ipaddr);
+#endif
 	}
 	if (netmask){
 		i=0;while(i<4){ipnetmask[i]=netmask[i];i++;}
 	}
+#ifdef ARP_cache
+	// the hosts may no longer be on the LAN
+	arp_cache_clear();
+#endif
 }
 
 // returns 1 if destip must be routed via the GW. Returns 0 if destip is on the local LAN
@@ -252,6 +307,58 @@ uint8_t eth_type_is_ip_and_my_ip(uint8_t *buf,uint16_t len){
 	return(1);
 }
 
+#ifdef ENC28J60_RX_FILTER
+uint8_t packet_header_filter(uint8_t *buf,uint16_t len){
+	if (len<42){
+		return(0);
+	}
+	if(buf[ETH_TYPE_H_P] == ETHTYPE_ARP_H_V && 
+	   buf[ETH_TYPE_L_P] == ETHTYPE_ARP_L_V){
+		return(memcmp(&buf[ETH_ARP_DST_IP_P],ipaddr,4)==0);
+	}
+	if(buf[ETH_TYPE_H_P]!=ETHTYPE_IP_H_V || 
+	   buf[ETH_TYPE_L_P]!=ETHTYPE_IP_L_V ||
+	   buf[IP_HEADER_LEN_VER_P]!=0x45){
+		return(0);
+	}
+	// a DHCP server may answer before we have an IP (port 67)
+	if (buf[IP_PROTO_P]==IP_PROTO_UDP_V && buf[UDP_SRC_PORT_H_P]==0 && buf[UDP_SRC_PORT_L_P]==67){
+		return(1);
+	}
+	if (memcmp(&buf[IP_DST_P],ipaddr,4)!=0){
+		return(0);
+	}
+	if (buf[IP_PROTO_P]==IP_PROTO_ICMP_V){
+		return(1);
+	}
+	if (buf[IP_PROTO_P]==IP_PROTO_TCP_V){
+#ifdef WWW_server
+		if (buf[TCP_DST_PORT_H_P]==wwwport_h && buf[TCP_DST_PORT_L_P]==wwwport_l){
+			return(1);
+		}
+#endif
+#if defined (TCP_client)
+		if (buf[TCP_DST_PORT_H_P]==TCPCLIENT_SRC_PORT_H){
+			return(1);
+		}
+#endif
+		return(0);
+	}
+	if (buf[IP_PROTO_P]==IP_PROTO_UDP_V){
+#ifdef UDP_server
+		// the application checks the port
+		return(1);
+#else
+		// DNS (port 53) and NTP (port 123) answers
+		if (buf[UDP_SRC_PORT_H_P]==0 && (buf[UDP_SRC_PORT_L_P]==53 || buf[UDP_SRC_PORT_L_P]==123)){
+			return(1);
+		}
+#endif
+	}
+	return(0);
+}
+#endif
+
 // make a return eth header from a received eth packet
 void make_eth(uint8_t *buf)
 {
@@ -397,34 +504,84 @@ uint16_t get_tcp_data_len(uint8_t *buf)
 }
 
 
+#ifdef TCP_data_sum
+// The data is filled in from position 0 onwards by the fill_tcp_data
+// functions, which add each byte to tcp_sum. The data start is at an even
+// offset from IP_SRC_P, so a byte at an even position is a high byte.
+static uint32_t tcp_sum;
+static uint16_t tcp_sum_len=0xffff; // data bytes in tcp_sum, 0xffff if unknown
+
+// returns the sum to continue at pos
+static uint32_t tcp_sum_begin(uint16_t pos)
+{
+	if (pos==0){
+		tcp_sum_len=0;
+		return(0);
+	}
+	if (pos!=tcp_sum_len){
+		// not filled in order
+		tcp_sum_len=0xffff;
+	}
+	return(tcp_sum);
+}
+
+static void tcp_sum_end(uint16_t pos,uint32_t sum)
+{
+	if (tcp_sum_len!=0xffff){
+		tcp_sum_len=pos;
+		tcp_sum=sum;
+	}
+}
+#endif
+
 // fill in tcp data at position pos. pos=0 means start of
 // tcp data. Returns the position at which the string after
 // this string could be filled.
 uint16_t fill_tcp_data_p(uint8_t *buf,uint16_t pos, const char *progmem_s)
 {
 	char c;
+#ifdef TCP_data_sum
+	uint32_t sum=tcp_sum_begin(pos);
+#endif
 	// fill in tcp data at position pos
 	//
 	// with no options the data starts after the checksum + 2 more bytes (urgent ptr)
 	while ((c = pgm_read_byte(progmem_s++))) {
 		buf[TCP_CHECKSUM_L_P+3+pos]=c;
+#ifdef TCP_data_sum
+		if (pos & 1) sum+=(uint8_t)c;
+		else sum+=(uint16_t)(uint8_t)c<<8;
+#endif
 		pos++;
 	}
+#ifdef TCP_data_sum
+	tcp_sum_end(pos,sum);
+#endif
 	return(pos);
 }
 
 // fill a binary string of len data into the tcp packet
 uint16_t fill_tcp_data_len(uint8_t *buf,uint16_t pos, const uint8_t *s, uint8_t len)
 {
+#ifdef TCP_data_sum
+	uint32_t sum=tcp_sum_begin(pos);
+#endif
 	// fill in tcp data at position pos
 	//
 	// with no options the data starts after the checksum + 2 more bytes (urgent ptr)
 	while (len) {
 		buf[TCP_CHECKSUM_L_P+3+pos]=*s;
+#ifdef TCP_data_sum
+		if (pos & 1) sum+=*s;
+		else sum+=(uint16_t)*s<<8;
+#endif
 		pos++;
 		s++;
 		len--;
 	}
+#ifdef TCP_data_sum
+	tcp_sum_end(pos,sum);
+#endif
 	return(pos);
 }
 
@@ -489,8 +646,17 @@ void make_tcp_ack_with_data_noflags(uint8_t *buf,uint16_t dlen)
 	// zero the checksum
 	buf[TCP_CHECKSUM_H_P]=0;
 	buf[TCP_CHECKSUM_L_P]=0;
+#ifdef TCP_data_sum
+	if (dlen && dlen==tcp_sum_len){
+		// the data is summed up already, add the headers and the length
+		j=checksum_add(&buf[IP_SRC_P],8+TCP_HEADER_LEN_PLAIN,tcp_sum+IP_PROTO_TCP_V+TCP_HEADER_LEN_PLAIN+dlen);
+	}else
+#endif
 	// calculate the checksum, len=8 (start from ip.src) + TCP_HEADER_LEN_PLAIN + data len
 	j=checksum(&buf[IP_SRC_P], 8+TCP_HEADER_LEN_PLAIN+dlen,2);
+#ifdef TCP_data_sum
+	tcp_sum_len=0xffff;
+#endif
 	buf[TCP_CHECKSUM_H_P]=j>>8;
 	buf[TCP_CHECKSUM_L_P]=j& 0xff;
 	enc28j60PacketSend(IP_HEADER_LEN+TCP_HEADER_LEN_PLAIN+dlen+ETH_HEADER_LEN,buf);
@@ -557,6 +723,9 @@ void init_udp_or_www_server(uint8_t *mymac,uint8_t *myip){
 			ipaddr[i]=myip[i];
 			i++;
 		}
+#ifdef ENC28J60_RX_FILTER
+		enc28j60SetArpFilter(ipaddr);
+#endif
 	}
 	if (mymac) init_mac(mymac);
 }
@@ -635,9 +804,53 @@ void www_server_reply(uint8_t *buf,uint16_t dlen)
 	make_tcp_ack_with_data_noflags(buf,dlen); // send data
 }
 
+// Like www_server_reply but the dlen bytes of tcp data in buf are
+// followed by len bytes that are copied from flash straight into the
+// transmit buffer of the enc28j60. sum is the sum of these bytes as
+// returned by www_sum_p. The reply must fit in one packet.
+void www_server_reply_p(uint8_t *buf,uint16_t dlen,const char *data_p,uint16_t len,uint16_t sum)
+{
+	uint16_t j;
+	make_tcp_ack_from_any(buf,info_data_len,0); // send ack for http get
+	buf[TCP_FLAGS_P]=TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V|TCP_FLAGS_FIN_V;
+	j=IP_HEADER_LEN+TCP_HEADER_LEN_PLAIN+dlen+len;
+	buf[IP_TOTLEN_H_P]=j>>8;
+	buf[IP_TOTLEN_L_P]=j& 0xff;
+	fill_ip_hdr_checksum(buf);
+	buf[TCP_CHECKSUM_H_P]=0;
+	buf[TCP_CHECKSUM_L_P]=0;
+	// after an odd number of bytes in buf the flash data is shifted by one
+	// byte, which swaps the bytes of its sum
+	if (dlen & 1){
+		sum=(sum<<8)|(sum>>8);
+	}
+	j=checksum_add(&buf[IP_SRC_P],8+TCP_HEADER_LEN_PLAIN+dlen,(uint32_t)sum+IP_PROTO_TCP_V+TCP_HEADER_LEN_PLAIN+dlen+len);
+	buf[TCP_CHECKSUM_H_P]=j>>8;
+	buf[TCP_CHECKSUM_L_P]=j& 0xff;
+	enc28j60PacketSendP(IP_HEADER_LEN+TCP_HEADER_LEN_PLAIN+dlen+ETH_HEADER_LEN,buf,len,data_p);
+}
+
+// sum of the 16bit words of len bytes in flash, for www_server_reply_p
+uint16_t www_sum_p(const char *data_p,uint16_t len)
+{
+	uint32_t sum=0;
+	while(len>1){
+		sum+=((uint16_t)pgm_read_byte(data_p)<<8)|pgm_read_byte(data_p+1);
+		data_p+=2;
+		len-=2;
+	}
+	if (len){
+		sum+=(uint16_t)pgm_read_byte(data_p)<<8;
+	}
+	while (sum>>16){
+		sum=(sum & 0xFFFF)+(sum >> 16);
+	}
+	return((uint16_t)sum);
+}
+
 #endif // WWW_server
 
-#if defined (ALL_clients) || defined (GRATARP) || defined (WOL_client)
+#if defined (ALL_clients) || defined (GRATARP) || defined (WOL_client) || defined (WWW_server_stream)
 // fill buffer with a prog-mem string
 void fill_buf_p(uint8_t *buf,uint16_t len, const char *progmem_str_p)
 {
@@ -648,7 +861,136 @@ void fill_buf_p(uint8_t *buf,uint16_t len, const char *progmem_str_p)
 		len--;
 	}
 }
-#endif 
+#endif
+
+#ifdef WWW_server_stream
+// read a 32 bit number in network byte order
+static uint32_t get_be32(const uint8_t *p)
+{
+	return(((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint16_t)p[2]<<8)|p[3]);
+}
+
+// write a 32 bit number in network byte order
+static void put_be32(uint8_t *p,uint32_t n)
+{
+	p[0]=n>>24;
+	p[1]=n>>16;
+	p[2]=n>>8;
+	p[3]=n;
+}
+
+// make the eth/ip/tcp header of the part in flight from the stream
+// state, let the callback fill in the data and send it
+static void www_stream_send(uint8_t *buf)
+{
+	uint16_t dlen;
+	uint8_t last=0;
+	uint8_t i=0;
+	while(i<6){
+		buf[ETH_DST_MAC +i]=www_stream_mac[i];
+		buf[ETH_SRC_MAC +i]=macaddr[i];
+		i++;
+	}
+	buf[ETH_TYPE_H_P] = ETHTYPE_IP_H_V;
+	buf[ETH_TYPE_L_P] = ETHTYPE_IP_L_V;
+	fill_buf_p(&buf[IP_P],9,iphdr);
+	buf[IP_ID_L_P]=ipid; ipid++;
+	buf[IP_PROTO_P]=IP_PROTO_TCP_V;
+	i=0;
+	while(i<4){
+		buf[IP_DST_P+i]=www_stream_ip[i];
+		buf[IP_SRC_P+i]=ipaddr[i];
+		i++;
+	}
+	buf[TCP_SRC_PORT_H_P]=wwwport_h;
+	buf[TCP_SRC_PORT_L_P]=wwwport_l;
+	buf[TCP_DST_PORT_H_P]=www_stream_port[0];
+	buf[TCP_DST_PORT_L_P]=www_stream_port[1];
+	put_be32(&buf[TCP_SEQ_H_P],www_stream_seq);
+	put_be32(&buf[TCP_SEQACK_H_P],www_stream_ack);
+	buf[TCP_HEADER_LEN_P]=0x50; // 20 bytes, no options
+	buf[TCP_WIN_SIZE]=0x4; // 1024=0x400
+	buf[TCP_WIN_SIZE+1]=0;
+	// urgent pointer
+	buf[TCP_CHECKSUM_L_P+1]=0;
+	buf[TCP_CHECKSUM_L_P+2]=0;
+	// the callback writes only the tcp data
+	dlen=(*www_stream_callback)(www_stream_part,&last);
+	www_stream_len=dlen;
+	www_stream_fin=last;
+	buf[TCP_FLAGS_P]=TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V;
+	if (last){
+		buf[TCP_FLAGS_P]|=TCP_FLAGS_FIN_V;
+		// the fin takes one seq number
+		www_stream_len++;
+	}
+	make_tcp_ack_with_data_noflags(buf,dlen);
+	www_stream_timer=WWW_STREAM_TIMEOUT;
+}
+
+// you must have initialized info_data_len, see www_server_reply
+//
+// The connection of the http request is remembered and the first part
+// of the page is sent. A page that is still being sent is dropped.
+void www_server_reply_stream(uint8_t *buf,uint16_t (*datafill_callback)(uint8_t part,uint8_t *last))
+{
+	memcpy(www_stream_mac,&buf[ETH_SRC_MAC],6);
+	memcpy(www_stream_ip,&buf[IP_SRC_P],4);
+	www_stream_port[0]=buf[TCP_SRC_PORT_H_P];
+	www_stream_port[1]=buf[TCP_SRC_PORT_L_P];
+	// the data of the first part acks the http request
+	www_stream_seq=get_be32(&buf[TCP_SEQACK_H_P]);
+	www_stream_ack=get_be32(&buf[TCP_SEQ_H_P])+info_data_len;
+	www_stream_callback=datafill_callback;
+	www_stream_part=0;
+	www_stream_retry=0;
+	www_stream_send(buf);
+}
+
+// counts down the retransmission timer, call it once per second
+void www_server_tick(void)
+{
+	if (www_stream_timer) www_stream_timer--;
+}
+
+uint8_t www_server_stream_busy(void)
+{
+	return(www_stream_callback!=NULL);
+}
+
+// check a tcp packet to the web server port against the stream state
+// and send the next part if it acks the part in flight
+// returns 1 if a part was sent, buf is then overwritten
+static uint8_t www_stream_check(uint8_t *buf)
+{
+	if (www_stream_callback==NULL){
+		return(0);
+	}
+	if (memcmp(&buf[IP_SRC_P],www_stream_ip,4)!=0 || buf[TCP_SRC_PORT_H_P]!=www_stream_port[0] || buf[TCP_SRC_PORT_L_P]!=www_stream_port[1]){
+		return(0);
+	}
+	if (buf[TCP_FLAGS_P] & (TCP_FLAGS_RST_V|TCP_FLAGS_FIN_V)){
+		// the client closed the connection
+		www_stream_callback=NULL;
+		return(0);
+	}
+	if (!(buf[TCP_FLAGS_P] & TCP_FLAGS_ACK_V) || get_be32(&buf[TCP_SEQACK_H_P])!=www_stream_seq+www_stream_len){
+		// the part in flight is not acked (yet)
+		return(0);
+	}
+	if (www_stream_fin){
+		// the whole page is acked
+		www_stream_callback=NULL;
+		return(0);
+	}
+	www_stream_seq+=www_stream_len;
+	www_stream_ack=get_be32(&buf[TCP_SEQ_H_P])+get_tcp_data_len(buf);
+	www_stream_part++;
+	www_stream_retry=0;
+	www_stream_send(buf);
+	return(1);
+}
+#endif // WWW_server_stream
 
 #ifdef PING_client
 // icmp echo, matchpat is a pattern that has to be sent back by the 
@@ -704,10 +1046,28 @@ void client_icmp_request(uint8_t *buf,uint8_t *destip,uint8_t *dstmac)
 
 
 #ifdef NTP_client
+// write a ntp time stamp in network byte order
+static void fill_ntp_ts(uint8_t *buf,const struct ntp_ts *ts)
+{
+	buf[0]=ts->sec>>24;
+	buf[1]=ts->sec>>16;
+	buf[2]=ts->sec>>8;
+	buf[3]=ts->sec;
+	buf[4]=ts->frac>>8;
+	buf[5]=ts->frac;
+}
+
+// read a ntp time stamp in network byte order
+static void get_ntp_ts(const uint8_t *buf,struct ntp_ts *ts)
+{
+	ts->sec=((uint32_t)buf[0]<<24)|((uint32_t)buf[1]<<16)|((uint32_t)buf[2]<<8)|((uint32_t)buf[3]);
+	ts->frac=((uint16_t)buf[4]<<8)|buf[5];
+}
+
 // ntp udp packet
-// See http://tools.ietf.org/html/rfc958 for details
+// See http://tools.ietf.org/html/rfc5905 for details
 //
-void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dstmac)
+void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dstmac,const struct ntp_ts *xmt)
 {
 	uint8_t i=0;
 	uint16_t ck;
@@ -748,6 +1108,8 @@ void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dst
 		i++;
 	}
 	fill_buf_p(&buf[UDP_DATA_P],10,ntpreqhdr);
+	// transmit time stamp, the server copies it into the originate time stamp
+	fill_ntp_ts(&buf[NTP_TRANSMIT_TS_P],xmt);
 	//
 	ck=checksum(&buf[IP_SRC_P], 16 + 48,1);
 	buf[UDP_CHECKSUM_H_P]=ck>>8;
@@ -757,7 +1119,7 @@ void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dst
 // process the answer from the ntp server:
 // if dstport==0 then accept any port otherwise only answers going to dstport
 // return 1 on successful processing of answer
-uint8_t client_ntp_process_answer(uint8_t *buf,uint32_t *time,uint8_t dstport_l){
+uint8_t client_ntp_process_answer(uint8_t *buf,struct ntp_ts *ts,uint8_t dstport_l){
 	if (dstport_l){
 		if (buf[UDP_DST_PORT_L_P]!=dstport_l){ 
 			return(0);
@@ -767,8 +1129,14 @@ uint8_t client_ntp_process_answer(uint8_t *buf,uint32_t *time,uint8_t dstport_l)
 		// not ntp
 		return(0);
 	}
-	// copy time from the transmit time stamp field:
-	*time=((uint32_t)buf[0x52]<<24)|((uint32_t)buf[0x53]<<16)|((uint32_t)buf[0x54]<<8)|((uint32_t)buf[0x55]);
+	// must be a server reply, not a kiss-o'-death (stratum 0) and the
+	// server clock must be synchronized (leap indicator not 3)
+	if ((buf[UDP_DATA_P]&0x07)!=4 || buf[UDP_DATA_P+1]==0 || (buf[UDP_DATA_P]&0xc0)==0xc0){
+		return(0);
+	}
+	get_ntp_ts(&buf[NTP_ORIGINATE_TS_P],&ts[0]);
+	get_ntp_ts(&buf[NTP_RECEIVE_TS_P],&ts[1]);
+	get_ntp_ts(&buf[NTP_TRANSMIT_TS_P],&ts[2]);
 	return(1);
 }
 #endif
@@ -1026,6 +1394,137 @@ void get_mac_with_arp(uint8_t *ip, uint8_t reference_number,void (*arp_result_ca
 		i++;
 	}
 }
+
+#ifdef ARP_cache
+static struct arp_entry *arp_cache_find(const uint8_t *ip)
+{
+	uint8_t i=0;
+	while(i<ARP_CACHE_SIZE){
+		if (arp_cache[i].state!=ARP_FREE && memcmp(arp_cache[i].ip,ip,4)==0){
+			return(&arp_cache[i]);
+		}
+		i++;
+	}
+	return(NULL);
+}
+
+// returns a free entry, or else the oldest learned or the oldest entry
+static struct arp_entry *arp_cache_alloc(void)
+{
+	struct arp_entry *e=&arp_cache[0];
+	uint8_t i=0;
+	while(i<ARP_CACHE_SIZE){
+		if (arp_cache[i].state==ARP_FREE) return(&arp_cache[i]);
+		if ((e->flags & ARP_PINNED) && !(arp_cache[i].flags & ARP_PINNED)){
+			e=&arp_cache[i];
+		}else if ((e->flags & ARP_PINNED)==(arp_cache[i].flags & ARP_PINNED) && arp_cache[i].age>e->age){
+			e=&arp_cache[i];
+		}
+		i++;
+	}
+	return(e);
+}
+
+uint8_t *arp_cache_lookup(const uint8_t *ip)
+{
+	struct arp_entry *e=arp_cache_find(ip);
+	if (e==NULL){
+		e=arp_cache_alloc();
+		memcpy(e->ip,ip,4);
+		e->state=ARP_PENDING;
+		e->flags=ARP_SEND;
+		e->age=0;
+		arp_cache_due=1;
+	}
+	e->flags|=ARP_PINNED;
+	if (e->state==ARP_VALID) return(e->mac);
+	return(NULL);
+}
+
+void arp_cache_expire(const uint8_t *ip)
+{
+	struct arp_entry *e=arp_cache_find(ip);
+	if (e){
+		e->state=ARP_PENDING;
+		e->flags|=ARP_SEND;
+		e->age=0;
+		arp_cache_due=1;
+	}
+}
+
+void arp_cache_clear(void)
+{
+	uint8_t i=0;
+	while(i<ARP_CACHE_SIZE){
+		arp_cache[i].state=ARP_FREE;
+		i++;
+	}
+}
+
+void arp_cache_tick(uint8_t linkup)
+{
+	struct arp_entry *e;
+	uint8_t i=0;
+	arp_cache_linkup=linkup;
+	while(i<ARP_CACHE_SIZE){
+		e=&arp_cache[i];
+		i++;
+		if (e->state==ARP_FREE) continue;
+		if (e->age<0xffff) e->age++;
+		if (!(e->flags & ARP_PINNED)){
+			// a learned entry is kept until it would need a refresh
+			if (e->age>=ARP_CACHE_REFRESH) e->state=ARP_FREE;
+			continue;
+		}
+		if (e->state==ARP_VALID && e->age>=ARP_CACHE_TTL){
+			// not refreshed in time, the mac is no longer used
+			e->state=ARP_PENDING;
+			e->age=0;
+		}
+		if (e->state==ARP_PENDING){
+			// every second at first, then every ARP_CACHE_RETRY seconds
+			if (e->age<ARP_CACHE_RETRY || e->age%ARP_CACHE_RETRY==0) e->flags|=ARP_SEND;
+		}else if (e->age>=ARP_CACHE_REFRESH && (e->age-ARP_CACHE_REFRESH)%ARP_CACHE_RETRY==0){
+			// the old mac is used until the answer arrives
+			e->flags|=ARP_SEND;
+		}
+		if (e->flags & ARP_SEND) arp_cache_due=1;
+	}
+}
+
+// updates the entry of the sender of an arp packet, a new sender is only
+// added if there is room
+static void arp_cache_learn(uint8_t *buf)
+{
+	struct arp_entry *e=arp_cache_find(&buf[ETH_ARP_SRC_IP_P]);
+	uint8_t i=0;
+	if (e==NULL){
+		while(i<ARP_CACHE_SIZE && arp_cache[i].state!=ARP_FREE) i++;
+		if (i==ARP_CACHE_SIZE) return;
+		e=&arp_cache[i];
+		memcpy(e->ip,&buf[ETH_ARP_SRC_IP_P],4);
+		e->flags=0;
+	}
+	memcpy(e->mac,&buf[ETH_ARP_SRC_MAC_P],6);
+	e->state=ARP_VALID;
+	e->flags&=~ARP_SEND;
+	e->age=0;
+}
+
+// sends the requests that are due
+static void arp_cache_send(uint8_t *buf)
+{
+	uint8_t i=0;
+	arp_cache_due=0;
+	while(i<ARP_CACHE_SIZE){
+		if (arp_cache[i].state!=ARP_FREE && (arp_cache[i].flags & ARP_SEND)){
+			arp_cache[i].flags&=~ARP_SEND;
+			client_arp_whohas(buf,arp_cache[i].ip);
+		}
+		i++;
+	}
+}
+#endif // ARP_cache
 #endif 
 
 #if defined (TCP_client)
@@ -1311,6 +1810,18 @@ uint16_t packetloop_arp_icmp_tcp(uint8_t *buf,uint16_t plen)
 	uint16_t tcpstart;
 	uint16_t save_len;
 #endif
+#ifdef WWW_server_stream
+	if(plen==0 && www_stream_callback && www_stream_timer==0){
+		// the part in flight was not acked in time
+		if (www_stream_retry<WWW_STREAM_RETRIES){
+			www_stream_retry++;
+			www_stream_send(buf);
+		}else{
+			// give up on this page
+			www_stream_callback=NULL;
+		}
+	}
+#endif
 #ifdef ARP_MAC_resolver_client
 	//plen will be unequal to zero if there is a valid 
 	// packet (without crc error):
@@ -1325,6 +1836,10 @@ uint16_t packetloop_arp_icmp_tcp(uint8_t *buf,uint16_t plen)
 			arp_delaycnt=0; // this is like a timer, not so precise but good enough, it wraps in about 2 sec
 		}
 		arp_delaycnt++;
+#ifdef ARP_cache
+		// checked in ram, the idle loop does not read the phy
+		if (arp_cache_due && arp_cache_linkup) arp_cache_send(buf);
+#endif
 #if defined (TCP_client)
 		if (tcp_client_state==1 && enc28j60linkup()){ // send a syn
 			tcp_client_state=2;
@@ -1342,6 +1857,10 @@ uint16_t packetloop_arp_icmp_tcp(uint8_t *buf,uint16_t plen)
 	// verify the mac address by sending it to 
 	// a unicast address.
 	if(eth_type_is_arp_and_my_ip(buf,plen)){
+#ifdef ARP_cache
+		// the sender of a request or reply is learned
+		arp_cache_learn(buf);
+#endif
 		if (buf[ETH_ARP_OPCODE_L_P]==ETH_ARP_OPCODE_REQ_L_V){
 			// is it an arp request 
 			make_arp_answer_from_request(buf);
@@ -1496,6 +2015,12 @@ uint16_t packetloop_arp_icmp_tcp(uint8_t *buf,uint16_t plen)
 			// make_tcp_synack_from_syn does already send the syn,ack
 			return(0);
 		}
+#ifdef WWW_server_stream
+		if (www_stream_check(buf)){
+			// the next part of the page is sent
+			return(0);
+		}
+#endif
 		if (buf[TCP_FLAGS_P] & TCP_FLAGS_ACK_V){
 			info_data_len=get_tcp_data_len(buf);
 			// we can possibly have no data, just ack:
@@ -27,6 +27,22 @@ extern void init_udp_or_www_server(uint8_t *mymac,uint8_t *myip);
 extern void www_server_port(uint16_t port); // not needed if you want port 80
 // send data from the web server to the client:
 extern void www_server_reply(uint8_t *buf,uint16_t dlen);
+// send dlen bytes of data in buf followed by len bytes from flash:
+extern void www_server_reply_p(uint8_t *buf,uint16_t dlen,const char *data_p,uint16_t len,uint16_t sum);
+// the sum of the flash data for www_server_reply_p, compute it once:
+extern uint16_t www_sum_p(const char *data_p,uint16_t len);
+#if defined (WWW_server_stream)
+// send a web page in several packets. The callback writes part number part
+// of the page to the tcp data and returns its length, it sets *last to 1
+// for the last part. The next part is requested when the client acks the
+// previous one. A part that is not acked is requested again, the callback
+// must then write the same data.
+extern void www_server_reply_stream(uint8_t *buf,uint16_t (*datafill_callback)(uint8_t part,uint8_t *last));
+// call this once per second for the retransmission timer:
+extern void www_server_tick(void);
+// returns 1 while a page is being sent in parts
+extern uint8_t www_server_stream_busy(void);
+#endif
 #endif
 
 // for a UDP server:
@@ -35,6 +51,12 @@ extern void make_udp_reply_from_request_udpdat_ready(uint8_t *buf,uint16_t datal
 extern void make_udp_reply_from_request(uint8_t *buf,char *data,uint8_t datalen,uint16_t port);
 #endif
 extern uint8_t eth_type_is_ip_and_my_ip(uint8_t *buf,uint16_t len);
+#ifdef ENC28J60_RX_FILTER
+// to be passed to enc28j60SetRxFilter, returns 1 if one of the enabled
+// functions wants the packet. Only the first 42 bytes are in buf, len
+// is the length of the whole packet.
+extern uint8_t packet_header_filter(uint8_t *buf,uint16_t len);
+#endif
 // return 0 to just continue in the packet loop and return the position 
 // of the tcp data if there is tcp data part:
 extern uint16_t packetloop_arp_icmp_tcp(uint8_t *buf,uint16_t plen);
@@ -76,6 +98,26 @@ extern uint8_t route_via_gw(uint8_t *destip); // returns 1 if destip must be rou
 // there is no answer. 
 extern void get_mac_with_arp(uint8_t *ip, uint8_t reference_number,void (*arp_result_callback)(uint8_t *ip,uint8_t reference_number,uint8_t *mac));
 uint8_t get_mac_with_arp_wait(void); // checks current ongoing transaction, returns 0 when the transaction is over
+#ifdef ARP_cache
+#define ARP_CACHE_SIZE 4
+// seconds after which a used entry is refreshed, unused entries are dropped
+#define ARP_CACHE_REFRESH 240
+// seconds after which an entry that was not refreshed is resolved again
+#define ARP_CACHE_TTL 300
+// seconds between the requests once the first ones were not answered
+#define ARP_CACHE_RETRY 10
+// returns the mac address of a host on the LAN, or NULL if it is not known
+// yet. The host is resolved in the packet loop and kept in the cache until
+// arp_cache_clear is called.
+extern uint8_t *arp_cache_lookup(const uint8_t *ip);
+// resolves the host again, use this if it does not answer
+extern void arp_cache_expire(const uint8_t *ip);
+// forgets all entries
+extern void arp_cache_clear(void);
+// ages the entries, call this once per second with the link state. The
+// requests are only sent while the link is up.
+extern void arp_cache_tick(uint8_t linkup);
+#endif
 #endif
 
 #ifdef TCP_client
@@ -161,8 +203,18 @@ extern void client_http_post(const char *urlbuf_p, char *urlbuf_varpart,const ch
 // a web-page. Normally you will be using the same packet buffer and
 // client_ntp_request writes immediately to buf. You might need to
 // set a marker and call client_ntp_request when your main loop is idle.
-extern void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dstmac);
-extern uint8_t client_ntp_process_answer(uint8_t *buf,uint32_t *time,uint8_t dstport_l);
+//
+// NTP time stamp, seconds since 1900 and the upper 16 bits of the fraction:
+struct ntp_ts {
+	uint32_t sec;
+	uint16_t frac;
+};
+// xmt is the local time at which the request is sent, the server returns
+// it in the originate time stamp of the answer.
+extern void client_ntp_request(uint8_t *buf,uint8_t *ntpip,uint8_t srcport,uint8_t *dstmac,const struct ntp_ts *xmt);
+// ts must point to 3 time stamps which are filled with the originate,
+// receive and transmit time stamp of the answer.
+extern uint8_t client_ntp_process_answer(uint8_t *buf,struct ntp_ts *ts,uint8_t dstport_l);
 #endif
 
 #ifdef UDP_client
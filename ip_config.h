@@ -21,8 +21,39 @@
 // the dhcp_client.c needs this.
 #define ENC28J60_BROADCAST
 
+// define this if the INT line of the enc28j60 is wired to INT0 (PD2), see
+// enc28j60.c. The receive buffer is then only read when a packet arrived.
+#undef ENC28J60_INT
+
+// define this to time stamp packets in the driver, see enc28j60GetRxStamp and
+// enc28j60GetTxStamp. Uses clock.c. With ENC28J60_INT the time stamp of a
+// received packet is taken in the interrupt.
+#define ENC28J60_TIMESTAMP
+
+// define this to read the headers of a packet first and skip the rest of the
+// packets that packet_header_filter() rejects, see enc28j60SetRxFilter. Also
+// limits the hardware ARP filter to requests for our IP.
+#define ENC28J60_RX_FILTER
+
+// define this to count received, rejected and bad packets and transmit
+// errors in the driver, see stats.h.
+#define ENC28J60_STATS
+
+// a cache of ARP_CACHE_SIZE mac addresses, see arp_cache_lookup. Entries are
+// resolved concurrently, refreshed before they age out and updated from the
+// ARP packets for our IP. Needs one of the clients.
+#define ARP_cache
+
+// a UDP server (status query):
+#define UDP_server
+
 // a web server
 #define WWW_server
+// the checksum of the tcp data is summed up while it is filled in, the
+// data is then not read again for the checksum
+#define TCP_data_sum
+// the web server can send a page in several packets, one at a time
+#define WWW_server_stream
 
 // to send out a ping:
 #undef PING_client
@@ -0,0 +1,58 @@
+/*
+ * jitter.c
+ *
+ * Created: 15-10-2026 03:10:48
+ *  Author: Tim Dorssers
+ *
+ * Random numbers that differ from clock to clock, so clocks that are powered
+ * up together do not send their requests and retries at the same moments.
+ * The seed mixes the mac with the lowest bits of a number of conversions of
+ * the internal temperature sensor, which are noise.
+ */
+
+#include <avr/io.h>
+#include <stdlib.h>
+#include "jitter.h"
+
+// conversions mixed into the seed
+#define JITTER_SAMPLES 32
+
+// rotates the seed and adds n
+static uint32_t jitter_mix(uint32_t seed, uint16_t n)
+{
+	return(((seed<<5)|(seed>>27))+n);
+}
+
+void jitter_init(const uint8_t *mac)
+{
+	uint32_t seed=0;
+	uint8_t i=0;
+
+	while(i<6){
+		seed=jitter_mix(seed,mac[i]);
+		i++;
+	}
+	// temperature sensor with the 1.1V reference, adc clock at F_CPU/64
+	ADMUX=(1<<REFS1)|(1<<REFS0)|(1<<MUX3);
+	ADCSRA=(1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+	i=0;
+	while(i<JITTER_SAMPLES){
+		ADCSRA|=(1<<ADSC);
+		while(ADCSRA & (1<<ADSC));
+		seed=jitter_mix(seed,ADC);
+		i++;
+	}
+	ADCSRA=0; // adc off
+	srandom(seed);
+}
+
+uint32_t jitter_below(uint32_t n)
+{
+	if (n==0) return(0);
+	return((uint32_t)random()%n);
+}
+
+uint32_t jitter_spread(uint32_t t)
+{
+	return(t-t/4+jitter_below(t/2+1));
+}
@@ -0,0 +1,20 @@
+/*
+ * jitter.h
+ *
+ * Created: 15-10-2026 03:12:26
+ *  Author: Tim Dorssers
+ */
+
+#ifndef JITTER_H_
+#define JITTER_H_
+
+#include <avr/io.h>
+
+// seeds the random numbers from the mac and the noise of the adc
+extern void jitter_init(const uint8_t *mac);
+// returns a random number below n, 0 if n is 0
+extern uint32_t jitter_below(uint32_t n);
+// returns t plus or minus a quarter of t at random
+extern uint32_t jitter_spread(uint32_t t);
+
+#endif /* JITTER_H_ */
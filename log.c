@@ -0,0 +1,199 @@
+/*
+ * log.c
+ *
+ * Created: 15-10-2026 01:33:27
+ *  Author: Tim Dorssers
+ *
+ * Log lines to the uart that never wait for it. A line starts only if its
+ * room is free in the uart buffer, otherwise it is dropped and counted.
+ *
+ * In text mode a line ends with CR LF. In binary mode a line is a record
+ * that ends with a SLIP END byte, 0xc0, inside a record 0xc0 is sent as 0xdb
+ * 0xdc and 0xdb as 0xdb 0xdd. A record holds the address of the text the line
+ * started with, 2 bytes, the level, the clock_get_ms() time, 4 bytes, and the
+ * arguments, each a LOG_TAG_ byte and its value. Multi-byte values are little
+ * endian. The texts are read from the elf file on the host.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdlib.h>
+#include "uart.h"
+#include "clock.h"
+#include "log.h"
+
+#define SLIP_END 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+uint8_t log_level=LOG_INFO;
+uint8_t log_binary=0;
+static uint8_t log_active=0; // a line was started and not dropped
+static uint8_t log_room; // bytes the line may still send
+static uint16_t log_dropped=0;
+
+// sends a byte of the line
+static void log_byte(uint8_t c)
+{
+	if (log_room==0) return;
+	if (log_binary && (c==SLIP_END || c==SLIP_ESC)){
+		if (log_room<2){
+			log_room=0;
+			return;
+		}
+		uart_putc(SLIP_ESC);
+		c=(c==SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+		log_room--;
+	}
+	uart_putc(c);
+	log_room--;
+}
+
+// sends the bytes of a value
+static void log_value(uint8_t tag, const uint8_t *p, uint8_t len)
+{
+	log_byte(tag);
+	while(len){
+		log_byte(*p++);
+		len--;
+	}
+}
+
+void log_init(void)
+{
+	uart_init(UART_BAUD_SELECT(LOG_BAUD,F_CPU));
+}
+
+void log_poll(void)
+{
+	uint16_t c;
+
+	while(!((c=uart_getc()) & UART_NO_DATA)){
+		c&=0xff;
+		if (c>='0' && c<='3') log_level=c-'0';
+		if (c=='b') log_binary=1;
+		if (c=='t') log_binary=0;
+	}
+}
+
+void log_start_p(uint8_t level, const char *progmem_s)
+{
+	uint32_t ms;
+	uint16_t addr;
+
+	log_active=0;
+	log_room=0;
+	if (level>log_level) return;
+	if (uart0_tx_free()<LOG_LINE_MAX){
+		log_dropped++;
+		return;
+	}
+	// the room for the end of the line is kept
+	log_active=1;
+	log_room=LOG_LINE_MAX-2;
+	if (!log_binary){
+		log_puts_p(progmem_s);
+		return;
+	}
+	addr=(uint16_t)progmem_s;
+	ms=clock_get_ms();
+	log_byte(addr);
+	log_byte(addr>>8);
+	log_byte(level);
+	log_byte(ms);
+	log_byte(ms>>8);
+	log_byte(ms>>16);
+	log_byte(ms>>24);
+}
+
+void log_puts(const char *s)
+{
+	if (log_binary) log_byte(LOG_TAG_STR);
+	while(*s){
+		log_byte(*s++);
+	}
+	if (log_binary) log_byte('\0');
+}
+
+void log_puts_p(const char *progmem_s)
+{
+	uint16_t addr=(uint16_t)progmem_s;
+	char c;
+
+	if (log_binary){
+		log_value(LOG_TAG_STR_P,(uint8_t *)&addr,2);
+		return;
+	}
+	while((c=pgm_read_byte(progmem_s++))){
+		log_byte(c);
+	}
+}
+
+void log_putc(char c)
+{
+	if (log_binary) log_byte(LOG_TAG_CHAR);
+	log_byte(c);
+}
+
+void log_number(int32_t n)
+{
+	char str[12];
+
+	if (log_binary){
+		log_value(LOG_TAG_NUMBER,(uint8_t *)&n,4);
+		return;
+	}
+	ltoa(n,str,10);
+	log_puts(str);
+}
+
+void log_ip(const uint8_t *ip)
+{
+	uint8_t i=0;
+
+	if (log_binary){
+		log_value(LOG_TAG_IP,ip,4);
+		return;
+	}
+	while(i<4){
+		if (i) log_byte('.');
+		log_number(ip[i]);
+		i++;
+	}
+}
+
+void log_mac(const uint8_t *mac)
+{
+	uint8_t i=0;
+
+	if (log_binary){
+		log_value(LOG_TAG_MAC,mac,6);
+		return;
+	}
+	while(i<6){
+		if (i) log_byte(':');
+		log_byte("0123456789abcdef"[mac[i]>>4]);
+		log_byte("0123456789abcdef"[mac[i] & 0x0f]);
+		i++;
+	}
+}
+
+void log_end(void)
+{
+	if (!log_active) return;
+	// the reserved room
+	if (log_binary){
+		uart_putc(SLIP_END);
+	}else{
+		uart_putc('\r');
+		uart_putc('\n');
+	}
+	log_active=0;
+	log_room=0;
+}
+
+uint16_t log_get_dropped(void)
+{
+	return(log_dropped);
+}
@@ -0,0 +1,61 @@
+/*
+ * log.h
+ *
+ * Created: 15-10-2026 01:34:09
+ *  Author: Tim Dorssers
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+// exact at 7.3728 MHz
+#define LOG_BAUD 115200
+// room that is reserved in the uart buffer for a line, longer lines are cut
+#define LOG_LINE_MAX 96
+
+// levels, a line is sent if its level is at most log_level
+#define LOG_OFF 0
+#define LOG_ERROR 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3 // every http request
+
+// tags of the arguments of a binary record
+#define LOG_TAG_STR 's' // characters and '\0'
+#define LOG_TAG_STR_P 'p' // address in program memory, 2 bytes
+#define LOG_TAG_CHAR 'c' // 1 byte
+#define LOG_TAG_NUMBER 'n' // 4 bytes
+#define LOG_TAG_IP 'i' // 4 bytes
+#define LOG_TAG_MAC 'm' // 6 bytes
+
+extern uint8_t log_level;
+extern uint8_t log_binary;
+
+// sets up the uart
+extern void log_init(void);
+// reads commands from the uart: '0' to '3' set the level, 'b' selects the
+// binary and 't' the text mode
+extern void log_poll(void);
+// starts a line with text from program memory. The line is dropped if its
+// level is not logged or if the uart buffer has less than LOG_LINE_MAX
+// bytes free, the other functions do nothing until log_end() then.
+extern void log_start_p(uint8_t level, const char *progmem_s);
+extern void log_puts(const char *s);
+extern void log_puts_p(const char *progmem_s);
+extern void log_putc(char c);
+extern void log_number(int32_t n);
+extern void log_ip(const uint8_t *ip);
+extern void log_mac(const uint8_t *mac);
+// ends the line
+extern void log_end(void);
+// returns the number of lines that were dropped for lack of room
+extern uint16_t log_get_dropped(void);
+
+#define log_start_P(level,s) log_start_p(level,PSTR(s))
+#define log_puts_P(s) log_puts_p(PSTR(s))
+// logs a line of one text
+#define log_P(level,s) do { log_start_P(level,s); log_end(); } while (0)
+
+#endif /* LOG_H_ */
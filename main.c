@@ -5,20 +5,78 @@
  * LED matrix displays and a DHT11 temperature and humidity sensor. Dynamic IP
  * address assignment is done using DHCP. DNS lookup is used for NTP host name
  * resolution. It is configurable via a built-in web server that implements GET
- * and POST methods and HTTP basic authentication. Web configurable parameters
- * are stored in EEPROM. At Ethernet link up, an IP address is obtained and
- * displayed for 30 seconds in which ARP, DNS and NTP are executed. If one of
- * those fails, the clock is reinitialized after that time. The modified DHCP
- * client retries obtaining the initial IP at exponential increasing intervals
- * and renews the address lease at half lease time, at 12.5% of the lease time
- * increasing intervals. Standard AVR Libc time keeping functions are used.
- * The highest and lowest temperature and humidity is recorded in RAM with time
- * stamps. Useful log messages are sent to the UART.
+ * and POST methods and HTTP basic authentication, the credentials that were
+ * accepted are kept encoded and compared in constant time. Web configurable
+ * parameters are stored in EEPROM with a check byte. A post only marks the
+ * changed fields, they are written in the background by the EEPROM ready
+ * interrupt, which skips the bytes that did not change. At Ethernet link up,
+ * an IP address is obtained and, unless the time is known, displayed for 30
+ * seconds while ARP, DNS and NTP are executed. Failing DNS and NTP requests
+ * are retried and then redone from the ARP step with the lease kept, failing
+ * ARP requests start over with DHCP. The modified DHCP client retries
+ * obtaining the initial IP at exponential increasing intervals and renews the
+ * address lease at half lease time, at 12.5% of the lease time increasing
+ * intervals. Standard AVR Libc time keeping functions are used.
+ * NTP answers are processed with sub-second precision: offset and round-trip
+ * delay are computed from all four time stamps and the timer is phase aligned
+ * to the fraction of the second. Small offsets are slewed out gradually and
+ * the crystal frequency error is estimated and corrected between updates.
+ * Up to four servers of the DNS answer are queried in parallel, the sample
+ * with the lowest delay of each server is kept and falsetickers are rejected
+ * before the best server is selected. The poll interval starts at a minute,
+ * doubles while updates find a small offset and jitter, up to the update
+ * period, and halves when they do not. Updates come a little early at random
+ * and failed ones are retried after a random, doubling delay.
+ * Clocks that are powered up together are kept apart by random numbers seeded
+ * from the mac and adc noise: the start up waits up to 4 seconds after link up
+ * and the DHCP, ARP, DNS and NTP retries vary by a quarter.
+ * The DNS answer is refreshed in the background at three quarters of its time
+ * to live, until then and during a DNS outage the servers of the previous
+ * answer are used. Failing NTP updates repeat the ARP but not the DNS lookup.
+ * The DNS and NTP mac come from an ARP cache that resolves them at the same
+ * time, refreshes them in the background and learns from the ARP packets for
+ * us. Link up with a valid lease, a new NTP host name and failing DNS lookups
+ * redo the start up from the ARP step and keep the lease, the caches and the
+ * time, which the display keeps showing. The Ethernet driver time stamps the
+ * requests when they are sent and the answers when they arrive. It reads the
+ * headers of a packet first and skips packets that are not for us.
+ * The style sheet and the script are copied from flash straight into the
+ * transmit buffer. Their urls carry a build id so browsers may cache them for
+ * a year, a conditional GET is answered with 304 Not Modified.
+ * The work is split in tasks with millisecond wake times: network, link, DHT,
+ * display and the DHCP, ARP, DNS and NTP start up. The cpu sleeps in idle mode
+ * when no task is due, the receive buffer is polled every 10 ms and only
+ * continuously while NTP answers are due. The cycles spent in receiving, DHCP,
+ * packet dispatch, HTTP, display and DHT are counted by TIMER0, their minimum,
+ * average and maximum are shown on the info page and sent to the UART after
+ * every NTP update.
+ * The display is rendered in a frame buffer and only the characters that
+ * changed are written to it.
+ * The DHT11 is read out in the background by the pin change interrupt, so the
+ * packet loop is never blocked by the sensor.
+ * Web pages that do not fit in one packet are sent in parts, each part is
+ * generated when the client acknowledges the previous one. A query or a form
+ * is parsed in one pass, each key goes to the handler of its page.
+ * A UDP query byte 'S' to port 1123 is answered with a binary status packet of
+ * fixed layout for monitoring, see udp_server_check_for_status_query().
+ * Packets, network errors, retries and sensor errors are counted in stats, the
+ * counters are in the status packet and on the info page.
+ * Temperature and humidity of the last 24 hours are recorded in RAM every 5
+ * minutes, the history page shows their extremes and a sparkline and /h.csv
+ * returns all samples. Every 30 minutes the time, the frequency correction and
+ * the last reading are written to a ring of 48 slots in EEPROM. At start up
+ * the history and the frequency correction are restored from the ring, after a
+ * reset that is not power-on also the time, from RAM if it survived.
+ * Useful log messages are sent to the UART at 115200 baud, as text or as
+ * compact binary records, see log.c. The level and the mode are selected by
+ * sending a character to the UART. A line that does not fit in the transmit
+ * buffer is dropped and counted, logging never waits for the UART.
  *
  * It uses a modified version of Guido Socher's TCP/IP stack, with changes to:
  * - enc28j60.c
  * - dhcp_client.c
  * - dnslkup.c
+ * - ip_arp_udp_tcp.c
  * - websrv_help_functions.c
  *
  * You need to define F_CPU as a symbol to gcc eg. -DF_CPU=7372800
@@ -34,32 +92,58 @@
 #include <avr/eeprom.h>
 #include <avr/wdt.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <ctype.h>
 #include <string.h>
 #include <time.h>
 #include "ip_arp_udp_tcp.h"
+#include "net.h"
 #include "websrv_help_functions.h"
 #include "enc28j60.h"
 #include "dhcp_client.h"
 #include "dnslkup.h"
 #include "hdlx2416.h"
-#include "uart.h"
+#include "log.h"
 #include "dht.h"
+#include "dht_log.h"
+#include "clock.h"
+#include "ntp_client.h"
+#include "sched.h"
+#include "prof.h"
+#include "nvstate.h"
+#include "eewrite.h"
+#include "stats.h"
+#include "jitter.h"
 
-// Board MAC address
-static uint8_t mymac[6] = {0x54,0x10,0xEC,0x00,0x28,0x60};
-// Time zone in minutes offset to UTC
-int16_t mins_offset_to_utc = 60;
-// Enable daylight saving time for EU
-static uint8_t enable_eu_dst = 1;
-// NTP Host name
+// Web configurable parameters, a copy is kept in EEPROM
 #define HOSTNAME_SIZE 24
-static char ntphostname[HOSTNAME_SIZE+1] = "time.apple.com";
-// Config web page password
 #define PASSWORD_SIZE 16
-static char password[PASSWORD_SIZE+1] = "secret";
-// NTP Update period in seconds
-static uint16_t ntp_update_period = 3600;
+struct config {
+	uint8_t mymac[6]; // Board MAC address
+	int16_t mins_offset_to_utc; // Time zone in minutes offset to UTC
+	uint8_t enable_eu_dst; // Enable daylight saving time for EU
+	char ntphostname[HOSTNAME_SIZE+1]; // NTP Host name
+	char password[PASSWORD_SIZE+1]; // Config web page password
+	uint16_t ntp_update_period; // NTP Update period in seconds
+	uint8_t display_24hclock;
+	uint8_t display_temperature;
+	uint8_t intensity;
+	uint8_t alarm_hour;
+	uint8_t alarm_min;
+	uint8_t alarm_enabled;
+	uint8_t sum; // check byte of the fields above
+};
+static struct config config = {
+	.mymac = {0x54,0x10,0xEC,0x00,0x28,0x60},
+	.mins_offset_to_utc = 60,
+	.enable_eu_dst = 1,
+	.ntphostname = "time.apple.com",
+	.password = "secret",
+	.ntp_update_period = 3600,
+	.display_24hclock = 1,
+	.display_temperature = 1,
+	.intensity = 4,
+};
 // NTP IP (DNS will provide a value for it):
 static uint8_t ntpip[4];
 // DNS (DHCP will provide a value for it):
@@ -71,15 +155,20 @@ static uint8_t gwip[4];
 // Net mask (DHCP will provide a value for it):
 static uint8_t netmask[4];
 // ARP resolving:
-#define TRANS_NUM_NTPMAC 1
-#define TRANS_NUM_DNSMAC 2
 static uint8_t ntproutingmac[6];
 static uint8_t dnsroutingmac[6];
 // state vars:
 static uint8_t have_ntp_mac=0;
 static uint8_t have_dns_mac=0;
 static int8_t init_state=-1; // 0=link up, 1=initial IP assignment, 2=resolve arps, 3=dns lookup, 4=ready for ntp req, 5=running
+#define INIT_JITTER_MS 4000 // the start up waits up to this long at random
 static uint8_t dns_state=0; // 0=pending, 1=started, 2=finished
+// DNS cache, the answer is refreshed at three quarters of its time to live
+#define DNS_MIN_TTL 60 // seconds
+#define DNS_MAX_TTL 86400
+#define DNS_RETRY_MS 60000 // refresh retry interval
+static uint8_t dns_cached=0; // the ntp servers of an answer are known
+static uint32_t dns_refresh; // clock_get_ms() time of the next refresh
 static uint8_t ntp_state=0; // 0=never sent a ntp req, 1=have time, 2=request sent no answer yet
 // global string buffer
 #define STR_BUFFER_SIZE 32
@@ -87,25 +176,67 @@ static char gStrbuf[STR_BUFFER_SIZE+1];
 // NTP:
 static uint8_t ntpclientportL; // lower 8 bytes of local port number
 static uint8_t ntp_retry_count=0;
+static uint8_t ntp_burst_count=0; // requests sent in this update
 static time_t start_t; // time of last ntp update
-static uint8_t display_24hclock=1;
-static uint8_t alarm_hour=0;
-static uint8_t alarm_min=0;
-static uint8_t alarm_enabled=0;
+// poll interval, doubled while the updates agree with the clock and halved
+// when they do not, up to config.ntp_update_period
+#define NTP_MIN_POLL 64 // seconds
+#define NTP_POLL_OFFSET 655 // 10 ms, smaller offsets and jitter are stable
+#define NTP_POLL_STABLE 2 // stable updates before the interval is doubled
+#define NTP_RETRY_MS 4000 // first retry, doubled for every retry
+static uint16_t ntp_poll=NTP_MIN_POLL;
+static uint8_t ntp_stable=0; // stable updates in a row
+static time_t ntp_next_t; // time of the next update
+static int32_t ntp_offset; // offset and delay of last ntp update
+static int32_t ntp_delay;
+// UDP status query:
+#define STATUS_PORT 1123
+#define STATUS_VERSION 3
+#define STATUS_QUERY 'S' // first byte of a query, never equal to STATUS_VERSION
 // timer:
 static volatile uint8_t display_update_pending=0;
-static volatile uint8_t delay_sec=0;
-static volatile uint8_t dht_delay_sec=0;
 static volatile uint8_t uptime_sec=0;
 static volatile uint8_t uptime_min=0;
 static volatile uint8_t uptime_hour=0;
 static volatile uint16_t uptime_day=0;
+// tasks:
+#define NET_POLL_MS 10 // receive buffer poll interval when idle
+#define NET_NTP_WAIT_MS 500 // longest time the buffer is polled for NTP answers
+#define DHT_PERIOD_MS 10000
+#define DHT_READ_MS 30 // a read out takes about 25 ms
+#define DHT_POLL_MS 5
+static uint8_t net_task;
+static uint32_t net_ntp_wait; // clock_get_ms() time the NTP answers are late
+static uint8_t init_task;
+static uint8_t link_task;
+static uint8_t dht_task;
+static uint8_t display_task;
+static uint32_t init_deadline; // clock_get_ms() time the init task may go on
+static uint8_t link_status=0;
+static uint8_t dhcp_status=0;
+static uint8_t dht_reading=0;
+static uint8_t display_sec=0;
+static uint8_t scroll_index=0;
+static char scroll_text[24]; // ip address followed by 8 spaces
+static uint8_t scroll_len; // length of the ip address
+static char display_fb[10]; // frame buffer, the first 8 are shown
+static uint8_t show_ip=0;
+static uint8_t arp_retry_count=0;
+static uint8_t dns_retry_count=0;
 // eth/ip buffer:
 #define BUFFER_SIZE 808
 static uint8_t buf[BUFFER_SIZE+1];
 static uint16_t dat_p;
+static uint16_t (*webpage_stream)(uint8_t,uint8_t*); // page that is sent in parts
+// a file in flash that is sent without copying it to buf
+struct static_file {
+	const char *data;
+	uint16_t len;
+	uint16_t sum; // one's complement sum of data, 0 until first use
+};
+static struct static_file *webpage_file; // file that follows the headers in buf
+static uint16_t build_id; // part of the urls and ETags of the files
 // Display:
-static uint8_t intensity=4;
 const char PROGMEM intensity0[]={">100%"};
 const char PROGMEM intensity1[]={">60%"};
 const char PROGMEM intensity2[]={">40%"};
@@ -116,37 +247,103 @@ const char PROGMEM intensity6[]={">7%"};
 const char PROGMEM intensity7[]={">3%"};
 PGM_P const PROGMEM intensities[8]={intensity0,intensity1,intensity2,intensity3,intensity4,intensity5,intensity6,intensity7};
 // DHT:
-static uint8_t display_temperature=1;
 static int8_t temperature;
 static int8_t humidity;
-static time_t low_temp_t;
-static time_t high_temp_t;
-static time_t low_hum_t;
-static time_t high_hum_t;
-static int8_t low_temp=127;
-static int8_t low_hum=127;
-static int8_t high_temp=0;
-static int8_t high_hum=0;
-// EEPROM:
-uint8_t EEMEM nv_magic_number_config;
-uint8_t EEMEM nv_ntpip[4];
-uint8_t EEMEM nv_password[PASSWORD_SIZE+1];
-uint8_t EEMEM nv_enable_eu_dst;
-uint8_t EEMEM nv_display_24hclock;
-uint16_t EEMEM nv_mins_offset_to_utc;
-uint8_t EEMEM nv_ntphostname[HOSTNAME_SIZE+1];
-uint8_t EEMEM nv_mymac[6];
-uint8_t EEMEM nv_magic_number_display;
-uint8_t EEMEM nv_display_temperature;
-uint8_t EEMEM nv_intensity;
-uint16_t EEMEM nv_ntp_update_period;
-uint8_t EEMEM nv_magic_number_password;
-uint8_t EEMEM nv_alarm_hour;
-uint8_t EEMEM nv_alarm_min;
-uint8_t EEMEM nv_alarm_enabled;
-uint8_t EEMEM nv_magic_number_alarm;
+static uint8_t dht_valid=0; // temperature and humidity were read
+// samples per part of a sparkline or of the csv file
+#define HISTORY_POINTS 72
+#define HISTORY_LINES 32
+// values of a page that is sent in parts, taken when the page is requested,
+// so a part that is sent again is made of the same bytes
+static union {
+	struct {
+		struct stats stats;
+		uint32_t uptime; // seconds
+		uint32_t leasetime;
+		uint8_t server_id[4];
+		uint16_t poll;
+		uint16_t log_dropped;
+	} info;
+	struct {
+		struct dht_log_stat stat;
+		time_t t; // time of the first sample
+		uint16_t count; // number of samples
+	} history;
+} page_snap;
+// HTTP basic authentication, the credentials that matched config.password
+#define AUTH_TOKEN_SIZE 44 // base64 of a user name and password of 33 bytes
+static char auth_token[AUTH_TOKEN_SIZE];
+static uint8_t auth_token_len=0; // 0 until a request is authorized
+// forms:
+static uint8_t form_page; // page of the query of the root web page
+static uint8_t form_error; // a value of the config form is wrong
+static uint8_t form_restart; // what analyse_post_url() returns
+// EEPROM:
+struct config EEMEM nv_config;
+// eeprom of the firmware before the config struct: separate blocks, each
+// valid when its magic number matches. They were at address 0 in reverse
+// order of their definition.
+#define OLD_CONFIG_ADDR 0
+struct old_config {
+	uint8_t magic_alarm; // 0xCC
+	uint8_t alarm_enabled;
+	uint8_t alarm_min;
+	uint8_t alarm_hour;
+	uint8_t magic_password; // 0x33
+	uint16_t ntp_update_period;
+	uint8_t intensity;
+	uint8_t display_temperature;
+	uint8_t magic_display; // 0xAA, also covers display_24hclock
+	uint8_t mymac[6];
+	char ntphostname[HOSTNAME_SIZE+1];
+	int16_t mins_offset_to_utc;
+	uint8_t display_24hclock;
+	uint8_t enable_eu_dst;
+	char password[PASSWORD_SIZE+1];
+	uint8_t ntpip[4]; // not kept, it is looked up
+	uint8_t magic_config; // 0x55
+};
+// fields of the config that eeprom is written in, the bits of config_dirty
+struct config_field {
+	uint8_t offset;
+	uint8_t size;
+};
+#define CONFIG_FIELD(f) {offsetof(struct config,f),sizeof(config.f)}
+const struct config_field PROGMEM config_fields[]={
+	CONFIG_FIELD(mymac),
+	CONFIG_FIELD(mins_offset_to_utc),
+	CONFIG_FIELD(enable_eu_dst),
+	CONFIG_FIELD(ntphostname),
+	CONFIG_FIELD(password),
+	CONFIG_FIELD(ntp_update_period),
+	CONFIG_FIELD(display_24hclock),
+	CONFIG_FIELD(display_temperature),
+	CONFIG_FIELD(intensity),
+	{offsetof(struct config,alarm_hour),3}, // hour, minute and enabled
+	CONFIG_FIELD(sum) // written last
+};
+#define CONFIG_FIELDS (sizeof(config_fields)/sizeof(struct config_field))
+#define CONFIG_MAC (1<<0)
+#define CONFIG_ZONE (1<<1)
+#define CONFIG_DST (1<<2)
+#define CONFIG_HOSTNAME (1<<3)
+#define CONFIG_PASSWORD (1<<4)
+#define CONFIG_PERIOD (1<<5)
+#define CONFIG_24H (1<<6)
+#define CONFIG_TEMPERATURE (1<<7)
+#define CONFIG_INTENSITY (1<<8)
+#define CONFIG_ALARM (1<<9)
+#define CONFIG_SUM (1<<10) // set by config_save()
+static uint16_t config_dirty=0; // fields that differ from eeprom
 // WDT:
 uint8_t mcusr_mirror __attribute__ ((section (".noinit")));
+// the time survives a reset that is not power-on
+struct warm_time {
+	time_t t;
+	uint8_t sum;
+};
+static struct warm_time warm_time __attribute__ ((section (".noinit")));
+static time_t nvstate_t=0; // time of the last snapshot in eeprom
 // Buzzer:
 #define buzzer_on() PORTC |= 1<<PINC5
 #define buzzer_init() DDRC |= 1<<PINC5
@@ -159,16 +356,51 @@ void __attribute__((naked)) __attribute__((section(".init3"))) get_mcusr(void)
 	wdt_disable();
 }
 
-// Daylight Saving function for the European Union
-// From http://savannah.nongnu.org/bugs/?44327
+// Daylight Saving for the European Union starts and ends at 1:00 UTC on the
+// last Sunday of March and October, this computes both instants of the year
+// of t, valid until 2099
+static time_t dst_year_start=1;
+static time_t dst_year_end=0;
+static time_t dst_start;
+static time_t dst_end;
+static void eu_dst_year(time_t t)
+{
+	uint16_t days=0; // days from 2000 to the start of the year
+	uint16_t len;
+	uint16_t d;
+	uint8_t y=0;
+	while(1){
+		len=(y%4) ? 365 : 366;
+		if ((time_t)(days+len)*ONE_DAY>t) break;
+		days+=len;
+		y++;
+	}
+	dst_year_start=(time_t)days*ONE_DAY;
+	dst_year_end=dst_year_start+(time_t)len*ONE_DAY;
+	// day of March 31 and October 31, January 1 2000 was a Saturday
+	d=days+89+len-365;
+	dst_start=(time_t)(d-(d+6)%7)*ONE_DAY+ONE_HOUR;
+	d=days+303+len-365;
+	dst_end=(time_t)(d-(d+6)%7)*ONE_DAY+ONE_HOUR;
+}
+
+// Daylight Saving function for the European Union
 static int eu_dst(const time_t *timer, int32_t *z)
 {
-	uint32_t t = *timer;
-	if ((uint8_t)(t >> 24) >= 194) t -= 3029443200U;
-	t = (t + 655513200) / 604800 * 28;
-	if ((uint16_t)(t % 1461) < 856) return 3600;
+	if (*timer<dst_year_start || *timer>=dst_year_end) eu_dst_year(*timer);
+	if (*timer>=dst_start && *timer<dst_end) return ONE_HOUR;
 	else return 0;
 }
+
+// returns the next switch of the European Union Daylight Saving after t, or
+// the start of the next year
+static time_t eu_dst_next(time_t t)
+{
+	if (t<dst_year_start || t>=dst_year_end) eu_dst_year(t);
+	if (t<dst_start) return(dst_start);
+	if (t<dst_end) return(dst_end);
+	return(dst_year_end);
+}
 
 // convert two decimal number to string with leading zero
 // s must point a 3 bytes buffer minimum
@@ -219,18 +451,17 @@ static int16_t parse_offset(char *buf) {
 }
 
 static void alarm_time_to_dispstr(char *buf) {
-	zero_two_d(buf, alarm_hour);
+	zero_two_d(buf, config.alarm_hour);
 	buf[2] = ':';
-	zero_two_d(buf + 3, alarm_min);
+	zero_two_d(buf + 3, config.alarm_min);
 }
 
 static void parse_alarm_time(char *str) {
 	char *sep;
 	
-	alarm_hour = atoi(str);
+	config.alarm_hour = atoi(str);
 	if ((sep = strchr(str, ':'))) {
-		*sep++ = '\0';
-		alarm_min = atoi(sep);
+		config.alarm_min = atoi(sep + 1);
 	}
 }
 
@@ -239,14 +470,9 @@ static uint16_t http200ok(void){
 	return(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nPragma: no-cache\r\n\r\n")));
 }
 
-// 59 bytes
-static uint16_t http200okjs(void){
-	return(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: application/x-javascript\r\n\r\n")));
-}
-
 // 43 bytes
-static uint16_t http200okcss(void){
-	return(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: text/css\r\n\r\n")));
+static uint16_t http200okcsv(void){
+	return(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: text/csv\r\n\r\n")));
 }
 
 // 47 bytes
@@ -274,13 +500,8 @@ static uint16_t http501notimpl(void){
 	return(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 501 Not Implemented\r\nContent-Type: text/html\r\n\r\n")));
 }
 
-// tz.js
-static uint16_t print_tzjs(void)
-{
-	uint16_t plen;
-	plen=http200okjs();
-	// show this computers TZ offset
-	plen=fill_tcp_data_p(buf,plen,PSTR("\
+// tz.js, shows this computers TZ offset
+const char PROGMEM tzjs[]={"\
 function tzi(){\n\
 	var d = new Date();\n\
 	var tzo = -d.getTimezoneOffset();\n\
@@ -290,16 +511,10 @@ function tzi(){\n\
 	var st = hour + \":\" + min;\n\
 	if (tzo > 0) st = \"UTC+\" + st; else st = \"UTC\" + st;\n\
 	document.write(\" [Info: your PC is \"+st+\"]\");\n\
-}\n"));
-	return(plen);
-}
+}\n"};
 
 // s.css
-static uint16_t print_s1css(void) {
-	uint16_t plen;
-	
-	plen=http200okcss();
-	plen=fill_tcp_data_p(buf,plen,PSTR("\
+const char PROGMEM s1css[]={"\
 body {\n\
 	font-family: arial, sans-serif;\n\
 }\n\
@@ -323,8 +538,49 @@ a {\n\
 }\n\
 a:hover {\n\
 	text-decoration: underline;\n\
-}\n"));
-	return(plen);
+}\n"};
+static struct static_file tzjs_file={tzjs,sizeof(tzjs)-1,0};
+static struct static_file s1css_file={s1css,sizeof(s1css)-1,0};
+
+// prints the ETag of a file to gStrbuf: build id and checksum in quotes
+static void print_etag(struct static_file *f) {
+	char *s=gStrbuf;
+	// the checksum of a file is computed at first use
+	if (f->sum==0) {
+		f->sum=www_sum_p(f->data,f->len);
+	}
+	*s++='"';
+	utoa(build_id,s,16);
+	s+=strlen(s);
+	*s++='-';
+	utoa(f->sum,s,16);
+	s+=strlen(s);
+	*s++='"';
+	*s='\0';
+}
+
+// about 70 bytes, the urls of the files change with every build so they
+// may be cached for a year
+static uint16_t print_cache_headers(uint16_t pos, struct static_file *f) {
+	pos=fill_tcp_data_p(buf,pos,PSTR("Cache-Control: max-age=31536000\r\nETag: "));
+	print_etag(f);
+	pos=fill_tcp_data(buf,pos,gStrbuf);
+	return(fill_tcp_data_p(buf,pos,PSTR("\r\n\r\n")));
+}
+
+// 28 bytes + cache headers
+static uint16_t http304notmodified(struct static_file *f){
+	return(print_cache_headers(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 304 Not Modified\r\n")),f));
+}
+
+// 57 bytes + cache headers
+static uint16_t http200okjs(void){
+	return(print_cache_headers(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: application/x-javascript\r\n")),&tzjs_file));
+}
+
+// 41 bytes + cache headers
+static uint16_t http200okcss(void){
+	return(print_cache_headers(fill_tcp_data_p(buf,0,PSTR("HTTP/1.0 200 OK\r\nContent-Type: text/css\r\n")),&s1css_file));
 }
 
 // returns netmask length
@@ -353,6 +609,14 @@ static uint16_t print_number_on_webpage(uint16_t pos, uint16_t num, const char *
 	return(pos);
 }
 
+// prints progmem string followed by a 32 bit number on the web page to the tcp send buffer
+static uint16_t print_number32_on_webpage(uint16_t pos, uint32_t num, const char *progmem_s) {
+	pos=fill_tcp_data_p(buf,pos,progmem_s);
+	ultoa(num,gStrbuf,10);
+	pos=fill_tcp_data(buf,pos,gStrbuf);
+	return(pos);
+}
+
 // prints a number followed by a progmem string on the web page to the tcp send buffer
 static uint16_t print_number_first_on_webpage(uint16_t pos, uint16_t num, const char *progmem_s) {
 	utoa(num,gStrbuf,10);
@@ -388,10 +652,24 @@ static uint16_t print_time_on_webpage(uint16_t pos, time_t *t, const char *progm
 	return(pos);
 }
 
-// prints the header of a web page with optional progmem string to the tcp send buffer
-static uint16_t print_html_head(uint16_t pos,const char *progmem_s) {
-	pos=fill_tcp_data_p(buf,pos,PSTR("<!DOCTYPE html>\n<html><head><title>NTP clock</title><link rel=stylesheet href=s.css>"));
-	if (progmem_s) pos=fill_tcp_data_p(buf,pos,progmem_s);
+// prints the url of a file with the build id
+static uint16_t print_file_url(uint16_t pos,const char *name_p) {
+	pos=fill_tcp_data_p(buf,pos,name_p);
+	pos=fill_tcp_data_p(buf,pos,PSTR("?b="));
+	utoa(build_id,gStrbuf,16);
+	return(fill_tcp_data(buf,pos,gStrbuf));
+}
+
+// prints the head with an optional script file
+static uint16_t print_html_head(uint16_t pos,const char *script_p) {
+	pos=fill_tcp_data_p(buf,pos,PSTR("<!DOCTYPE html>\n<html><head><title>NTP clock</title><link rel=stylesheet href="));
+	pos=print_file_url(pos,PSTR("s.css"));
+	pos=fill_tcp_data_p(buf,pos,PSTR(">"));
+	if (script_p) {
+		pos=fill_tcp_data_p(buf,pos,PSTR("<script src="));
+		pos=print_file_url(pos,script_p);
+		pos=fill_tcp_data_p(buf,pos,PSTR("></script>"));
+	}
 	pos=fill_tcp_data_p(buf,pos,PSTR("</head><body><div>"));
 	return(pos);
 }
@@ -420,16 +698,16 @@ static uint16_t print_webpage_authfail(void) {
 static uint16_t print_webpage_config(void)
 {
 	uint16_t plen;
-	plen=print_html_head(http200ok(),PSTR("<script src=tz.js></script>"));
+	plen=print_html_head(http200ok(),PSTR("tz.js"));
 	plen=fill_tcp_data_p(buf,plen,PSTR("<h2>Config</h2><pre><form action=/cu method=post>\n<b>NTP hostname:</b>\t<input type=text name=nt value="));
-	plen=fill_tcp_data(buf,plen,ntphostname);
-	plen=print_number_on_webpage(plen,ntp_update_period,PSTR(">\n<b>Update period:</b>\t<input type=text name=up value="));
-	plen=print_mac_on_webpage(plen,mymac,PSTR(">\n<b>MAC address:</b>\t<input type=text name=ma value="));
+	plen=fill_tcp_data(buf,plen,config.ntphostname);
+	plen=print_number_on_webpage(plen,config.ntp_update_period,PSTR(">\n<b>Update period:</b>\t<input type=text name=up value="));
+	plen=print_mac_on_webpage(plen,config.mymac,PSTR(">\n<b>MAC address:</b>\t<input type=text name=ma value="));
 	plen=fill_tcp_data_p(buf,plen,PSTR(">\n<b>UTC offset:</b>\t<input type=text name=tz value="));
-	offset_to_dispstr(mins_offset_to_utc,gStrbuf);
+	offset_to_dispstr(config.mins_offset_to_utc,gStrbuf);
 	plen=fill_tcp_data(buf,plen,gStrbuf);
 	plen=fill_tcp_data_p(buf,plen,PSTR("><script>tzi()</script>\n<b>Apply:</b>\t\t<input type=checkbox name=st"));
-	if (enable_eu_dst){
+	if (config.enable_eu_dst){
 		plen=fill_tcp_data_p(buf,plen,PSTR(" checked"));
 	}
 	plen=fill_tcp_data_p(buf,plen,PSTR(">EU DST\n<br><input type=submit value=apply> <input type=button value=cancel onclick=\"window.location='/'\"></form></pre>"));
@@ -455,11 +733,11 @@ static uint16_t print_webpage_display(void) {
 	
 	plen=print_html_head(http200ok(),NULL);
 	plen=fill_tcp_data_p(buf,plen,PSTR("<h2>Display</h2><pre><form action=/du method=post>\n<b>Show:</b>\t\t<input type=checkbox name=hh"));
-	if (display_24hclock){
+	if (config.display_24hclock){
 		plen=fill_tcp_data_p(buf,plen,PSTR(" checked"));
 	}
 	plen=fill_tcp_data_p(buf,plen,PSTR(">24h <input type=checkbox name=te"));
-	if (display_temperature){
+	if (config.display_temperature){
 		plen=fill_tcp_data_p(buf,plen,PSTR(" checked"));
 	}
 	plen=fill_tcp_data_p(buf,plen,PSTR(">Temperature\n<b>Intensity:</b>\t<select name=in>"));
@@ -468,7 +746,7 @@ static uint16_t print_webpage_display(void) {
 		gStrbuf[0]='0'+i;
 		gStrbuf[1]='\0';
 		plen=fill_tcp_data(buf,plen,gStrbuf);
-		if (intensity==i){
+		if (config.intensity==i){
 			plen=fill_tcp_data_p(buf,plen,PSTR(" selected"));
 		}
 		memcpy_P(&ptr, &intensities[i], sizeof(PGM_P));
@@ -480,62 +758,223 @@ static uint16_t print_webpage_display(void) {
 	return(plen);
 }
 
-// prepare the web page by writing the data to the tcp send buffer
-static uint16_t print_webpage_history(void) {
-	uint16_t plen;
+// returns the seconds since the clock started
+static uint32_t get_uptime(void) {
+	return(((uint32_t)uptime_day*24+uptime_hour)*3600+uptime_min*60+uptime_sec);
+}
+
+// takes the values of the info page, the cycle counts are held until the
+// page is sent
+static void info_snapshot(void) {
+	page_snap.info.stats=stats;
+	page_snap.info.uptime=get_uptime();
+	dhcp_get_info(page_snap.info.server_id,&page_snap.info.leasetime);
+	page_snap.info.poll=ntp_poll;
+	page_snap.info.log_dropped=log_get_dropped();
+	prof_hold(1);
+}
+
+// takes the samples of the history pages. A page is sent in less time than
+// DHT_LOG_INTERVAL, so at most one sample is added while it is sent, which
+// drops up to DHT_LOG_MAX_LEN samples from a full ring: the page starts
+// behind them.
+static void history_snapshot(void) {
+	struct dht_log_pos lp;
+	uint8_t skip;
+
+	page_snap.history.count=dht_log_get_stat(&page_snap.history.stat);
+	skip=(dht_log_get_free()<DHT_LOG_MAX_LEN) ? DHT_LOG_MAX_LEN : 0;
+	dht_log_seek(&lp,skip);
+	page_snap.history.t=lp.t;
+	page_snap.history.count-=skip;
+}
+
+// moves lp to sample n of the history snapshot, the ring may have moved on
+// since, returns 0 if there is no such sample
+static uint8_t history_seek(struct dht_log_pos *lp, uint16_t n) {
+	if (n>=page_snap.history.count || !dht_log_seek(lp,0) || lp->t>page_snap.history.t)
+		return(0);
+	return(dht_log_seek(lp,n+(page_snap.history.t-lp->t)/DHT_LOG_INTERVAL));
+}
+
+// prints sparkline points of the samples from n on to the tcp send buffer, y
+// is 100 minus twice the temperature or minus the humidity
+static uint16_t print_sparkline_on_webpage(uint16_t pos, uint16_t n, uint8_t hum) {
+	struct dht_log_pos lp;
+	uint8_t i=0;
+	uint8_t more;
 	
-	plen=print_html_head(http200ok(),NULL);
-	plen=fill_tcp_data_p(buf,plen,PSTR("<h2>History</h2><pre><form action=/ method=get>\n"));
-	plen=print_number_on_webpage(plen,high_temp,PSTR("<b>Highest Temperature:</b>\t"));
-	plen=print_time_on_webpage(plen,&high_temp_t,PSTR(" &deg;C @ "));
-	plen=print_number_on_webpage(plen,low_temp,PSTR("\n<b>Lowest Temperature:</b>\t"));
-	plen=print_time_on_webpage(plen,&low_temp_t,PSTR(" &deg;C @ "));
-	plen=print_number_on_webpage(plen,high_hum,PSTR("\n<b>Highest Humidity:</b>\t"));
-	plen=print_time_on_webpage(plen,&high_hum_t,PSTR(" %  @ "));
-	plen=print_number_on_webpage(plen,low_hum,PSTR("\n<b>Lowest Humidity:</b>\t"));
-	plen=print_time_on_webpage(plen,&low_hum_t,PSTR(" %  @ "));
-	plen=fill_tcp_data_p(buf,plen,PSTR("\n<br><input name=pg type=hidden value=3><input name=ac type=submit value=clear></form></pre><a href=/>home</a> | <a href=/?pg=3>refresh</a>"));
+	more=history_seek(&lp,n);
+	while (more && i<HISTORY_POINTS && n<page_snap.history.count) {
+		utoa(n,gStrbuf,10);
+		pos=fill_tcp_data(buf,pos,gStrbuf);
+		gStrbuf[0]=',';
+		itoa((hum) ? 100-lp.humidity : 100-2*lp.temperature,gStrbuf+1,10);
+		pos=fill_tcp_data(buf,pos,gStrbuf);
+		pos=fill_tcp_data_p(buf,pos,PSTR(" "));
+		more=dht_log_next(&lp);
+		n++;
+		i++;
+	}
+	return(pos);
+}
+
+// prepare a part of the history web page by writing the data to the tcp send buffer
+// part 0 has the extremes, then each sparkline takes one or more parts
+static uint16_t print_webpage_history(uint8_t part, uint8_t *last) {
+	uint16_t plen=0;
+	uint8_t parts;
+	struct dht_log_stat *stat=&page_snap.history.stat;
+	
+	if (part==0) {
+		plen=print_html_head(http200ok(),NULL);
+		plen=fill_tcp_data_p(buf,plen,PSTR("<h2>History</h2><pre><form action=/ method=get>\n"));
+		plen=print_number_on_webpage(plen,stat->high_temp,PSTR("<b>Highest Temperature:</b>\t"));
+		plen=print_time_on_webpage(plen,&stat->high_temp_t,PSTR(" &deg;C @ "));
+		plen=print_number_on_webpage(plen,stat->low_temp,PSTR("\n<b>Lowest Temperature:</b>\t"));
+		plen=print_time_on_webpage(plen,&stat->low_temp_t,PSTR(" &deg;C @ "));
+		plen=print_number_on_webpage(plen,stat->high_hum,PSTR("\n<b>Highest Humidity:</b>\t"));
+		plen=print_time_on_webpage(plen,&stat->high_hum_t,PSTR(" %  @ "));
+		plen=print_number_on_webpage(plen,stat->low_hum,PSTR("\n<b>Lowest Humidity:</b>\t"));
+		plen=print_time_on_webpage(plen,&stat->low_hum_t,PSTR(" %  @ "));
+		plen=fill_tcp_data_p(buf,plen,PSTR("\n<b>Last 24 hours:</b>\t<span style=color:red>temperature</span> <span style=color:blue>humidity</span>"));
+		plen=fill_tcp_data_p(buf,plen,PSTR("\n<br><input name=pg type=hidden value=3><input name=ac type=submit value=clear></form></pre>"));
+		return(plen);
+	}
+	parts=(page_snap.history.count+HISTORY_POINTS-1)/HISTORY_POINTS;
+	if (part<=2*parts) {
+		part--;
+		if (part==0) {
+			plen=print_number_on_webpage(plen,DHT_LOG_SIZE,PSTR("<svg viewBox=\"0 0 "));
+			plen=fill_tcp_data_p(buf,plen,PSTR(" 100\" width=550 height=100 preserveAspectRatio=none><polyline fill=none stroke=red points=\""));
+		}
+		if (part==parts)
+			plen=fill_tcp_data_p(buf,plen,PSTR("<polyline fill=none stroke=blue points=\""));
+		plen=print_sparkline_on_webpage(plen,(part%parts)*HISTORY_POINTS,part>=parts);
+		if (part%parts==parts-1)
+			plen=fill_tcp_data_p(buf,plen,PSTR("\"/>"));
+		if (part==2*parts-1)
+			plen=fill_tcp_data_p(buf,plen,PSTR("</svg>"));
+		return(plen);
+	}
+	*last=1;
+	plen=fill_tcp_data_p(buf,plen,PSTR("<a href=/>home</a> | <a href=/?pg=3>refresh</a> | <a href=/h.csv>csv</a>"));
 	plen=print_html_foot(plen);
 	return(plen);
 }
 
-// prepare the web page by writing the data to the tcp send buffer
-static uint16_t print_webpage_info(void) {
+// h.csv, unix time, temperature and humidity of every sample
+static uint16_t print_history_csv(uint8_t part, uint8_t *last) {
+	uint16_t plen=0;
+	uint8_t i=0;
+	uint8_t more;
+	uint16_t n=part*HISTORY_LINES;
+	struct dht_log_pos lp;
+	
+	if (part==0) {
+		plen=http200okcsv();
+		plen=fill_tcp_data_p(buf,plen,PSTR("time,temperature,humidity\n"));
+	}
+	more=history_seek(&lp,n);
+	while (more && i<HISTORY_LINES && n<page_snap.history.count) {
+		ultoa(lp.t+UNIX_OFFSET,gStrbuf,10);
+		plen=fill_tcp_data(buf,plen,gStrbuf);
+		gStrbuf[0]=',';
+		itoa(lp.temperature,gStrbuf+1,10);
+		plen=fill_tcp_data(buf,plen,gStrbuf);
+		itoa(lp.humidity,gStrbuf+1,10);
+		plen=fill_tcp_data(buf,plen,gStrbuf);
+		plen=fill_tcp_data_p(buf,plen,PSTR("\n"));
+		more=dht_log_next(&lp);
+		n++;
+		i++;
+	}
+	if ((part+1)*HISTORY_LINES>=page_snap.history.count) *last=1;
+	return(plen);
+}
+
+// prepare a part of the info web page by writing the data to the tcp send buffer
+static uint16_t print_webpage_info(uint8_t part, uint8_t *last) {
 	uint16_t plen;
 	uint8_t *gwmac=NULL;
-	uint8_t server_id[4];
-	uint32_t leasetime;
+	uint32_t min,avg,max;
+	uint32_t t;
+	uint8_t i;
 	
-	plen=print_html_head(http200ok(),NULL);
-	plen=print_number_on_webpage(plen,enc28j60getrev(),PSTR("<h2>Info</h2><pre><b>ENC28J60 Rev:</b>\tB"));
-	plen=print_mac_on_webpage(plen,mymac,PSTR("\n<b>MAC address:</b>\t"));
-	plen=print_ip_on_webpage(plen,myip,PSTR("\n<b>IP address:</b>\t"));
-	gStrbuf[0]='/';
-	itoa(get_netmask_length(netmask),gStrbuf+1,10);
-	plen=fill_tcp_data(buf,plen,gStrbuf);
-	plen=print_ip_on_webpage(plen,gwip,PSTR("\n<b>Gateway:</b>\t"));
-	if (route_via_gw(ntpip))
-		gwmac=&ntproutingmac[0];
-	else
-		plen=print_mac_on_webpage(plen,ntproutingmac,PSTR("\n<b>NTP MAC:</b>\t"));
-	if (route_via_gw(mydns))
-		gwmac=&dnsroutingmac[0];
-	else
-		plen=print_mac_on_webpage(plen,dnsroutingmac,PSTR("\n<b>DNS MAC:</b>\t"));
-	if (gwmac)
-		plen=print_mac_on_webpage(plen,gwmac,PSTR("\n<b>Gateway MAC:</b>\t"));
-	plen=print_number_on_webpage(plen,ntp_update_period,PSTR("\n<b>Update period:</b>\t"));
-	dhcp_get_info(server_id,&leasetime);
-	plen=print_ip_on_webpage(plen,server_id,PSTR(" seconds\n<b>DHCP server:</b>\t"));
-	plen=print_number_on_webpage(plen,leasetime/60,PSTR("\n<b>Lease time:</b>\t"));
+	if (part==0) {
+		plen=print_html_head(http200ok(),NULL);
+		plen=print_number_on_webpage(plen,enc28j60getrev(),PSTR("<h2>Info</h2><pre><b>ENC28J60 Rev:</b>\tB"));
+		plen=print_mac_on_webpage(plen,config.mymac,PSTR("\n<b>MAC address:</b>\t"));
+		plen=print_ip_on_webpage(plen,myip,PSTR("\n<b>IP address:</b>\t"));
+		gStrbuf[0]='/';
+		itoa(get_netmask_length(netmask),gStrbuf+1,10);
+		plen=fill_tcp_data(buf,plen,gStrbuf);
+		plen=print_ip_on_webpage(plen,gwip,PSTR("\n<b>Gateway:</b>\t"));
+		if (route_via_gw(ntpip))
+			gwmac=&ntproutingmac[0];
+		else
+			plen=print_mac_on_webpage(plen,ntproutingmac,PSTR("\n<b>NTP MAC:</b>\t"));
+		if (route_via_gw(mydns))
+			gwmac=&dnsroutingmac[0];
+		else
+			plen=print_mac_on_webpage(plen,dnsroutingmac,PSTR("\n<b>DNS MAC:</b>\t"));
+		if (gwmac)
+			plen=print_mac_on_webpage(plen,gwmac,PSTR("\n<b>Gateway MAC:</b>\t"));
+		return(plen);
+	}
+	if (part==3) {
+		*last=1;
+		plen=print_number32_on_webpage(0,page_snap.info.stats.rx_packets,PSTR("\n\n<b>Received:</b>\t"));
+		plen=print_number32_on_webpage(plen,page_snap.info.stats.rx_rejected,PSTR(" packets, skipped "));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.rx_errors,PSTR(", bad "));
+		plen=print_number32_on_webpage(plen,page_snap.info.stats.tx_packets,PSTR("\n<b>Sent:</b>\t\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.tx_timeouts,PSTR(" packets, hung "));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.tx_errors,PSTR(", aborted "));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.arp_retries,PSTR("\n<b>ARP retries:</b>\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.dns_errors,PSTR("\n<b>DNS errors:</b>\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.ntp_fails,PSTR("\n<b>NTP failures:</b>\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.dhcp_changes,PSTR("\n<b>DHCP changes:</b>\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.dht_errors,PSTR("\n<b>DHT errors:</b>\t"));
+		plen=print_number_on_webpage(plen,page_snap.info.stats.dht_checksum_errors,PSTR(", bad checksum "));
+		plen=print_number_on_webpage(plen,page_snap.info.log_dropped,PSTR("\n<b>Log dropped:</b>\t"));
+		plen=fill_tcp_data_p(buf,plen,PSTR(" lines\n</pre><a href=/>home</a> | <a href=/?pg=4>refresh</a>"));
+		plen=print_html_foot(plen);
+		return(plen);
+	}
+	if (part==2) {
+		plen=fill_tcp_data_p(buf,0,PSTR("\n\n<b>Cycles</b>\t\tmin\tavg\tmax"));
+		i=0;
+		while(i<PROF_PHASES){
+			if (prof_get(i,&min,&avg,&max)) {
+				plen=fill_tcp_data_p(buf,plen,PSTR("\n<b>"));
+				plen=fill_tcp_data_p(buf,plen,prof_get_name_p(i));
+				plen=fill_tcp_data_p(buf,plen,PSTR(":</b>\t\t"));
+				ultoa(min,gStrbuf,10);
+				plen=fill_tcp_data(buf,plen,gStrbuf);
+				ultoa(avg,gStrbuf,10);
+				plen=fill_tcp_data_p(buf,plen,PSTR("\t"));
+				plen=fill_tcp_data(buf,plen,gStrbuf);
+				ultoa(max,gStrbuf,10);
+				plen=fill_tcp_data_p(buf,plen,PSTR("\t"));
+				plen=fill_tcp_data(buf,plen,gStrbuf);
+			}
+			i++;
+		}
+		return(plen);
+	}
+	plen=print_number_on_webpage(0,config.ntp_update_period,PSTR("\n<b>Update period:</b>\t"));
+	plen=print_number_on_webpage(plen,page_snap.info.poll,PSTR(" seconds\n<b>Poll interval:</b>\t"));
+	plen=print_ip_on_webpage(plen,page_snap.info.server_id,PSTR(" seconds\n<b>DHCP server:</b>\t"));
+	plen=print_number_on_webpage(plen,page_snap.info.leasetime/60,PSTR("\n<b>Lease time:</b>\t"));
 	plen=fill_tcp_data_p(buf,plen,PSTR(" minutes\n<b>Uptime:</b>\t\t"));
-	if (uptime_day)
-		plen=print_number_first_on_webpage(plen,uptime_day,PSTR(" days, "));
-	if (uptime_hour)
-		plen=print_number_first_on_webpage(plen,uptime_hour,PSTR(" hours, "));
-	if (uptime_min)
-		plen=print_number_first_on_webpage(plen,uptime_min,PSTR(" minutes, "));
-	plen=print_number_first_on_webpage(plen,uptime_sec,PSTR(" seconds\n<b>Reset reason:</b>\t"));
+	t=page_snap.info.uptime;
+	if (t>=86400)
+		plen=print_number_first_on_webpage(plen,t/86400,PSTR(" days, "));
+	if ((t/3600)%24)
+		plen=print_number_first_on_webpage(plen,(t/3600)%24,PSTR(" hours, "));
+	if ((t/60)%60)
+		plen=print_number_first_on_webpage(plen,(t/60)%60,PSTR(" minutes, "));
+	plen=print_number_first_on_webpage(plen,t%60,PSTR(" seconds\n<b>Reset reason:</b>\t"));
 	if (mcusr_mirror & (1<<PORF)){
 		plen=fill_tcp_data_p(buf,plen,PSTR("Power-on"));
 	}else{
@@ -546,8 +985,6 @@ static uint16_t print_webpage_info(void) {
 		if (mcusr_mirror & (1<<WDRF))
 			plen=fill_tcp_data_p(buf,plen,PSTR("Watchdog System"));
 	}
-	plen=fill_tcp_data_p(buf,plen,PSTR("\n</pre><a href=/>home</a> | <a href=/?pg=4>refresh</a>"));
-	plen=print_html_foot(plen);
 	return(plen);
 }
 
@@ -559,7 +996,7 @@ static uint16_t print_webpage_alarm(void) {
 	alarm_time_to_dispstr(gStrbuf);
 	plen=fill_tcp_data(buf,plen,gStrbuf);
 	plen=fill_tcp_data_p(buf,plen,PSTR(">\n<b>Alarm:</b>\t\t<input type=checkbox name=al"));
-	if (alarm_enabled){
+	if (config.alarm_enabled){
 		plen=fill_tcp_data_p(buf,plen,PSTR(" checked"));
 	}
 	plen=fill_tcp_data_p(buf,plen,PSTR(">enabled\n<br><input type=submit value=apply> <input type=button value=cancel onclick=\"window.location='/'\"></form></pre>"));
@@ -572,11 +1009,12 @@ static uint16_t print_webpage_main(void)
 {
 	uint16_t plen;
 	time_t now;
+	uint8_t *peer;
 	plen=print_html_head(http200ok(),NULL);
 	time(&now);
 	plen=print_time_on_webpage(plen,&now,PSTR("<h2>NTP clock</h2><pre><b>Time:</b>\t\t"));
 	plen=fill_tcp_data_p(buf,plen,PSTR(" (UTC"));
-	offset_to_dispstr(mins_offset_to_utc,gStrbuf);
+	offset_to_dispstr(config.mins_offset_to_utc,gStrbuf);
 	plen=fill_tcp_data(buf,plen,gStrbuf);
 	plen=print_ip_on_webpage(plen,mydns,PSTR(")\n<b>DNS server:</b>\t"));
 	plen=fill_tcp_data_p(buf,plen,PSTR(" ["));
@@ -587,8 +1025,9 @@ static uint16_t print_webpage_main(void)
 	else
 		plen=fill_tcp_data_p(buf,plen,PSTR("OK"));
 	plen=fill_tcp_data_p(buf,plen,PSTR("]\n<b>NTP server:</b>\t"));
-	plen=fill_tcp_data(buf,plen,ntphostname);
-	plen=print_ip_on_webpage(plen,ntpip,PSTR(" ["));
+	plen=fill_tcp_data(buf,plen,config.ntphostname);
+	peer=ntp_client_get_peer();
+	plen=print_ip_on_webpage(plen,(peer) ? peer : ntpip,PSTR(" ["));
 	plen=print_time_on_webpage(plen,&start_t,PSTR("]\n<b>Last sync:</b>\t"));
 	if (ntp_state!=1) 
 		plen=fill_tcp_data_p(buf,plen,PSTR(" [Syncing]")); 
@@ -597,7 +1036,7 @@ static uint16_t print_webpage_main(void)
 	plen=fill_tcp_data_p(buf,plen,PSTR("\n<b>Alarm:</b>\t\t"));
 	alarm_time_to_dispstr(gStrbuf);
 	plen=fill_tcp_data(buf,plen,gStrbuf);
-	if (alarm_enabled)
+	if (config.alarm_enabled)
 		plen=fill_tcp_data_p(buf,plen,PSTR(" [Enabled]"));
 	else
 		plen=fill_tcp_data_p(buf,plen,PSTR(" [Disabled]"));
@@ -641,57 +1080,93 @@ static uint8_t parse_mac(uint8_t *mac_byte_str,const char *str)
 	return(1);
 }
 
-// decodes a base64-encoded string
-static void base64_decode(char *str) {
-	char *out = str;
-	char stream[4];
-	while (strlen(str) >= 4) {
-		for (uint8_t i = 0; i < 4; ++i) {
-			if (*str >= 'A' && *str <= 'Z') {
-				stream[i] = *str - 'A';
-			}
-			else if (*str >= 'a' && *str <= 'z') {
-				stream[i] = *str - 'a' + 26;
-			}
-			else if (*str >= '0' && *str <= '9') {
-				stream[i] = *str - '0' + 52;
-			}
-			else if (*str == '+') {
-				stream[i] = 62;
-			}
-			else if (*str == '/') {
-				stream[i] = 63;
-			}
-			else if (*str == '=') {
-				stream[i] = 0;
-			}
-			++str;
-		}
-		*out++ = stream[0] << 2 | stream[1] >> 4;
-		*out++ = stream[1] << 4 | stream[2] >> 2;
-		*out++ = stream[2] << 6 | stream[3] >> 0;
+// compares n characters in a time that does not depend on where they differ
+static uint8_t auth_compare(const char *a, const char *b, uint8_t n) {
+	uint8_t d=0;
+	uint8_t i=0;
+
+	while (i<n) {
+		d|=a[i]^b[i];
+		i++;
 	}
-	*out = '\0';
+	return(d==0);
 }
 
 // verifies credentials in the given html header
 // returns 1 if credentials match, 0 otherwise
 static uint8_t check_authorization(char *str) {
 	char *auth_str,*pw_str;
+	char token[AUTH_TOKEN_SIZE+1];
+	uint8_t len=0;
+	uint8_t ok=0;
 	
-	if ((auth_str=strstr_P(str,PSTR("Authorization:")))){
+	if ((auth_str=strstr_P(str,PSTR("Authorization: Basic ")))){
 		auth_str+=21;
-		base64_decode(auth_str);
-		pw_str=strchr(auth_str,':');
-		*pw_str++='\0';
-		if (strncmp(password,pw_str,PASSWORD_SIZE)==0){
+		while (auth_str[len] && auth_str[len]!='\r' && auth_str[len]!=' ' && len<255) {
+			len++;
+		}
+		// the credentials that matched before need no decoding
+		if (len && len==auth_token_len && auth_compare(auth_str,auth_token,len)){
 			return(1);
 		}
+		if (len>AUTH_TOKEN_SIZE) return(0);
+		memcpy(token,auth_str,len);
+		token[len]='\0';
+		base64_decode(token);
+		if ((pw_str=strchr(token,':'))){
+			*pw_str++='\0';
+			if (strncmp(config.password,pw_str,PASSWORD_SIZE)==0){
+				memcpy(auth_token,auth_str,len);
+				auth_token_len=len;
+				ok=1;
+			}
+		}
 	}
-	return(0);
+	return(ok);
 }
 
 // analyze the url given
+// returns 1 if the browser has the current version of the file: its
+// If-None-Match has our ETag. No Last-Modified is sent, so If-Modified-Since
+// is not looked at.
+static uint8_t file_not_modified(char *str, struct static_file *f) {
+	char *s;
+	char *e;
+
+	if ((s=strstr_P(str,PSTR("\r\nIf-None-Match:")))) {
+		s+=16;
+		e=strchr(s,'\r');
+		print_etag(f);
+		s=strstr(s,gStrbuf);
+		return(s && (!e || s<e));
+	}
+	return(0);
+}
+
+// sends a file from flash or tells the browser to keep its copy
+static void reply_file(char *str, struct static_file *f, uint16_t (*header)(void)) {
+	if (file_not_modified(str,f)) {
+		dat_p=http304notmodified(f);
+	} else {
+		dat_p=(*header)();
+		webpage_file=f;
+	}
+}
+
+// keys of the query of the root web page
+const char PROGMEM get_keys[][KEY_VAL_KEY_SIZE]={"ac","pg"};
+
+static void get_key_val(uint8_t key, char *val) {
+	switch (key) {
+		case 0: // clear history
+			dht_log_clear();
+			break;
+		case 1: // page
+			form_page=atoi(val);
+			break;
+	}
+}
+
 static uint8_t analyse_get_url(char *str)
 {
 	if (str[0] == '/' && str[1] == ' '){
@@ -700,165 +1175,286 @@ static uint8_t analyse_get_url(char *str)
 		return(0);
 	}
 	if (str[0] == '/' && str[1] == '?'){
-		if (find_key_val_p(str,gStrbuf,STR_BUFFER_SIZE,PSTR("ac"))){
-			low_temp_t=high_temp_t=low_hum_t=high_hum_t=0;
-			low_hum=low_temp=127;
-			high_hum=high_temp=0;
-		}
-		if (find_key_val_p(str,gStrbuf,STR_BUFFER_SIZE,PSTR("pg"))){
-			urldecode(gStrbuf);
-			switch (atoi(gStrbuf)) {
-				case 1:
-					if (check_authorization(str)) {
-						dat_p=print_webpage_config();
-					} else {
-						dat_p=print_webpage_authfail();
-					}
-					return(0);
-				case 2:
-					dat_p=print_webpage_display();
-					return(0);
-				case 3:
-					dat_p=print_webpage_history();
-					return(0);
-				case 4:
-					dat_p=print_webpage_info();
-					return(0);
-				case 5:
-					if (check_authorization(str)) {
-						dat_p=print_webpage_password();
-					} else {
-						dat_p=print_webpage_authfail();
-					}
-					return(0);
-				case 6:
-					dat_p=print_webpage_alarm();
-					return(0);
-			}
+		form_page=0;
+		parse_key_vals(str+2,get_keys,sizeof(get_keys)/KEY_VAL_KEY_SIZE,get_key_val);
+		switch (form_page) {
+			case 1:
+				if (check_authorization(str)) {
+					dat_p=print_webpage_config();
+				} else {
+					dat_p=print_webpage_authfail();
+				}
+				return(0);
+			case 2:
+				dat_p=print_webpage_display();
+				return(0);
+			case 3:
+				history_snapshot();
+				webpage_stream=print_webpage_history;
+				return(0);
+			case 4:
+				info_snapshot();
+				webpage_stream=print_webpage_info;
+				return(0);
+			case 5:
+				if (check_authorization(str)) {
+					dat_p=print_webpage_password();
+				} else {
+					dat_p=print_webpage_authfail();
+				}
+				return(0);
+			case 6:
+				dat_p=print_webpage_alarm();
+				return(0);
 		}
 	}
 	if (strncmp_P(str,PSTR("/tz.js"),6)==0){
-		dat_p=print_tzjs();
+		reply_file(str,&tzjs_file,http200okjs);
 		return(0);
 	}
 	if (strncmp_P(str,PSTR("/s.css"),6)==0){
-		dat_p=print_s1css();
+		reply_file(str,&s1css_file,http200okcss);
+		return(0);
+	}
+	if (strncmp_P(str,PSTR("/h.csv"),6)==0){
+		history_snapshot();
+		webpage_stream=print_history_csv;
 		return(0);
 	}
 	dat_p=http404notfound();
 	return(0);
 }
 
-// analyze the body of the given html document
+// returns the check byte of a config, so an erased eeprom is not accepted
+static uint8_t config_sum(const struct config *c) {
+	const uint8_t *p=(const uint8_t *)c;
+	uint8_t sum=0xa5;
+	uint8_t i=0;
+
+	while (i<offsetof(struct config,sum)) {
+		sum=(sum<<1 | sum>>7)+p[i];
+		i++;
+	}
+	return(sum);
+}
+
+// queues the dirty fields for the background eeprom writer, the check byte
+// goes last. Fields that do not fit in the queue are queued on the next call.
+static void config_flush(void) {
+	uint8_t i=0;
+	uint8_t offset;
+
+	// only fields of a complete config are written
+	if (!(config_dirty & CONFIG_SUM)) return;
+	while (i<CONFIG_FIELDS) {
+		if (config_dirty & (1<<i)) {
+			offset=pgm_read_byte(&config_fields[i].offset);
+			if (!eewrite((uint8_t *)&nv_config+offset,(uint8_t *)&config+offset,pgm_read_byte(&config_fields[i].size))) return;
+			config_dirty&=~(1<<i);
+		}
+		i++;
+	}
+}
+
+// stores the config in eeprom, the unchanged bytes are not written
+static void config_save(void) {
+	config.sum=config_sum(&config);
+	config_dirty|=CONFIG_SUM;
+	config_flush();
+}
+
+// takes the config from the old eeprom blocks that are valid
+// returns 1 if there was one
+static uint8_t config_load_old(void) {
+	struct old_config o;
+	uint8_t found=0;
+
+	eeprom_read_block(&o,(const void *)OLD_CONFIG_ADDR,sizeof(o));
+	if (o.magic_config==0x55){
+		memcpy(config.mymac,o.mymac,6);
+		config.mins_offset_to_utc=o.mins_offset_to_utc;
+		config.enable_eu_dst=o.enable_eu_dst;
+		memcpy(config.ntphostname,o.ntphostname,HOSTNAME_SIZE);
+		config.ntp_update_period=o.ntp_update_period;
+		found=1;
+	}
+	if (o.magic_display==0xAA){
+		config.display_24hclock=o.display_24hclock;
+		config.display_temperature=o.display_temperature;
+		config.intensity=o.intensity;
+		found=1;
+	}
+	if (o.magic_password==0x33){
+		memcpy(config.password,o.password,PASSWORD_SIZE);
+		found=1;
+	}
+	if (o.magic_alarm==0xCC){
+		config.alarm_enabled=o.alarm_enabled;
+		config.alarm_hour=o.alarm_hour;
+		config.alarm_min=o.alarm_min;
+		found=1;
+	}
+	return(found);
+}
+
+// reads the config from eeprom. A config in the old layout is converted and
+// saved in the new one, the defaults are only kept if neither is valid.
+static void __attribute__((noinline)) config_load(void) {
+	struct config c;
+
+	eeprom_read_block(&c,&nv_config,sizeof(c));
+	if (c.sum == config_sum(&c)){
+		// ok check byte matches accept values
+		config=c;
+	}else if (config_load_old()){
+		config_dirty=CONFIG_MAC|CONFIG_ZONE|CONFIG_DST|CONFIG_HOSTNAME|CONFIG_PASSWORD|CONFIG_PERIOD|CONFIG_24H|CONFIG_TEMPERATURE|CONFIG_INTENSITY|CONFIG_ALARM;
+		config_save();
+	}
+	// make sure they are terminated, should not be necessary
+	config.ntphostname[HOSTNAME_SIZE]='\0';
+	config.password[PASSWORD_SIZE]='\0';
+}
+
+// keys of the forms, every form has a handler for its keys
+const char PROGMEM password_keys[][KEY_VAL_KEY_SIZE]={"pw"};
+
+static void password_key_val(uint8_t key, char *val) {
+	strncpy(config.password,val,PASSWORD_SIZE);
+	config.password[PASSWORD_SIZE]='\0';
+	config_dirty|=CONFIG_PASSWORD;
+	// the browser has to send the new password
+	auth_token_len=0;
+}
+
+const char PROGMEM alarm_keys[][KEY_VAL_KEY_SIZE]={"al","ti"};
+
+static void alarm_key_val(uint8_t key, char *val) {
+	switch (key) {
+		case 0: // enabled
+			config.alarm_enabled=1;
+			break;
+		case 1: // time
+			parse_alarm_time(val);
+			break;
+	}
+}
+
+const char PROGMEM display_keys[][KEY_VAL_KEY_SIZE]={"hh","te","in"};
+
+static void display_key_val(uint8_t key, char *val) {
+	switch (key) {
+		case 0: // 24 hour clock
+			config.display_24hclock=1;
+			break;
+		case 1: // temperature
+			config.display_temperature=1;
+			break;
+		case 2: // intensity
+			config.intensity=atoi(val);
+			hdlx2416_intensity(config.intensity);
+			break;
+	}
+}
+
+const char PROGMEM config_keys[][KEY_VAL_KEY_SIZE]={"ma","nt","up","st","tz"};
+
+static void config_key_val(uint8_t key, char *val) {
+	int16_t i;
+
+	switch (key) {
+		case 0: // mac address
+			if (parse_mac(config.mymac,val)!=0){
+				form_error=1;
+			}
+			break;
+		case 1: // ntp host name
+			if (strncmp(config.ntphostname,val,HOSTNAME_SIZE)!=0) form_restart=2;
+			strncpy(config.ntphostname,val,HOSTNAME_SIZE);
+			config.ntphostname[HOSTNAME_SIZE]='\0';
+			if (strlen(val)>HOSTNAME_SIZE) {
+				form_error=1;
+			}
+			break;
+		case 2: // update period
+			config.ntp_update_period=atoi(val);
+			break;
+		case 3: // eu dst
+			config.enable_eu_dst=1;
+			break;
+		case 4: // time zone
+			i=parse_offset(val);
+			if (i>=-720 && i<=840){
+				config.mins_offset_to_utc=i;
+				set_zone((int32_t)config.mins_offset_to_utc * 60);
+			}else{
+				form_error=1;
+			}
+			break;
+	}
+}
+
+// analyze the body of the given html document, returns 1 if the mac
+// address changed or 2 if only the ntp host name changed
 static uint8_t analyse_post_url(char *str) {
 	char *body;
-	int16_t i=0;
-	uint8_t updateerr=0;
+	struct config old;
 	
 	if ((body=strstr_P(str,PSTR("\r\n\r\n")))) {
 		body+=4;
-		uart_puts(body);
-		uart_puts_P("\r\n");
+		log_start_P(LOG_DEBUG,"");
+		log_puts(body);
+		log_end();
 		if (strncmp_P(str,PSTR("/pu"),3)==0){
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("pw"))){
-				urldecode(gStrbuf);
-				strncpy(password,gStrbuf,PASSWORD_SIZE);
-				password[PASSWORD_SIZE]='\0';
-				// store in eeprom:
-				eeprom_write_byte(&nv_magic_number_password,0x33); // magic number
-				eeprom_write_block(&password,&nv_password,sizeof(password));
-			}
+			parse_key_vals(body,password_keys,sizeof(password_keys)/KEY_VAL_KEY_SIZE,password_key_val);
+			config_save();
 			dat_p=http302moved();
 			return(0);
 		}
 		if (strncmp_P(str,PSTR("/au"),3)==0){
-			alarm_enabled=0;
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("al"))){
-				alarm_enabled=1;
-			}
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("ti"))){
-				urldecode(gStrbuf);
-				parse_alarm_time(gStrbuf);
-			}
-			// store in eeprom:
-			eeprom_write_byte(&nv_magic_number_alarm,0xCC); // magic number
-			eeprom_write_byte(&nv_alarm_enabled,alarm_enabled);
-			eeprom_write_byte(&nv_alarm_hour,alarm_hour);
-			eeprom_write_byte(&nv_alarm_min,alarm_min);
+			config.alarm_enabled=0;
+			parse_key_vals(body,alarm_keys,sizeof(alarm_keys)/KEY_VAL_KEY_SIZE,alarm_key_val);
+			config_dirty|=CONFIG_ALARM;
+			config_save();
 			dat_p=http302moved();
 			return(0);
 		}
 		if (strncmp_P(str,PSTR("/du"),3)==0){
-			display_24hclock=0;
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("hh"))){
-				display_24hclock=1;
-			}
-			display_temperature=0;
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("te"))){
-				display_temperature=1;
-			}
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("in"))){
-				urldecode(gStrbuf);
-				intensity=atoi(gStrbuf);
-				hdlx2416_intensity(intensity);
-			}
-			// store in eeprom:
-			eeprom_write_byte(&nv_magic_number_display,0xAA); // magic number
-			eeprom_write_byte(&nv_display_24hclock,display_24hclock);
-			eeprom_write_byte(&nv_display_temperature,display_temperature);
-			eeprom_write_byte(&nv_intensity,intensity);
+			config.display_24hclock=0;
+			config.display_temperature=0;
+			parse_key_vals(body,display_keys,sizeof(display_keys)/KEY_VAL_KEY_SIZE,display_key_val);
+			config_dirty|=CONFIG_24H|CONFIG_TEMPERATURE|CONFIG_INTENSITY;
+			config_save();
 			dat_p=http302moved();
 			return(0);
 		}
 		if (strncmp_P(str,PSTR("/cu"),3)==0){
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("ma"))){
-				urldecode(gStrbuf);
-				if (parse_mac(mymac,gStrbuf)!=0){
-					updateerr=1;
-				}
-			}
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("nt"))){
-				urldecode(gStrbuf);
-				strncpy(ntphostname, gStrbuf,HOSTNAME_SIZE);
-				ntphostname[HOSTNAME_SIZE]='\0';
-				if (strlen(gStrbuf)>HOSTNAME_SIZE) {
-					updateerr=1;
-				}
-			}
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("up"))){
-				urldecode(gStrbuf);
-				ntp_update_period=atoi(gStrbuf);
-			}
-			enable_eu_dst=0;
-			set_dst(NULL);
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("st"))){
-				enable_eu_dst=1;
-				set_dst(eu_dst);
-			}
-			if (find_key_val_p(body,gStrbuf,STR_BUFFER_SIZE,PSTR("tz"))){
-				urldecode(gStrbuf);
-				i=parse_offset(gStrbuf);
-				if (i>=-720 && i<=840){
-					mins_offset_to_utc=i;
-					set_zone((int32_t)mins_offset_to_utc * 60);
-					}else{
-					updateerr=1;
-				}
-			}
-			if (updateerr){
+			// nothing of a rejected form is kept
+			old=config;
+			form_error=0;
+			form_restart=0;
+			config.enable_eu_dst=0;
+			parse_key_vals(body,config_keys,sizeof(config_keys)/KEY_VAL_KEY_SIZE,config_key_val);
+			if (form_error){
+				config=old;
+				set_zone((int32_t)config.mins_offset_to_utc * 60);
+				clock_localtime_invalidate();
 				dat_p=print_webpage_error();
 				return(0);
 			}
-			// store in eeprom:
-			eeprom_write_byte(&nv_magic_number_config,0x55); // magic number
-			eeprom_write_block(&ntpip,&nv_ntpip,sizeof(ntpip));
-			eeprom_write_byte(&nv_enable_eu_dst,enable_eu_dst);
-			eeprom_write_word(&nv_mins_offset_to_utc,mins_offset_to_utc);
-			eeprom_write_block(&ntphostname,&nv_ntphostname,sizeof(ntphostname));
-			eeprom_write_block(&mymac,&nv_mymac,sizeof(mymac));
-			eeprom_write_word(&nv_ntp_update_period,ntp_update_period);
+			if (config.enable_eu_dst) {
+				clock_set_dst(eu_dst,eu_dst_next);
+			} else {
+				clock_set_dst(NULL,NULL);
+			}
+			if (ntp_poll>config.ntp_update_period) {
+				ntp_poll=config.ntp_update_period;
+				ntp_next_t=start_t+ntp_poll;
+			}
+			config_dirty|=CONFIG_MAC|CONFIG_ZONE|CONFIG_DST|CONFIG_HOSTNAME|CONFIG_PERIOD;
+			config_save();
 			dat_p=print_webpage_ok();
-			return(1);
+			if (memcmp(old.mymac,config.mymac,6)!=0) form_restart=1;
+			return(form_restart);
 		}
 	}
 	dat_p=http500interr();
@@ -867,62 +1463,96 @@ static uint8_t analyse_post_url(char *str) {
 
 // prints timestamp with offset to utc to uart
 static void print_time_to_uart(void) {
-	time_t now;
-	struct tm *ts;
+	log_start_P(LOG_INFO,"Time ");
+	asctime_r(clock_localtime(), gStrbuf);
+	log_puts(gStrbuf);
+	log_puts_P(" (UTC");
+	offset_to_dispstr(config.mins_offset_to_utc,gStrbuf);
+	log_puts(gStrbuf);
+	log_putc(')');
+	log_end();
+}
 
-	time(&now);
-	ts = localtime(&now);
-	asctime_r(ts, gStrbuf);
-	uart_puts(gStrbuf);
-	uart_puts_P(" (UTC");
-	offset_to_dispstr(mins_offset_to_utc,gStrbuf);
-	uart_puts(gStrbuf);
-	uart_puts_P(")\r\n");
+// prints the cycle counts of the main loop phases to uart
+static void print_prof_to_uart(void) {
+	uint32_t min,avg,max;
+	uint8_t i=0;
+
+	while(i<PROF_PHASES){
+		if (prof_get(i,&min,&avg,&max)) {
+			log_start_p(LOG_INFO,prof_get_name_p(i));
+			log_puts_P(" min=");
+			log_number(min);
+			log_puts_P(" avg=");
+			log_number(avg);
+			log_puts_P(" max=");
+			log_number(max);
+			log_puts_P(" cycles");
+			log_end();
+		}
+		i++;
+	}
 }
 
 // prints ip, netmask and dns to uart
 static void print_ip_to_uart(void) {
-	mk_net_str(gStrbuf,myip,4,'.',10);
-	uart_puts_P("Got IP:");
-	uart_puts(gStrbuf);
-	uart_putc('/');
-	itoa(get_netmask_length(netmask),gStrbuf,10);
-	uart_puts(gStrbuf);
-	uart_puts_P("\r\n");
-	mk_net_str(gStrbuf,mydns,4,'.',10);
-	uart_puts_P("DNS IP:");
-	uart_puts(gStrbuf);
-	uart_puts_P("\r\n");
+	log_start_P(LOG_INFO,"Got IP:");
+	log_ip(myip);
+	log_putc('/');
+	log_number(get_netmask_length(netmask));
+	log_end();
+	log_start_P(LOG_INFO,"DNS IP:");
+	log_ip(mydns);
+	log_end();
 }
 
 // prints enc28j60 silicon revision to uart
 static void print_rev_to_uart(void) {
-	itoa(enc28j60getrev(),gStrbuf,10);
-	uart_puts_P("ENC28J60 Rev B");
-	uart_puts(gStrbuf);
-	uart_puts_P("\r\n");	
+	log_start_P(LOG_INFO,"ENC28J60 Rev B");
+	log_number(enc28j60getrev());
+	log_end();
+}
+
+// renders a number with two digits at least at pos of the frame buffer,
+// returns the position after it
+static uint8_t render_number(uint8_t pos, int16_t n, uint8_t zero) {
+	if (n<0){
+		display_fb[pos++]='-';
+		n=-n;
+	}
+	if (n>99){
+		display_fb[pos++]='0'+n/100;
+		n%=100;
+		zero=1;
+	}
+	if (n>9 || zero){
+		display_fb[pos++]='0'+n/10;
+	}
+	display_fb[pos++]='0'+n%10;
+	return(pos);
 }
 
 // prints temperature and humidity to display
 static void print_dht_to_display(void) {
-	hdlx2416_goto(0);
-	itoa(temperature,gStrbuf,10);
-	hdlx2416_puts(gStrbuf);
-	hdlx2416_puts_P("'C ");
-	itoa(humidity,gStrbuf,10);
-	hdlx2416_puts(gStrbuf);
-	hdlx2416_putc('%');
+	uint8_t pos;
+
+	pos=render_number(0,temperature,0);
+	display_fb[pos++]='\'';
+	display_fb[pos++]='C';
+	display_fb[pos++]=' ';
+	pos=render_number(pos,humidity,0);
+	display_fb[pos++]='%';
+	while(pos<8) display_fb[pos++]=' ';
+	hdlx2416_flush(display_fb);
 }
 
 // sounds buzzer when alarm goes off and checks if the ntp update period has passed
 static void check_alarm_and_ntp_period(void) {
-	time_t now;
-	struct tm *ts;
+	const struct tm *ts;
 	
-	time(&now);
-	ts = localtime(&now);
+	ts = clock_localtime();
 	// check alarm
-	if (alarm_enabled && ts->tm_sec < 10 && ts->tm_hour == alarm_hour && ts->tm_min == alarm_min) {
+	if (config.alarm_enabled && ts->tm_sec < 10 && ts->tm_hour == config.alarm_hour && ts->tm_min == config.alarm_min) {
 		if (ts->tm_sec % 2 == 0)
 			buzzer_on();
 		else
@@ -931,54 +1561,105 @@ static void check_alarm_and_ntp_period(void) {
 		buzzer_off();
 	}
 	// check for ntp update
-	if (difftime(now, start_t)>ntp_update_period && ntp_state==1){
+	if (ntp_state==1 && (int32_t)(time(NULL)-ntp_next_t)>=0){
 		// mark that we will wait for new ntp update
 		ntp_state=2;
 		ntp_retry_count=0;
+		ntp_burst_count=0;
+		sched_wake(init_task,0);
 	}
 }
 
 // prints timestamp to display
 static void print_time_to_display(void)
 {
-	time_t now;
-	struct tm *ts;
+	const struct tm *ts;
 	uint8_t hour;
 
-	time(&now);
-	ts = localtime(&now);
-	hdlx2416_goto(0);
+	ts = clock_localtime();
 	hour = ts->tm_hour;
-	if (display_24hclock == 0 && hour > 12) {
+	if (config.display_24hclock == 0 && hour > 12) {
 		hour -= 12;
 	}
-	zero_two_d(gStrbuf,hour);
-	hdlx2416_puts(gStrbuf);
+	render_number(0,hour,1);
 	// blink colon
-	if (display_24hclock == 0 && ts->tm_sec % 2) {
-		hdlx2416_putc(' ');
+	if (config.display_24hclock == 0 && ts->tm_sec % 2) {
+		display_fb[2] = ' ';
 	} else {
-		hdlx2416_putc(':');
+		display_fb[2] = ':';
 	}
-	zero_two_d(gStrbuf,ts->tm_min);
-	hdlx2416_puts(gStrbuf);
-	if (display_24hclock==0) {
-		if (ts->tm_hour < 12) {
-			hdlx2416_puts_P("am ");
-		} else {
-			hdlx2416_puts_P("pm ");
-		}
+	render_number(3,ts->tm_min,1);
+	if (config.display_24hclock==0) {
+		display_fb[5] = (ts->tm_hour < 12) ? 'a' : 'p';
+		display_fb[6] = 'm';
+		display_fb[7] = ' ';
 	} else {
-		hdlx2416_putc(':');
-		zero_two_d(gStrbuf,ts->tm_sec);
-		hdlx2416_puts(gStrbuf);
+		display_fb[5] = ':';
+		render_number(6,ts->tm_sec,1);
+	}
+	// usually only the last digit is written
+	hdlx2416_flush(display_fb);
+}
+
+// check byte of the time kept over a reset
+static uint8_t warm_time_sum(time_t t) {
+	return(~((uint8_t)t+(uint8_t)(t>>8)+(uint8_t)(t>>16)+(uint8_t)(t>>24)));
+}
+
+// keeps the time for a reset and writes a snapshot to eeprom every
+// NVSTATE_INTERVAL seconds
+static void save_state(void) {
+	struct nvstate s;
+	time_t t=time(NULL);
+
+	warm_time.t=t;
+	warm_time.sum=warm_time_sum(t);
+	if (nvstate_t && t>=nvstate_t && t-nvstate_t<NVSTATE_INTERVAL) return;
+	s.t=t;
+	s.freq=clock_get_freq();
+	s.temperature=temperature;
+	s.humidity=humidity;
+	s.flags=(dht_valid) ? NVSTATE_DHT : 0;
+	if (nvstate_write(&s)) nvstate_t=t;
+}
+
+// restores the history and the frequency correction from eeprom and,
+// unless at power-on, the time
+static void restore_state(void) {
+	struct nvstate s;
+	uint8_t n=0;
+	time_t t=0;
+
+	nvstate_init();
+	while (nvstate_read(n,&s)) {
+		if (s.flags & NVSTATE_DHT) dht_log_add(s.t,s.temperature,s.humidity);
+		n++;
+	}
+	if (!(mcusr_mirror & (1<<PORF))) {
+		// the time in ram is at most a second behind, the snapshot
+		// up to NVSTATE_INTERVAL
+		if (warm_time.sum==warm_time_sum(warm_time.t)) {
+			t=warm_time.t;
+		} else if (n) {
+			t=s.t;
+		}
+	}
+	if (n==0 && t==0) return;
+	clock_restore(t,(n) ? s.freq : 0);
+	if (t) {
+		set_zone((int32_t)config.mins_offset_to_utc * 60);
+		ntp_state=2; // shown until the next update
+		log_P(LOG_INFO,"Time restored");
 	}
 }
 
-// interrupt, step seconds counter
-ISR(TIMER1_COMPA_vect){
-	system_tick();
+// executed from the clock interrupt every second
+static void second_tick(void){
 	dhcp_tick();
+	www_server_tick();
+#ifdef ENC28J60_INT
+	enc28j60RxPoll();
+#endif
 	uptime_sec++;
 	if (uptime_sec>59) {
 		uptime_sec=0;
@@ -992,364 +1673,682 @@ ISR(TIMER1_COMPA_vect){
 		uptime_hour=0;
 		uptime_day++;
 	}
-	if (delay_sec) delay_sec--;
-	if (dht_delay_sec) dht_delay_sec--;
 	display_update_pending=1;
+	sched_wake(display_task,0);
 }
 
-// Generate a 1s clock signal as interrupt
-static void timer_init(void)
-{
-	/* write high byte first for 16 bit register access: */
-	TCNT1H=0;  /* set counter to zero*/
-	TCNT1L=0;
-	// Mode 4 table 14-4 page 132. CTC mode and top in OCR1A
-	// WGM13=0, WGM12=1, WGM11=0, WGM10=0
-	TCCR1A=(0<<COM1B1)|(0<<COM1B0)|(0<<WGM11);
-	TCCR1B=(1<<CS12)|(1<<CS10)|(1<<WGM12)|(0<<WGM13); // crystal clock/1024
-
-	// divide crystal clock:
-	// At what value to cause interrupt. Since we count from zero we have to subtract one.
-	OCR1AH = ((F_CPU / 1024) >> 8) & 0x00FF;
-	OCR1AL = ((F_CPU / 1024) & 0x00FF) - 1;
-	// interrupt mask bit:
-	TIMSK1 = (1 << OCIE1A);
+// the init task may go on after ms milliseconds, 0 wakes it at once
+static void init_delay(uint16_t ms) {
+	init_deadline=clock_get_ms()+ms;
+	sched_wake(init_task,ms);
+}
+
+// returns 1 if the delay of the init task has passed
+static uint8_t init_delay_passed(void) {
+	return((int32_t)(clock_get_ms()-init_deadline)>=0);
+}
+
+// warm restart: the start up is redone from state on, the lease, the caches
+// and the time are kept. A start up that did not get that far goes on.
+static void init_restart(int8_t state) {
+	if (init_state>state) init_state=state;
+	init_delay(0);
 }
 
 // prints message to uart when pinged
 static void ping_callback(uint8_t __attribute__((unused)) *srcip) {
-	uart_puts_P("ICMP request\r\n");
+	log_P(LOG_DEBUG,"ICMP request");
 }
 
-// gets called whenever an arp is resolved
-static void arpresolver_result_callback(uint8_t *ip,uint8_t reference_number,uint8_t *mac){
-	mk_net_str(gStrbuf,ip,4,'.',10);
-	uart_puts(gStrbuf);
-	uart_puts_P(" is at ");
-	mk_net_str(gStrbuf,mac,6,':',16);
-	uart_puts(gStrbuf);
-	uart_puts_P("\r\n");
-	if (reference_number==TRANS_NUM_NTPMAC){
-		// copy mac address over:
-		memcpy(ntproutingmac,mac,sizeof(ntproutingmac));
-		delay_sec=0;
-		have_ntp_mac=1;
-	}
-	if (reference_number==TRANS_NUM_DNSMAC){
-		// copy mac address over:
-		memcpy(dnsroutingmac,mac,sizeof(dnsroutingmac));
-		delay_sec=0;
-		have_dns_mac=1;
+// returns the ip of the host on the LAN that packets to ip are sent to
+static uint8_t *next_hop(uint8_t *ip) {
+	return((route_via_gw(ip)) ? gwip : ip);
+}
+
+// copies the mac of the next hop to ip from the arp cache, prints it if it
+// changed. returns 0 if it is not resolved yet
+static uint8_t arpresolver_mac(uint8_t *ip, uint8_t *mac) {
+	uint8_t *m=arp_cache_lookup(next_hop(ip));
+
+	if (m==NULL) return(0);
+	if (memcmp(mac,m,6)!=0){
+		memcpy(mac,m,6);
+		log_start_P(LOG_INFO,"");
+		log_ip(next_hop(ip));
+		log_puts_P(" is at ");
+		log_mac(mac);
+		log_end();
 	}
+	return(1);
 }
 
-// starts arp process for dns and/or ntp mac if not yet resolved
-// returns 1 if arp sent, 0 otherwise
+// gets the dns and ntp mac from the arp cache, which resolves them in the
+// packet loop at the same time. returns 1 if one is not resolved yet
 static uint8_t arpresolver(void) {
-	if (!have_dns_mac) {
-		get_mac_with_arp((route_via_gw(mydns)) ? gwip : mydns, TRANS_NUM_DNSMAC, &arpresolver_result_callback);
-		return 1;
+	have_dns_mac=arpresolver_mac(mydns,dnsroutingmac);
+	have_ntp_mac=arpresolver_mac(ntpip,ntproutingmac);
+	return(!have_dns_mac || !have_ntp_mac);
+}
+
+// prints a time difference in milliseconds to uart
+static void print_ms_to_uart(int32_t d) {
+	log_number(clock_to_ms(d));
+	log_puts_P("ms");
+}
+
+// prints ntp server ip to uart
+static void print_ntp_ip_to_uart(uint8_t *ip) {
+	log_start_P(LOG_INFO,"NTP IP:");
+	log_ip(ip);
+	log_end();
+}
+
+// takes the ntp servers from the dns answer and schedules its refresh
+static void dns_use_answer(void) {
+	uint8_t i;
+	uint8_t ip[4];
+	uint32_t ttl;
+
+	ttl=dnslkup_get_ttl();
+	log_start_P(LOG_INFO,"DNS TTL=");
+	log_number(ttl);
+	log_end();
+	if (ttl<DNS_MIN_TTL) ttl=DNS_MIN_TTL;
+	if (ttl>DNS_MAX_TTL) ttl=DNS_MAX_TTL;
+	dns_refresh=clock_get_ms()+ttl*750-jitter_below(ttl*125);
+	dnslkup_get_ip(ip);
+	if (dns_cached && memcmp(ip,ntpip,4)==0){
+		// same first server, the samples are kept
+		return;
 	}
-	if (!have_ntp_mac) {
-		get_mac_with_arp((route_via_gw(ntpip)) ? gwip : ntpip, TRANS_NUM_NTPMAC, &arpresolver_result_callback);
-		return 1;
+	dns_cached=1;
+	memcpy(ntpip,ip,4);
+	ntp_client_init();
+	ntp_client_add_server(ntpip);
+	print_ntp_ip_to_uart(ntpip);
+	// more servers of the answer if they route via the
+	// gateway like the first, the ntp mac is shared
+	i=1;
+	while (i<dnslkup_get_ip_count()){
+		dnslkup_get_ip_n(i,ip);
+		if (route_via_gw(ip) && route_via_gw(ntpip) && ntp_client_add_server(ip)){
+			print_ntp_ip_to_uart(ip);
+		}
+		i++;
 	}
-	return 0;
 }
 
 // NTP protocol handling
 static void udp_client_check_for_ntp_answer(uint8_t *buf,uint16_t plen) {
 	// check if ip packets are for us:
 	if(eth_type_is_ip_and_my_ip(buf,plen)){
-		if (client_ntp_process_answer(buf,&start_t,ntpclientportL)){
+		if (ntp_client_process_answer(buf)==2){
+			// the clock was never set, it is set from the first answer
+			// and refined when all requests of this update are done
 			display_update_pending=0;
-			start_t -= NTP_OFFSET;
-			set_system_time(start_t);
-			set_zone((int32_t)mins_offset_to_utc * 60);
-			print_time_to_uart();
-			ntp_state=1;
-			ntp_retry_count=0;
+			set_zone((int32_t)config.mins_offset_to_utc * 60);
+			clock_localtime_invalidate();
+			log_P(LOG_INFO,"NTP time set");
+			if (ntp_state==0) ntp_state=2;
 		}
 	}
 }
 
-// save min and max values and record time stamps
-static void save_min_max_temp(void) {
-	if (temperature>high_temp){
-		high_temp=temperature;
-		time(&high_temp_t);
-	}
-	if (temperature<low_temp){
-		low_temp=temperature;
-		time(&low_temp_t);
-	}
-	if (humidity>high_hum){
-		high_hum=humidity;
-		time(&high_hum_t);
+// writes a 32 bit number in network byte order to the udp send buffer
+static uint8_t fill_udp_data_u32(uint8_t pos, uint32_t n) {
+	buf[UDP_DATA_P+pos++]=n>>24;
+	buf[UDP_DATA_P+pos++]=n>>16;
+	buf[UDP_DATA_P+pos++]=n>>8;
+	buf[UDP_DATA_P+pos++]=n;
+	return(pos);
+}
+
+// writes a 16 bit number in network byte order to the udp send buffer
+static uint8_t fill_udp_data_u16(uint8_t pos, uint16_t n) {
+	buf[UDP_DATA_P+pos++]=n>>8;
+	buf[UDP_DATA_P+pos++]=n;
+	return(pos);
+}
+
+// writes a time stamp as unix time to the udp send buffer, 0 stays 0
+static uint8_t fill_udp_data_time(uint8_t pos, time_t t) {
+	return(fill_udp_data_u32(pos,(t) ? t+UNIX_OFFSET : 0));
+}
+
+// answers a query to the status port with one packet of fixed layout. A
+// query is a datagram whose first byte is STATUS_QUERY, datagrams from the
+// status port are dropped so that two clocks never answer each other.
+// All numbers in network byte order:
+//  0 version, ntp state, reset reason (MCUSR), dhcp state
+//  4 uptime in seconds
+//  8 current time, 12 time of last ntp update (unix time)
+// 16 offset and 20 delay of last ntp update in 1/65536 seconds
+// 24 frequency correction in ppb
+// 28 dhcp lease time in seconds, 32 dhcp server ip, 36 ntp server ip
+// 40 temperature, humidity, lowest and highest temperature and
+//    humidity of the history (signed bytes)
+// 46 time stamps of lowest and highest temperature and humidity
+// 62 received, 66 skipped and 70 sent packets
+// 74 bad received packets, hung and aborted transmissions, ARP retries,
+//    DNS errors, NTP failures, DHCP changes, DHT errors and DHT checksum
+//    errors (16 bits)
+// 92 end
+static void udp_server_check_for_status_query(uint8_t *buf,uint16_t plen) {
+	uint8_t pos;
+	uint8_t *peer;
+	uint32_t leasetime;
+	struct dht_log_stat stat;
+
+	if (!eth_type_is_ip_and_my_ip(buf,plen) || buf[IP_PROTO_P]!=IP_PROTO_UDP_V)
+		return;
+	if (buf[UDP_DST_PORT_H_P]!=(STATUS_PORT>>8) || buf[UDP_DST_PORT_L_P]!=(STATUS_PORT & 0xff))
+		return;
+	if (buf[UDP_SRC_PORT_H_P]==(STATUS_PORT>>8) && buf[UDP_SRC_PORT_L_P]==(STATUS_PORT & 0xff))
+		return;
+	// a status packet is never a query
+	if (plen<=UDP_DATA_P || (buf[UDP_LEN_H_P]==0 && buf[UDP_LEN_L_P]<=UDP_HEADER_LEN) || buf[UDP_DATA_P]!=STATUS_QUERY)
+		return;
+	buf[UDP_DATA_P]=STATUS_VERSION;
+	buf[UDP_DATA_P+1]=ntp_state;
+	buf[UDP_DATA_P+2]=mcusr_mirror;
+	buf[UDP_DATA_P+3]=dhcp_get_info(&buf[UDP_DATA_P+32],&leasetime);
+	pos=fill_udp_data_u32(4,get_uptime());
+	pos=fill_udp_data_time(pos,time(NULL));
+	pos=fill_udp_data_time(pos,start_t);
+	pos=fill_udp_data_u32(pos,ntp_offset);
+	pos=fill_udp_data_u32(pos,ntp_delay);
+	pos=fill_udp_data_u32(pos,clock_get_drift());
+	pos=fill_udp_data_u32(pos,leasetime)+4;
+	peer=ntp_client_get_peer();
+	memcpy(&buf[UDP_DATA_P+pos],(peer) ? peer : ntpip,4);
+	pos+=4;
+	buf[UDP_DATA_P+pos++]=temperature;
+	buf[UDP_DATA_P+pos++]=humidity;
+	dht_log_get_stat(&stat);
+	buf[UDP_DATA_P+pos++]=stat.low_temp;
+	buf[UDP_DATA_P+pos++]=stat.high_temp;
+	buf[UDP_DATA_P+pos++]=stat.low_hum;
+	buf[UDP_DATA_P+pos++]=stat.high_hum;
+	pos=fill_udp_data_time(pos,stat.low_temp_t);
+	pos=fill_udp_data_time(pos,stat.high_temp_t);
+	pos=fill_udp_data_time(pos,stat.low_hum_t);
+	pos=fill_udp_data_time(pos,stat.high_hum_t);
+	pos=fill_udp_data_u32(pos,stats.rx_packets);
+	pos=fill_udp_data_u32(pos,stats.rx_rejected);
+	pos=fill_udp_data_u32(pos,stats.tx_packets);
+	pos=fill_udp_data_u16(pos,stats.rx_errors);
+	pos=fill_udp_data_u16(pos,stats.tx_timeouts);
+	pos=fill_udp_data_u16(pos,stats.tx_errors);
+	pos=fill_udp_data_u16(pos,stats.arp_retries);
+	pos=fill_udp_data_u16(pos,stats.dns_errors);
+	pos=fill_udp_data_u16(pos,stats.ntp_fails);
+	pos=fill_udp_data_u16(pos,stats.dhcp_changes);
+	pos=fill_udp_data_u16(pos,stats.dht_errors);
+	pos=fill_udp_data_u16(pos,stats.dht_checksum_errors);
+	make_udp_reply_from_request_udpdat_ready(buf,pos,STATUS_PORT);
+}
+
+// adapts the poll interval to the offset and the jitter of an update and
+// schedules the next update
+static void ntp_adapt_poll(int32_t offset, int32_t jitter) {
+	uint16_t max=config.ntp_update_period;
+	uint16_t min=(max<NTP_MIN_POLL) ? max : NTP_MIN_POLL;
+
+	offset=labs(offset);
+	if (offset>4*NTP_POLL_OFFSET || jitter>4*NTP_POLL_OFFSET) {
+		ntp_poll/=2;
+		ntp_stable=0;
+	} else if (offset<NTP_POLL_OFFSET && jitter<NTP_POLL_OFFSET) {
+		if (++ntp_stable>=NTP_POLL_STABLE) {
+			ntp_stable=0;
+			ntp_poll=(ntp_poll>max/2) ? max : ntp_poll*2;
+		}
+	} else {
+		ntp_stable=0;
 	}
-	if (humidity<low_hum){
-		low_hum=humidity;
-		time(&low_hum_t);
+	if (ntp_poll<min) ntp_poll=min;
+	if (ntp_poll>max) ntp_poll=max;
+	// a little earlier, so clocks that started together drift apart
+	ntp_next_t=start_t+ntp_poll-jitter_below(ntp_poll/16+1);
+}
+
+// returns the time until the next try of a failed update, doubled for every
+// retry of the update and chosen at random from its second half
+static uint32_t ntp_retry_delay(void) {
+	uint32_t d=(uint32_t)NTP_RETRY_MS<<ntp_retry_count;
+
+	return(d/2+jitter_below(d/2));
+}
+
+// selects a server from the answers and corrects the clock
+// returns 1 if successful or 0 otherwise
+static uint8_t ntp_update(void) {
+	uint8_t ip[4];
+	int32_t offset;
+	int32_t delay;
+	int32_t jitter;
+	uint8_t n;
+
+	if (!(n=ntp_client_update(ip,&offset,&delay,&jitter))){
+		log_P(LOG_ERROR,"NTP no server selected");
+		STATS_INC(ntp_fails);
+		return(0);
 	}
+	display_update_pending=0;
+	log_start_P(LOG_INFO,"NTP peer=");
+	log_ip(ip);
+	log_puts_P(" offset=");
+	print_ms_to_uart(offset);
+	log_puts_P(" delay=");
+	print_ms_to_uart(delay);
+	log_puts_P(" agree=");
+	log_number(n);
+	log_puts_P(" drift=");
+	log_number(clock_get_drift());
+	log_puts_P("ppb");
+	log_end();
+	ntp_offset=offset;
+	ntp_delay=delay;
+	time(&start_t);
+	ntp_adapt_poll(offset,jitter);
+	log_start_P(LOG_INFO,"NTP jitter=");
+	print_ms_to_uart(jitter);
+	log_puts_P(" poll=");
+	log_number(ntp_poll);
+	log_puts_P("s");
+	log_end();
+	set_zone((int32_t)config.mins_offset_to_utc * 60);
+	clock_localtime_invalidate();
+	print_time_to_uart();
+	print_prof_to_uart();
+	return(1);
 }
 
-// main loop
-int main(void){
-	uint8_t i;
-	uint16_t plen=0;
-	uint8_t link_status=0;
-	uint8_t display_sec=0;
-	uint8_t scroll_index=0;
-	uint8_t show_ip=0;
-	uint8_t arp_retry_count=0;
-	uint8_t dns_retry_count=0;
+// receives a packet and answers it
+static void net_run(void) {
+	uint16_t plen;
 	uint8_t *s;
-	uint8_t dhcp_status=0;
-	
-	if (eeprom_read_byte(&nv_magic_number_config) == 0x55){
-		// ok magic number matches accept values
-		eeprom_read_block(&ntpip,&nv_ntpip,sizeof(ntpip));
-		enable_eu_dst=eeprom_read_byte(&nv_enable_eu_dst);
-		mins_offset_to_utc=eeprom_read_word(&nv_mins_offset_to_utc);
-		eeprom_read_block(&ntphostname, &nv_ntphostname, sizeof(ntphostname));
-		eeprom_read_block(&mymac, &nv_mymac, sizeof(mymac));
-		ntp_update_period=eeprom_read_word(&nv_ntp_update_period);
-	}
-	if (eeprom_read_byte(&nv_magic_number_display) == 0xAA){
-		display_24hclock=eeprom_read_byte(&nv_display_24hclock);
-		display_temperature=eeprom_read_byte(&nv_display_temperature);
-		intensity=eeprom_read_byte(&nv_intensity);
-	}
-	if (eeprom_read_byte(&nv_magic_number_password) == 0x33){
-		eeprom_read_block(&password,&nv_password,sizeof(password));
-		password[PASSWORD_SIZE]='\0'; // make sure it is terminated, should not be necessary
-	}
-	if (eeprom_read_byte(&nv_magic_number_alarm) == 0xCC){
-		alarm_enabled=eeprom_read_byte(&nv_alarm_enabled);
-		alarm_hour=eeprom_read_byte(&nv_alarm_hour);
-		alarm_min=eeprom_read_byte(&nv_alarm_min);
-	}
-	uart_init(UART_BAUD_SELECT(9600, F_CPU));
-	buzzer_init();
-	hdlx2416_init();
-	hdlx2416_intensity(intensity);
-	hdlx2416_puts_P("NTPclock");
-	enc28j60Init(mymac);
-	print_rev_to_uart();
-	init_mac(mymac);
-	if (enable_eu_dst) {
-		set_dst(eu_dst);
+
+	prof_begin();
+	plen=enc28j60PacketReceive(BUFFER_SIZE, buf);
+	buf[BUFFER_SIZE]='\0'; // HTTP is an ASCII protocol. Make sure we have a string terminator.
+	// empty polls are not counted
+	if (plen) prof_end(PROF_RX); else prof_stop();
+#ifdef ENC28J60_INT
+	sched_wake(net_task,(plen) ? 0 : NET_POLL_MS);
+#else
+	// NTP answers are time stamped when found, the buffer is polled without
+	// sleep from the requests until they are answered or late
+	sched_wake(net_task,(plen || (ntp_client_waiting() && (int32_t)(net_ntp_wait-clock_get_ms())>0)) ? 0 : NET_POLL_MS);
+#endif
+	// DHCP handling. Get the initial IP
+	prof_begin();
+	if (init_state==1 && packetloop_dhcp_initial_ip_assignment(buf,plen)) {
+		// we have an IP:
+		init_state=2;
+		dhcp_get_my_ip(myip,netmask,gwip,mydns);
+		init_dnslkup(mydns);
+		client_ifconfig(myip,netmask);
+		// show the ip for 30 seconds unless the time is known
+		show_ip=(ntp_state) ? 0 : 30;
+		scroll_index=0;
+		mk_net_str(scroll_text,myip,4,'.',10);
+		scroll_len=strlen(scroll_text);
+		strcat_P(scroll_text,PSTR("        "));
+		prof_end(PROF_DHCP);
+		print_ip_to_uart();
+		sched_wake(init_task,0);
+		return;
 	}
-	register_ping_rec_callback(ping_callback);
-	timer_init();
-	wdt_enable(WDTO_250MS); // dht read out takes about 220 ms
-	sei(); // interrupt on, clock starts ticking now
-	while(1){
-		plen=enc28j60PacketReceive(BUFFER_SIZE, buf);
-		buf[BUFFER_SIZE]='\0'; // HTTP is an ASCII protocol. Make sure we have a string terminator.
-		// DHCP handling. Get the initial IP
-		if (init_state==1 && packetloop_dhcp_initial_ip_assignment(buf,plen)) {
-			// we have an IP:
-			init_state=2;
-			dhcp_get_my_ip(myip,netmask,gwip,mydns);
-			init_dnslkup(mydns);
-			client_ifconfig(myip,netmask);
-			show_ip=30; // show the ip for 30 seconds
-			scroll_index=0;
-			print_ip_to_uart();
-			continue;
-		}
-		// DHCP renew IP:
+	// DHCP renew IP:
+	if (plen) {
 		plen=packetloop_dhcp_renewhandler(buf,plen);
-		if (dhcp_get_info(NULL,NULL)!=dhcp_status) {
-			uart_puts_P("DHCP ");
-			switch ((dhcp_status=dhcp_get_info(NULL,NULL))) {
-				case 0: 
-					uart_puts_P("init\r\n"); 
-					// reinitialize clock
-					init_state=0;
-					delay_sec=0;
-					break;
-				case 1: uart_puts_P("select\r\n"); break;
-				case 2: uart_puts_P("request\r\n"); break;
-				case 3: uart_puts_P("bound\r\n"); break;
-				case 4: uart_puts_P("rebind\r\n");
-			}
+		prof_end(PROF_DHCP);
+	} else {
+		// like the other packet phases, empty polls are not counted
+		packetloop_dhcp_renewhandler(buf,plen);
+		prof_stop();
+	}
+	if (dhcp_get_info(NULL,NULL)!=dhcp_status) {
+		STATS_INC(dhcp_changes);
+		log_start_P(LOG_INFO,"DHCP ");
+		switch ((dhcp_status=dhcp_get_info(NULL,NULL))) {
+			case 0: 
+				log_puts_P("init"); 
+				// reinitialize clock
+				init_state=0;
+				init_delay(jitter_below(INIT_JITTER_MS));
+				break;
+			case 1: log_puts_P("select"); break;
+			case 2: log_puts_P("request"); break;
+			case 3: log_puts_P("bound"); break;
+			case 4: log_puts_P("rebind");
 		}
-		dat_p=packetloop_arp_icmp_tcp(buf,plen);
-		if(dat_p==0){
-			// no http request
-			if (plen>0){
-				// possibly a udp message
-				udp_client_check_for_dns_answer(buf,plen);
-				udp_client_check_for_ntp_answer(buf,plen);
-				continue;
-			}
-			// we are idle here (no incoming packet to process).
-			if (enc28j60linkup()!=link_status) {
-				if ((link_status=enc28j60linkup())) {
-					uart_puts_P("Link up\r\n");
-					init_state=0;
-					delay_sec=0;
-				} else {
-					uart_puts_P("Link down\r\n");
-					show_ip=0;
-				}
-			}
-			// scroll the ip address over display
-			if (show_ip && display_update_pending){
-				show_ip--;
-				display_update_pending=0;
-				mk_net_str(gStrbuf,myip,4,'.',10);
-				i=strlen(gStrbuf);
-				strcat_P(gStrbuf,PSTR("        "));
-				hdlx2416_putsn(gStrbuf+scroll_index,8);
-				scroll_index++;
-				if (scroll_index==i) scroll_index=0;
-			}
-			// periodically read the temperature and humidity
-			if (dht_delay_sec==0) {
-				dht_delay_sec=10;
-				dht_gettemperaturehumidity(&temperature,&humidity);
-				if (ntp_state) save_min_max_temp();
-			}
-			if (init_state==0 && delay_sec==0 && link_status){
-				// request initial IP assignment
-				init_state=1;
-				have_ntp_mac=0;
-				have_dns_mac=0;
-				hdlx2416_puts_P("WaitDHCP");
-				// unassigns any previous assigned IP:
-				i=0;
-				while (i<4) {myip[i]=0;i++;}
-				client_ifconfig(myip,NULL);
-				// prepare for initial IP assignment:
-				init_dhcp(mymac[5]);
-				dhcp_status=0;
+		log_end();
+	}
+	prof_begin();
+	dat_p=packetloop_arp_icmp_tcp(buf,plen);
+	if(dat_p==0){
+		// no http request
+		if (plen>0){
+			// possibly a udp message
+			udp_client_check_for_dns_answer(buf,plen);
+			udp_client_check_for_ntp_answer(buf,plen);
+			udp_server_check_for_status_query(buf,plen);
+			prof_end(PROF_IP);
+			// the init task may wait for this answer
+			sched_wake(init_task,0);
+		}else{
+			prof_stop();
+		}
+		return;
+	}
+	prof_end(PROF_IP);
+	// tcp port 80 begin
+	prof_begin();
+	// prints http request method line
+	s = &buf[dat_p];
+	log_start_P(LOG_DEBUG,"");
+	while (*s && *s!='\r' && *s!='\n') {
+		log_putc(*s++);
+	}
+	log_end();
+	webpage_stream=NULL;
+	webpage_file=NULL;
+	// check method
+	if (strncmp_P((char *)&(buf[dat_p]),PSTR("GET "),4)==0){
+		// get method:
+		analyse_get_url((char *)&(buf[dat_p+4]));
+	} else if (strncmp_P((char *)&(buf[dat_p]),PSTR("POST "),5)==0){
+		// post method:
+		switch (analyse_post_url((char *)&(buf[dat_p+5]))) {
+			case 1:
+				// reinitialize clock with the new mac
+				dns_cached=0;
+				init_state=0;
+				init_delay(0);
+				enc28j60setmac(config.mymac);
+				init_mac(config.mymac);
+				break;
+			case 2:
+				// look up the new ntp host
+				dns_cached=0;
+				init_restart(2);
+		}
+	} else {
+		// other methods:
+		dat_p=http501notimpl();
+	}
+	if (webpage_stream) {
+		// the page is written to the tcp send buf part by part
+		log_P(LOG_DEBUG,"Reply stream");
+		www_server_reply_stream(buf,webpage_stream);
+	} else if (webpage_file) {
+		// the headers are in the tcp send buf, the file is sent from flash
+		log_P(LOG_DEBUG,"Reply file");
+		www_server_reply_p(buf,dat_p,webpage_file->data,webpage_file->len,webpage_file->sum);
+	} else {
+		// a web page has been written to the tcp send buf
+		log_start_P(LOG_DEBUG,"Reply len=");
+		log_number(dat_p);
+		log_end();
+		www_server_reply(buf,dat_p); // send web page data
+	}
+	prof_end(PROF_HTTP);
+	// tcp port 80 end
+}
+
+// checks the link once per second
+static void link_run(void) {
+	uint8_t linkup;
+
+	sched_wake(link_task,1000);
+	log_poll();
+	config_flush();
+	if (!www_server_stream_busy()) prof_hold(0);
+	linkup=enc28j60linkup();
+	if (linkup!=link_status) {
+		if ((link_status=linkup)) {
+			log_P(LOG_INFO,"Link up");
+			if (dhcp_status>=3){
+				// the lease is still valid, check the macs
+				init_restart(2);
+			}else{
+				init_state=0;
+				// clocks that got their link together start apart
+				init_delay(jitter_below(INIT_JITTER_MS));
 			}
-			if (init_state==2 && delay_sec==0){
-				// resolve ARPs
-				if (!have_dns_mac || !have_ntp_mac) {
-					uart_puts_P("ARP request\r\n");
-					if (arpresolver()) {
-						delay_sec=2; // retry after 2 sec if no answer
-						if (++arp_retry_count==15){
-							arp_retry_count=0;
-							// reinitialize clock after multiple retries
-							init_state=0;
-							delay_sec=0;
-						}
-					}
-				}
-				if (have_dns_mac && have_ntp_mac) {
-					// all ARPs resolved
-					init_state=3;
-					delay_sec=0;
-					dns_state=0;
-				}
+		} else {
+			log_P(LOG_INFO,"Link down");
+			show_ip=0;
+		}
+	}
+	arp_cache_tick(link_status);
+}
+
+// reads the temperature and humidity every 10 seconds
+static void dht_run(void) {
+	int8_t status;
+
+	if (!dht_reading) {
+		dht_start();
+		dht_reading=1;
+		sched_wake(dht_task,DHT_READ_MS);
+		return;
+	}
+	prof_begin();
+	status=dht_gettemperaturehumidity(&temperature,&humidity);
+	if (status==1) {
+		// not done yet
+		prof_stop();
+		sched_wake(dht_task,DHT_POLL_MS);
+		return;
+	}
+	if (status<0) STATS_INC(dht_errors);
+	if (status==-2) STATS_INC(dht_checksum_errors);
+	if (status==0) {
+		dht_valid=1;
+		if (ntp_state) dht_log_add(time(NULL),temperature,humidity);
+	}
+	prof_end(PROF_DHT);
+	dht_reading=0;
+	sched_wake(dht_task,DHT_PERIOD_MS-DHT_READ_MS);
+}
+
+// updates the display, woken every second by the clock interrupt
+static void display_run(void) {
+	if (!display_update_pending) return;
+	display_update_pending=0;
+	prof_begin();
+	// scroll the ip address over display
+	if (show_ip){
+		show_ip--;
+		hdlx2416_flush(scroll_text+scroll_index);
+		scroll_index++;
+		if (scroll_index==scroll_len) scroll_index=0;
+		prof_end(PROF_DISPLAY);
+		return;
+	}
+	// the time runs on while the start up is redone
+	if (ntp_state){
+		save_state();
+		check_alarm_and_ntp_period();
+		display_sec++;
+		if (display_sec>5 && config.display_temperature){
+			print_dht_to_display();
+		}else{
+			print_time_to_display();
+		}
+		if (display_sec>9) display_sec=0;
+	}
+	prof_end(PROF_DISPLAY);
+}
+
+// brings the clock up: IP assignment, ARP, DNS lookup and NTP requests,
+// woken when its delay passed or when something happened
+static void init_run(void) {
+	uint8_t i;
+
+	// look again once per second unless a delay says otherwise
+	sched_wake(init_task,1000);
+	if (init_state==0 && init_delay_passed() && link_status){
+		// request initial IP assignment
+		init_state=1;
+		have_ntp_mac=0;
+		have_dns_mac=0;
+		if (!ntp_state) hdlx2416_puts_P("WaitDHCP");
+		// unassigns any previous assigned IP:
+		i=0;
+		while (i<4) {myip[i]=0;i++;}
+		client_ifconfig(myip,NULL);
+		// prepare for initial IP assignment:
+		init_dhcp(config.mymac[5]);
+		dhcp_status=0;
+	}
+	if (init_state==5 && arpresolver()){
+		// a mac was not refreshed in time
+		init_state=2;
+		init_delay(0);
+	}
+	if (init_state==2){
+		// resolve ARPs
+		if (!arpresolver()) {
+			// all ARPs resolved
+			arp_retry_count=0;
+			init_state=3;
+			init_delay(0);
+			dns_state=0;
+		}else if (init_delay_passed()){
+			log_P(LOG_DEBUG,"ARP request");
+			init_delay(jitter_spread(2000)); // check again after about 2 sec if no answer
+			if (arp_retry_count) STATS_INC(arp_retries);
+			if (++arp_retry_count==15){
+				arp_retry_count=0;
+				// reinitialize clock after multiple retries
+				init_state=0;
+				init_delay(0);
 			}
-			if (init_state==3) {
-				// DNS lookup
-				if (dns_state==0){
-					delay_sec=5; // retry after 5 sec if no answer
-					dns_state=1;
-					uart_puts_P("DNS request\r\n");
-					dnslkup_request(buf,ntphostname,ntproutingmac);
-				}
-				if (dns_state==1 && dnslkup_haveanswer()){
-					// dns-lookup succeeded:
-					dns_state=2;
-					dnslkup_get_ip(ntpip);
-					mk_net_str(gStrbuf,ntpip,4,'.',10);
-					uart_puts_P("NTP IP:");
-					uart_puts(gStrbuf);
-					uart_puts_P("\r\n");
-					init_state = 4;
-				}
-				if (dns_state!=2 && delay_sec==0){
-					// retry if dns-lookup failed:
-					dns_state=0;
-					if (dnslkup_get_error_info()) {
-						uart_puts_P("DNS Error\r\n");
-					}
-					if (++dns_retry_count==6) {
-						dns_retry_count=0;
-						// reinitialize clock after multiple retries
-						init_state=0;
-						delay_sec=0;
-					}
-				}
+		}
+	}
+	if (init_state==3) {
+		// DNS lookup, the cached answer is used while it is refreshed
+		if (dns_cached){
+			dns_state=2;
+			init_state=4;
+		}
+		if (dns_state==0){
+			init_delay(jitter_spread(5000)); // retry after about 5 sec if no answer
+			dns_state=1;
+			log_P(LOG_INFO,"DNS request");
+			dnslkup_request(buf,config.ntphostname,dnsroutingmac);
+		}
+		if (dns_state==1 && dnslkup_haveanswer()){
+			// dns-lookup succeeded:
+			dns_state=2;
+			dns_use_answer();
+			init_state = 4;
+		}
+		if (dns_state!=2 && init_delay_passed()){
+			// retry if dns-lookup failed:
+			dns_state=0;
+			STATS_INC(dns_errors);
+			if (dnslkup_get_error_info()) {
+				log_P(LOG_ERROR,"DNS Error");
 			}
-			if (init_state==4){
-				// ready for initial NTP
-				ntpclientportL=mymac[5];
-				delay_sec=0;
-				ntp_state=0;
-				init_state=5;
+			if (++dns_retry_count==6) {
+				dns_retry_count=0;
+				// resolve the dns mac again after multiple retries
+				arp_cache_expire(next_hop(mydns));
+				init_restart(2);
 			}
-			if (init_state==5){
-				// request NTP
-				if (ntp_state!=1 && delay_sec==0 && link_status){
-					if (ntp_retry_count<6){
-						delay_sec=5; // retry after 5 sec if no answer
-						ntpclientportL++; // new src port
-						uart_puts_P("NTP request\r\n");
-						client_ntp_request(buf,ntpip,ntpclientportL,ntproutingmac);
-						ntp_retry_count++;
-					}else{
+		}
+	}
+	if (init_state==4){
+		// ready for initial NTP
+		ntpclientportL=config.mymac[5];
+		init_delay(0);
+		// a clock that was set keeps running
+		if (ntp_state) ntp_state=2;
+		ntp_burst_count=0;
+		init_state=5;
+	}
+	if (init_state==5){
+		// request NTP
+		if (ntp_state!=1 && init_delay_passed() && link_status){
+			if (ntp_retry_count<3){
+				init_delay(jitter_spread(2000)); // next request after about 2 sec
+				if (ntp_burst_count<NTP_SAMPLES){
+					ntpclientportL+=NTP_MAX_SERVERS; // new src ports
+					log_P(LOG_DEBUG,"NTP request");
+					ntp_client_request(buf,ntpclientportL,ntproutingmac);
+					ntp_burst_count++;
+					net_ntp_wait=clock_get_ms()+NET_NTP_WAIT_MS;
+					sched_wake(net_task,0);
+				}else{
+					// all requests of this update are sent
+					ntp_burst_count=0;
+					ntp_retry_count++;
+					if (ntp_update()){
+						ntp_state=1;
 						ntp_retry_count=0;
-						// reinitialize clock after multiple retries
-						init_state=0;
-						delay_sec=0;
-					}
-				}
-				// update the display
-				if (!show_ip && ntp_state && display_update_pending){
-					display_update_pending=0;
-					check_alarm_and_ntp_period();
-					display_sec++;
-					if (display_sec>5 && display_temperature){
-						print_dht_to_display();
 					}else{
-						print_time_to_display();
+						init_delay(ntp_retry_delay());
 					}
-					if (display_sec>9) display_sec=0;
-				}
-			}
-		} else {
-			// dat_p !=0
-			// tcp port 80 begin
-			// prints http request method line
-			s = &buf[dat_p];
-			while (*s) {
-				uart_putc(*s);
-				if (*s++=='\n') break;
-			}
-			// check method
-			if (strncmp_P((char *)&(buf[dat_p]),PSTR("GET "),4)==0){
-				// get method:
-				analyse_get_url((char *)&(buf[dat_p+4]));
-			} else if (strncmp_P((char *)&(buf[dat_p]),PSTR("POST "),5)==0){
-				// post method:
-				if (analyse_post_url((char *)&(buf[dat_p+5]))) {
-					// reinitialize clock
-					init_state=0;
-					delay_sec=0;
-					enc28j60setmac(mymac);
-					init_mac(mymac);
 				}
-			} else {
-				// other methods:
-				dat_p=http501notimpl();
+			}else{
+				ntp_retry_count=0;
+				// resolve the ntp mac again after multiple retries,
+				// the dns answer is kept
+				arp_cache_expire(next_hop(ntpip));
+				init_state=2;
+				init_delay(0);
 			}
-			// a web page has been written to the tcp send buf
-			uart_puts_P("Reply len=");
-			itoa(dat_p,gStrbuf,10);
-			uart_puts(gStrbuf);
-			uart_puts_P("\r\n");
-			www_server_reply(buf,dat_p); // send web page data
-			// tcp port 80 end
 		}
+		// refresh the dns answer in the background
+		if (dns_state==1 && dnslkup_haveanswer()){
+			dns_state=2;
+			dns_use_answer();
+		}
+		if (init_state==5 && (int32_t)(clock_get_ms()-dns_refresh)>=0){
+			dns_refresh=clock_get_ms()+jitter_spread(DNS_RETRY_MS); // retry if no answer
+			dns_state=1;
+			log_P(LOG_INFO,"DNS refresh");
+			dnslkup_request(buf,config.ntphostname,dnsroutingmac);
+		}
+	}
+}
+
+// main loop
+int main(void){
+	config_load();
+	log_init();
+	buzzer_init();
+	hdlx2416_init();
+	hdlx2416_intensity(config.intensity);
+	hdlx2416_puts_P("NTPclock");
+	enc28j60Init(config.mymac);
+#ifdef ENC28J60_RX_FILTER
+	enc28j60SetRxFilter(packet_header_filter);
+#endif
+	print_rev_to_uart();
+	init_mac(config.mymac);
+	jitter_init(config.mymac);
+	build_id=www_sum_p(PSTR(__DATE__ __TIME__),sizeof(__DATE__ __TIME__)-1);
+	if (config.enable_eu_dst) {
+		clock_set_dst(eu_dst,eu_dst_next);
+	}
+	register_ping_rec_callback(ping_callback);
+	clock_init(second_tick);
+	restore_state();
+	net_task=sched_add(net_run);
+	init_task=sched_add(init_run);
+	link_task=sched_add(link_run);
+	dht_task=sched_add(dht_run);
+	display_task=sched_add(display_run);
+	wdt_enable(WDTO_250MS); // tasks must not block
+	sei(); // interrupt on, clock starts ticking now
+	while(1){
+		sched_run();
 		wdt_reset();
 	}
 	return (0);
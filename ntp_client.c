@@ -0,0 +1,338 @@
+/*
+ * ntp_client.c
+ *
+ * Created: 14-10-2026 21:04:38
+ *  Author: Tim Dorssers
+ *
+ * Queries up to NTP_MAX_SERVERS servers in parallel and selects one of them
+ * with simplified versions of the clock filter, select and cluster
+ * algorithms of RFC 5905. An update is a burst of NTP_SAMPLES requests to
+ * every server. Of each server the sample with the lowest round-trip delay
+ * is the candidate, the other samples give its jitter. The correctness
+ * interval of a candidate is its offset plus and minus half the delay and
+ * the jitter. Servers whose interval does not overlap the intersection of
+ * the majority of intervals are falsetickers. The survivors that are furthest
+ * away from the others are pruned and the survivor with the smallest interval
+ * corrects the clock.
+ */
+
+#include <avr/io.h>
+#include <stdlib.h>
+#include <string.h>
+#include "net.h"
+#include "ip_arp_udp_tcp.h"
+#include "clock.h"
+#include "ntp_client.h"
+#ifdef ENC28J60_TIMESTAMP
+#include "enc28j60.h"
+#endif
+
+// once the clock is set, samples with a larger offset are rejected,
+// in units of 1/65536 second
+#define NTP_MAX_OFFSET (1000L*65536)
+// added to the intervals for the timer resolution, about 1 ms
+#define NTP_MIN_DISTANCE 66
+// pruning stops at this number of survivors
+#define NTP_MIN_CLUSTER 3
+
+struct ntp_server {
+	uint8_t ip[4];
+	struct ntp_ts xmt; // transmit time stamp of the outstanding request
+	struct ntp_ts sent; // time the request actually left
+	int32_t offset[NTP_SAMPLES]; // in units of 1/65536 second
+	uint16_t delay[NTP_SAMPLES]; // round-trip delay below one second
+	uint8_t count; // number of samples in the ring
+	uint8_t next; // ring position of the next sample
+};
+
+static struct ntp_server ntp_servers[NTP_MAX_SERVERS];
+static uint8_t ntp_server_count=0;
+static uint8_t ntp_srcport; // source port of the first server
+static uint8_t ntp_synced=0; // the clock was corrected by an update
+static int8_t ntp_peer=-1; // last selected server
+
+// forgets all samples and outstanding requests
+static void ntp_client_clear(void)
+{
+	uint8_t i=0;
+	while(i<ntp_server_count){
+		ntp_servers[i].xmt.sec=0;
+		ntp_servers[i].count=0;
+		ntp_servers[i].next=0;
+		i++;
+	}
+}
+
+void ntp_client_init(void)
+{
+	ntp_server_count=0;
+	ntp_peer=-1;
+}
+
+uint8_t ntp_client_add_server(const uint8_t *ip)
+{
+	uint8_t i=0;
+	while(i<ntp_server_count){
+		if (memcmp(ntp_servers[i].ip,ip,4)==0) return(1);
+		i++;
+	}
+	if (ntp_server_count==NTP_MAX_SERVERS) return(0);
+	memcpy(ntp_servers[ntp_server_count].ip,ip,4);
+	ntp_server_count++;
+	ntp_client_clear();
+	return(1);
+}
+
+void ntp_client_request(uint8_t *buf,uint8_t srcport,uint8_t *dstmac)
+{
+	uint8_t i=0;
+#ifdef ENC28J60_TIMESTAMP
+	struct clock_stamp stamp;
+#endif
+	ntp_srcport=srcport;
+	while(i<ntp_server_count){
+		clock_get_ntp_time(&ntp_servers[i].xmt);
+		client_ntp_request(buf,ntp_servers[i].ip,srcport+i,dstmac,&ntp_servers[i].xmt);
+#ifdef ENC28J60_TIMESTAMP
+		// the driver stamped the start of the transmission
+		enc28j60GetTxStamp(&stamp);
+		clock_stamp_to_ntp(&stamp,&ntp_servers[i].sent);
+#else
+		ntp_servers[i].sent=ntp_servers[i].xmt;
+#endif
+		i++;
+	}
+}
+
+uint8_t ntp_client_process_answer(uint8_t *buf)
+{
+	struct ntp_ts now;
+	struct ntp_ts ts[3]; // originate, receive and transmit time stamps
+	struct ntp_server *s;
+	int32_t delay;
+	int32_t offset;
+	uint8_t i;
+#ifdef ENC28J60_TIMESTAMP
+	struct clock_stamp stamp;
+
+	// destination time stamp, taken by the driver when the packet arrived
+	enc28j60GetRxStamp(&stamp);
+	clock_stamp_to_ntp(&stamp,&now);
+#else
+	// destination time stamp, taken as early as possible
+	clock_get_ntp_time(&now);
+#endif
+	i=buf[UDP_DST_PORT_L_P]-ntp_srcport;
+	if (i>=ntp_server_count){
+		return(0);
+	}
+	s=&ntp_servers[i];
+	if (memcmp(&buf[IP_SRC_P],s->ip,4)!=0){
+		return(0);
+	}
+	if (!client_ntp_process_answer(buf,ts,buf[UDP_DST_PORT_L_P])){
+		return(0);
+	}
+	// the answer must be to the outstanding request, accept it once
+	if (s->xmt.sec==0 || ts[0].sec!=s->xmt.sec || ts[0].frac!=s->xmt.frac){
+		return(0);
+	}
+	s->xmt.sec=0;
+	// round-trip delay excluding the server processing time
+	delay=clock_ntp_diff(&now,&s->sent)-clock_ntp_diff(&ts[2],&ts[1]);
+	if (delay<0) delay=0;
+	if (delay>0xffff){
+		return(0);
+	}
+	// server time at the destination time stamp
+	clock_ntp_add(&ts[2],delay/2);
+	offset=clock_ntp_diff(&ts[2],&now);
+	if (offset>NTP_MAX_OFFSET || offset<-NTP_MAX_OFFSET){
+		if (ntp_synced){
+			return(0);
+		}
+		// the clock was never set, set it from this server and start over
+		clock_set_ntp_time(&now,&ts[2]);
+		ntp_client_clear();
+		return(2);
+	}
+	s->offset[s->next]=offset;
+	s->delay[s->next]=delay;
+	s->next=(s->next+1)%NTP_SAMPLES;
+	if (s->count<NTP_SAMPLES) s->count++;
+	return(1);
+}
+
+uint8_t ntp_client_update(uint8_t *ip,int32_t *offset,int32_t *delay,int32_t *jitter)
+{
+	struct ntp_server *s;
+	struct ntp_ts now;
+	struct ntp_ts ref;
+	uint8_t srv[NTP_MAX_SERVERS]; // server of each candidate
+	uint16_t dly[NTP_MAX_SERVERS]; // the lowest delay
+	int32_t off[NTP_MAX_SERVERS];
+	int32_t jit[NTP_MAX_SERVERS];
+	int32_t dist[NTP_MAX_SERVERS]; // half the correctness interval
+	int32_t edge[3*NTP_MAX_SERVERS];
+	int8_t type[3*NTP_MAX_SERVERS]; // -1 lower, 0 middle, +1 upper edge
+	int32_t e,low=0,high=0,sel,max,minjit;
+	int8_t t,chime;
+	uint8_t i,j,k,n=0,m=0,allow,found,alive=0,survivors=0,peer=0;
+
+	// clock filter: candidates are the samples with the lowest delay
+	i=0;
+	while(i<ntp_server_count){
+		s=&ntp_servers[i];
+		if (s->count){
+			k=0;
+			j=1;
+			while(j<s->count){
+				if (s->delay[j]<s->delay[k]) k=j;
+				j++;
+			}
+			srv[n]=i;
+			dly[n]=s->delay[k];
+			off[n]=s->offset[k];
+			jit[n]=0;
+			j=0;
+			while(j<s->count){
+				jit[n]+=labs(s->offset[j]-off[n]);
+				j++;
+			}
+			if (s->count>1) jit[n]/=s->count-1;
+			dist[n]=dly[n]/2+jit[n]+NTP_MIN_DISTANCE;
+			n++;
+		}
+		i++;
+	}
+	ntp_client_clear();
+	if (n==0){
+		return(0);
+	}
+	// select: sort the edges of the correctness intervals
+	i=0;
+	while(i<n){
+		edge[m]=off[i]-dist[i]; type[m++]=-1;
+		edge[m]=off[i]; type[m++]=0;
+		edge[m]=off[i]+dist[i]; type[m++]=1;
+		i++;
+	}
+	i=1;
+	while(i<m){
+		e=edge[i];
+		t=type[i];
+		j=i;
+		while(j>0 && edge[j-1]>e){
+			edge[j]=edge[j-1];
+			type[j]=type[j-1];
+			j--;
+		}
+		edge[j]=e;
+		type[j]=t;
+		i++;
+	}
+	// find the intersection of the most intervals, allowing for a
+	// minority of falsetickers
+	allow=0;
+	while(2*allow<n){
+		found=0;
+		chime=0;
+		i=0;
+		while(i<m){
+			chime-=type[i];
+			if (chime>=n-allow){
+				low=edge[i];
+				break;
+			}
+			if (type[i]==0) found++;
+			i++;
+		}
+		chime=0;
+		i=m;
+		while(i>0){
+			i--;
+			chime+=type[i];
+			if (chime>=n-allow){
+				high=edge[i];
+				break;
+			}
+			if (type[i]==0) found++;
+		}
+		if (found<=allow && low<high) break;
+		allow++;
+	}
+	if (2*allow>=n){
+		// no majority agrees
+		return(0);
+	}
+	// the candidates whose intervals overlap the intersection survive
+	i=0;
+	while(i<n){
+		if (off[i]+dist[i]>=low && off[i]-dist[i]<=high){
+			alive|=1<<i;
+			survivors++;
+		}
+		i++;
+	}
+	// cluster: prune the survivor that is furthest away from the others
+	// while that distance exceeds the smallest jitter of the survivors
+	while(survivors>NTP_MIN_CLUSTER){
+		max=-1;
+		minjit=INT32_MAX;
+		k=0;
+		i=0;
+		while(i<n){
+			if (alive & (1<<i)){
+				sel=0;
+				j=0;
+				while(j<n){
+					if (alive & (1<<j)) sel+=labs(off[i]-off[j]);
+					j++;
+				}
+				sel/=survivors-1;
+				if (sel>max){
+					max=sel;
+					k=i;
+				}
+				if (jit[i]<minjit) minjit=jit[i];
+			}
+			i++;
+		}
+		if (max<=minjit) break;
+		alive&=~(1<<k);
+		survivors--;
+	}
+	// the survivor with the smallest interval becomes the peer
+	i=0;
+	while(i<n){
+		if ((alive & (1<<i)) && (!(alive & (1<<peer)) || dist[i]<dist[peer])) peer=i;
+		i++;
+	}
+	clock_get_ntp_time(&now);
+	ref=now;
+	clock_ntp_add(&ref,off[peer]);
+	clock_set_ntp_time(&now,&ref);
+	ntp_synced=1;
+	ntp_peer=srv[peer];
+	memcpy(ip,ntp_servers[ntp_peer].ip,4);
+	*offset=off[peer];
+	*delay=dly[peer];
+	*jitter=jit[peer];
+	return(survivors);
+}
+
+uint8_t *ntp_client_get_peer(void)
+{
+	if (ntp_peer<0) return(NULL);
+	return(ntp_servers[ntp_peer].ip);
+}
+
+uint8_t ntp_client_waiting(void)
+{
+	uint8_t i=0;
+	while(i<ntp_server_count){
+		if (ntp_servers[i].xmt.sec) return(1);
+		i++;
+	}
+	return(0);
+}
@@ -0,0 +1,37 @@
+/*
+ * ntp_client.h
+ *
+ * Created: 14-10-2026 21:05:12
+ *  Author: Tim Dorssers
+ */
+
+#ifndef NTP_CLIENT_H_
+#define NTP_CLIENT_H_
+
+#include <avr/io.h>
+
+// number of servers that are queried in parallel
+#define NTP_MAX_SERVERS 4
+// number of requests per server in one update, the sample ring size
+#define NTP_SAMPLES 4
+
+// forgets all servers and samples
+extern void ntp_client_init(void);
+// adds a server, returns 0 if there is no room left
+extern uint8_t ntp_client_add_server(const uint8_t *ip);
+// sends a request to every server, server n uses source port srcport+n
+extern void ntp_client_request(uint8_t *buf,uint8_t srcport,uint8_t *dstmac);
+// stores the sample of an answer to one of our requests
+// returns 1 if a sample was stored, 2 if the clock was not set yet and
+// was set from the answer, 0 otherwise
+extern uint8_t ntp_client_process_answer(uint8_t *buf);
+// selects a server from the samples and corrects the clock with its offset,
+// clears all samples. Returns the number of servers that agree, 0 if none.
+// ip, offset, delay and jitter of the selected server are returned.
+extern uint8_t ntp_client_update(uint8_t *ip,int32_t *offset,int32_t *delay,int32_t *jitter);
+// returns the ip of the last selected server or NULL
+extern uint8_t *ntp_client_get_peer(void);
+// returns 1 while a request is not answered
+extern uint8_t ntp_client_waiting(void);
+
+#endif /* NTP_CLIENT_H_ */
@@ -0,0 +1,106 @@
+/*
+ * nvstate.c
+ *
+ * Created: 15-10-2026 00:20:58
+ *  Author: Tim Dorssers
+ *
+ * Ring of snapshots in EEPROM. Every snapshot goes to the next slot, so the
+ * writes are spread over NVSTATE_SLOTS slots. The sequence number of a slot
+ * is one more than that of the slot before it, the newest slot is the one
+ * whose successor does not follow on. A slot with a wrong check byte, like
+ * an erased one, is not used. Slots are written in the background by eewrite,
+ * they are only read at start up.
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "eewrite.h"
+#include "nvstate.h"
+
+static struct nvstate EEMEM nv_state[NVSTATE_SLOTS];
+static uint8_t nvstate_next=0; // slot that is written next
+static uint8_t nvstate_count=0; // valid slots before nvstate_next
+static uint8_t nvstate_seq=0; // seq of the next slot
+static struct nvstate nvstate_buf; // snapshot that is being written
+
+// returns the check byte of a snapshot
+static uint8_t nvstate_sum(const struct nvstate *s)
+{
+	const uint8_t *p=(const uint8_t *)s;
+	uint8_t sum=0x5a;
+	uint8_t i=0;
+
+	while(i<sizeof(struct nvstate)-1){
+		sum=(sum<<1 | sum>>7)+p[i];
+		i++;
+	}
+	return(sum);
+}
+
+static uint8_t nvstate_load(uint8_t slot, struct nvstate *s)
+{
+	eeprom_read_block(s,&nv_state[slot],sizeof(struct nvstate));
+	return(s->sum==nvstate_sum(s));
+}
+
+void nvstate_init(void)
+{
+	struct nvstate s;
+	uint8_t seq;
+	uint8_t newest=NVSTATE_SLOTS;
+	uint8_t i=0;
+
+	// look for a valid slot that the next slot does not follow on
+	while(i<NVSTATE_SLOTS){
+		if (nvstate_load(i,&s)){
+			seq=s.seq;
+			if (!nvstate_load((i+1)%NVSTATE_SLOTS,&s) || s.seq!=(uint8_t)(seq+1)){
+				newest=i;
+				break;
+			}
+		}
+		i++;
+	}
+	nvstate_count=0;
+	nvstate_next=0;
+	nvstate_seq=0;
+	if (newest==NVSTATE_SLOTS) return;
+	nvstate_next=(newest+1)%NVSTATE_SLOTS;
+	// count the slots back to the oldest one
+	i=newest;
+	nvstate_load(i,&s);
+	seq=s.seq;
+	nvstate_seq=seq+1;
+	nvstate_count=1;
+	while(nvstate_count<NVSTATE_SLOTS){
+		i=(i+NVSTATE_SLOTS-1)%NVSTATE_SLOTS;
+		if (!nvstate_load(i,&s) || s.seq!=(uint8_t)(seq-1)) break;
+		seq=s.seq;
+		nvstate_count++;
+	}
+}
+
+uint8_t nvstate_get_count(void)
+{
+	return(nvstate_count);
+}
+
+uint8_t nvstate_read(uint8_t n, struct nvstate *s)
+{
+	if (n>=nvstate_count) return(0);
+	return(nvstate_load((nvstate_next+NVSTATE_SLOTS-nvstate_count+n)%NVSTATE_SLOTS,s));
+}
+
+uint8_t nvstate_write(struct nvstate *s)
+{
+	// nvstate_buf may still be being written
+	if (eewrite_busy()) return(0);
+	s->seq=nvstate_seq;
+	s->sum=nvstate_sum(s);
+	nvstate_buf=*s;
+	if (!eewrite(&nv_state[nvstate_next],&nvstate_buf,sizeof(struct nvstate))) return(0);
+	nvstate_seq++;
+	nvstate_next=(nvstate_next+1)%NVSTATE_SLOTS;
+	if (nvstate_count<NVSTATE_SLOTS) nvstate_count++;
+	return(1);
+}
@@ -0,0 +1,43 @@
+/*
+ * nvstate.h
+ *
+ * Created: 15-10-2026 00:21:34
+ *  Author: Tim Dorssers
+ */
+
+#ifndef NVSTATE_H_
+#define NVSTATE_H_
+
+#include <avr/io.h>
+#include <time.h>
+
+// number of slots in the ring, 24 hours of snapshots
+#define NVSTATE_SLOTS 48
+// seconds between two snapshots
+#define NVSTATE_INTERVAL 1800
+
+// flags
+#define NVSTATE_DHT 1 // temperature and humidity are valid
+
+// a snapshot of the clock state
+struct nvstate {
+	uint8_t seq; // incremented for every slot that is written
+	time_t t;
+	int32_t freq; // frequency correction of the clock
+	int8_t temperature;
+	int8_t humidity;
+	uint8_t flags;
+	uint8_t sum; // check byte
+};
+
+// finds the newest slot, call this once before the other functions
+extern void nvstate_init(void);
+// returns the number of snapshots in the ring
+extern uint8_t nvstate_get_count(void);
+// reads snapshot n, 0 is the oldest, returns 0 if there is no such snapshot
+extern uint8_t nvstate_read(uint8_t n, struct nvstate *s);
+// writes a snapshot over the oldest one in the background, sets its seq and
+// sum. Returns 0 if eeprom is busy, try again later
+extern uint8_t nvstate_write(struct nvstate *s);
+
+#endif /* NVSTATE_H_ */
@@ -0,0 +1,99 @@
+/*
+ * prof.c
+ *
+ * Created: 14-10-2026 23:51:40
+ *  Author: Tim Dorssers
+ *
+ * Cycle counts of the main loop phases. TIMER0 counts at crystal clock/8
+ * while a phase is measured, its overflow interrupt extends the count. The
+ * timer is stopped otherwise, so it does not wake the cpu from sleep. The
+ * overflow interrupts take about 1% of the cycles that are counted.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "prof.h"
+
+#define PROF_PRESCALE 8
+
+struct prof_phase {
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+	uint16_t count; // number of measurements in sum
+};
+
+static struct prof_phase prof_phases[PROF_PHASES];
+static volatile uint16_t prof_ovf; // TIMER0 overflows since prof_begin
+static uint8_t prof_held=0; // the counts are being read, do not change them
+
+static const char prof_names[PROF_PHASES][8] PROGMEM = {
+	"RX", "DHCP", "IP", "HTTP", "Display", "DHT"
+};
+
+ISR(TIMER0_OVF_vect)
+{
+	prof_ovf++;
+}
+
+void prof_begin(void)
+{
+	TCCR0B=0;
+	TCNT0=0;
+	prof_ovf=0;
+	TIFR0=(1<<TOV0);
+	TIMSK0=(1<<TOIE0);
+	TCCR0B=(1<<CS01); // clk/8
+}
+
+void prof_stop(void)
+{
+	TCCR0B=0;
+	TIMSK0=0;
+}
+
+void prof_hold(uint8_t hold)
+{
+	prof_held=hold;
+}
+
+void prof_end(uint8_t phase)
+{
+	struct prof_phase *p;
+	uint32_t cycles;
+	uint16_t ovf;
+
+	prof_stop();
+	if (prof_held) return;
+	cycles=TCNT0;
+	ovf=prof_ovf;
+	if (TIFR0 & (1<<TOV0)) ovf++; // overflow was not served
+	cycles=(((uint32_t)ovf<<8)|cycles)*PROF_PRESCALE;
+	p=&prof_phases[phase];
+	if (p->count==0 || cycles<p->min) p->min=cycles;
+	if (cycles>p->max) p->max=cycles;
+	// keep a long running average when the sum would overflow
+	if (p->count==0xffff || p->sum>=0x80000000UL-cycles){
+		p->sum/=2;
+		p->count/=2;
+	}
+	p->sum+=cycles;
+	p->count++;
+}
+
+uint8_t prof_get(uint8_t phase, uint32_t *min, uint32_t *avg, uint32_t *max)
+{
+	struct prof_phase *p=&prof_phases[phase];
+
+	if (p->count==0) return(0);
+	*min=p->min;
+	*avg=p->sum/p->count;
+	*max=p->max;
+	return(1);
+}
+
+const char *prof_get_name_p(uint8_t phase)
+{
+	return(prof_names[phase]);
+}
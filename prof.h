@@ -0,0 +1,35 @@
+/*
+ * prof.h
+ *
+ * Created: 14-10-2026 23:52:16
+ *  Author: Tim Dorssers
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <avr/io.h>
+
+// main loop phases, the first three are only counted when a packet was read
+#define PROF_RX 0 // reading a packet from the ENC28J60
+#define PROF_DHCP 1 // DHCP client on a packet
+#define PROF_IP 2 // ARP, ICMP, TCP and UDP dispatch
+#define PROF_HTTP 3 // parsing a request and rendering the reply
+#define PROF_DISPLAY 4
+#define PROF_DHT 5 // collecting and logging a reading
+#define PROF_PHASES 6
+
+// starts measuring, phases cannot be nested
+extern void prof_begin(void);
+// stops measuring without counting
+extern void prof_stop(void);
+// stops measuring and adds the cycles since prof_begin to the phase
+extern void prof_end(uint8_t phase);
+// while held, measurements are not counted and the counts do not change
+extern void prof_hold(uint8_t hold);
+// gets the cycle counts of a phase, returns 0 if it was never measured
+extern uint8_t prof_get(uint8_t phase, uint32_t *min, uint32_t *avg, uint32_t *max);
+// name of a phase in program memory
+extern const char *prof_get_name_p(uint8_t phase);
+
+#endif /* PROF_H_ */
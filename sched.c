@@ -0,0 +1,107 @@
+/*
+ * sched.c
+ *
+ * Created: 14-10-2026 23:17:42
+ *  Author: Tim Dorssers
+ *
+ * Cooperative scheduler with millisecond timers. Each task has a wake time
+ * and runs to completion when it is due. When no task is due the cpu sleeps
+ * in idle mode until the next wake time or any interrupt, an interrupt that
+ * wakes a task has it run right after.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include "clock.h"
+#include "sched.h"
+
+struct sched_task {
+	void (*run)(void);
+	uint32_t wake; // clock_get_ms() time to run
+	uint8_t armed; // waiting for its wake time
+};
+
+static volatile struct sched_task sched_tasks[SCHED_MAX_TASKS];
+static uint8_t sched_count=0;
+
+uint8_t sched_add(void (*task)(void))
+{
+	sched_tasks[sched_count].run=task;
+	sched_tasks[sched_count].wake=clock_get_ms();
+	sched_tasks[sched_count].armed=1;
+	return(sched_count++);
+}
+
+void sched_wake(uint8_t id, uint16_t ms)
+{
+	uint32_t now;
+
+	now=clock_get_ms();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		sched_tasks[id].wake=now+ms;
+		sched_tasks[id].armed=1;
+	}
+}
+
+// returns the milliseconds until the first armed task is due, at most
+// SCHED_MAX_SLEEP, must be called with interrupts disabled
+static int32_t sched_next(uint32_t now)
+{
+	int32_t left;
+	int32_t next=SCHED_MAX_SLEEP;
+	uint8_t i=0;
+
+	while(i<sched_count){
+		if (sched_tasks[i].armed){
+			left=sched_tasks[i].wake-now;
+			if (left<next) next=left;
+		}
+		i++;
+	}
+	return(next);
+}
+
+void sched_run(void)
+{
+	uint32_t now;
+	int32_t next;
+	uint8_t due;
+	uint8_t ran=0;
+	uint8_t i=0;
+
+	while(i<sched_count){
+		due=0;
+		now=clock_get_ms();
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			if (sched_tasks[i].armed && (int32_t)(sched_tasks[i].wake-now)<=0){
+				sched_tasks[i].armed=0;
+				due=1;
+			}
+		}
+		if (due){
+			(*sched_tasks[i].run)();
+			ran=1;
+		}
+		i++;
+	}
+	if (ran){
+		// the tasks may have woken each other
+		return;
+	}
+	cli();
+	next=sched_next(clock_get_ms());
+	if (next>0){
+		clock_set_wakeup(next);
+		// timers, SPI and UART keep running
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		sleep_enable();
+		// the instruction after sei is executed before any pending
+		// interrupt, so an interrupt from here on still wakes the cpu
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+}
@@ -0,0 +1,25 @@
+/*
+ * sched.h
+ *
+ * Created: 14-10-2026 23:18:05
+ *  Author: Tim Dorssers
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <avr/io.h>
+
+#define SCHED_MAX_TASKS 8
+// the watchdog must be reset in time, sleep 100 ms at most
+#define SCHED_MAX_SLEEP 100
+
+// adds a task that runs as soon as possible, returns its number
+extern uint8_t sched_add(void (*task)(void));
+// runs the task after ms milliseconds, can be called from interrupt.
+// A task runs once per wake, it wakes itself again if it is periodic.
+extern void sched_wake(uint8_t id, uint16_t ms);
+// runs the tasks that are due, or sleeps until the next one is due
+extern void sched_run(void);
+
+#endif /* SCHED_H_ */
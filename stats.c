@@ -0,0 +1,15 @@
+/*
+ * stats.c
+ *
+ * Created: 15-10-2026 02:05:12
+ *  Author: Tim Dorssers
+ *
+ * Counters of the events that tell whether the network and the sensor are
+ * healthy. They are only counted in the main loop, not in interrupts, so
+ * they are read without disabling interrupts.
+ */
+
+#include <avr/io.h>
+#include "stats.h"
+
+struct stats stats;
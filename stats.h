@@ -0,0 +1,34 @@
+/*
+ * stats.h
+ *
+ * Created: 15-10-2026 02:05:44
+ *  Author: Tim Dorssers
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <avr/io.h>
+
+// event counters, they stop at their maximum
+struct stats {
+	uint32_t rx_packets; // read from the enc28j60
+	uint32_t rx_rejected; // skipped after the headers
+	uint32_t tx_packets;
+	uint16_t rx_errors; // crc or symbol error
+	uint16_t tx_timeouts; // previous transmission hung
+	uint16_t tx_errors; // previous transmission aborted
+	uint16_t arp_retries;
+	uint16_t dns_errors; // lookups without answer
+	uint16_t ntp_fails; // updates without server
+	uint16_t dhcp_changes; // state transitions
+	uint16_t dht_errors; // read outs with a timeout or bad checksum
+	uint16_t dht_checksum_errors; // read outs with a bad checksum
+};
+
+extern struct stats stats;
+
+// counts an event of the named counter
+#define STATS_INC(c) do { if (++stats.c==0) stats.c--; } while (0)
+
+#endif /* STATS_H_ */
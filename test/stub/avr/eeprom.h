@@ -0,0 +1,22 @@
+/*
+ * eeprom.h
+ *
+ * Created: 15-10-2026 10:13:20
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/eeprom.h>. EEMEM variables are placed in the
+ * stub_eeprom array by their offset, see stub.h.
+ */
+
+#ifndef STUB_EEPROM_H_
+#define STUB_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM __attribute__((section("eeprom")))
+
+extern void eeprom_read_block(void *dst, const void *src, size_t n);
+extern void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif /* STUB_EEPROM_H_ */
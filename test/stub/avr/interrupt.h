@@ -0,0 +1,16 @@
+/*
+ * interrupt.h
+ *
+ * Created: 15-10-2026 10:13:58
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/interrupt.h>, there are no interrupts.
+ */
+
+#ifndef STUB_INTERRUPT_H_
+#define STUB_INTERRUPT_H_
+
+#define sei()
+#define cli()
+
+#endif /* STUB_INTERRUPT_H_ */
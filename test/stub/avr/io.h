@@ -0,0 +1,34 @@
+/*
+ * io.h
+ *
+ * Created: 15-10-2026 10:12:03
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/io.h>. The registers that main.c touches are
+ * plain variables in io.c.
+ */
+
+#ifndef STUB_IO_H_
+#define STUB_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1<<(bit))
+
+// 2 KB of ram from 0x100
+#define RAMEND 0x8ff
+#define E2END 0x3ff
+
+#define PINC5 5
+
+// reset causes in MCUSR
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t DDRC;
+extern volatile uint8_t PORTC;
+
+#endif /* STUB_IO_H_ */
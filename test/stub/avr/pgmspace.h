@@ -0,0 +1,29 @@
+/*
+ * pgmspace.h
+ *
+ * Created: 15-10-2026 10:12:41
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/pgmspace.h>, progmem is ordinary memory.
+ */
+
+#ifndef STUB_PGMSPACE_H_
+#define STUB_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strstr_P strstr
+
+#endif /* STUB_PGMSPACE_H_ */
@@ -0,0 +1,20 @@
+/*
+ * sleep.h
+ *
+ * Created: 15-10-2026 14:03:41
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/sleep.h>, sleeping returns at once.
+ */
+
+#ifndef STUB_SLEEP_H_
+#define STUB_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_cpu()
+#define sleep_disable()
+
+#endif /* STUB_SLEEP_H_ */
@@ -0,0 +1,19 @@
+/*
+ * wdt.h
+ *
+ * Created: 15-10-2026 14:03:10
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <avr/wdt.h>, there is no watchdog.
+ */
+
+#ifndef STUB_WDT_H_
+#define STUB_WDT_H_
+
+#define WDTO_250MS 4
+
+#define wdt_enable(timeout)
+#define wdt_disable()
+#define wdt_reset()
+
+#endif /* STUB_WDT_H_ */
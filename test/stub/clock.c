@@ -0,0 +1,110 @@
+/*
+ * clock.c
+ *
+ * Created: 15-10-2026 10:23:16
+ *  Author: Tim Dorssers
+ *
+ * Clock that stands still at stub_clock_now and records the corrections,
+ * the local time follows stub_time and the milliseconds stub_clock_ms.
+ * clock_ntp_diff and clock_ntp_add are the same as in the firmware.
+ */
+
+#include "clock.h"
+#include "stub.h"
+
+struct ntp_ts stub_clock_now;
+int32_t stub_clock_offset=0;
+uint8_t stub_clock_sets=0;
+
+void clock_get_ntp_time(struct ntp_ts *ts)
+{
+	*ts=stub_clock_now;
+}
+
+void clock_stamp_to_ntp(const struct clock_stamp *s, struct ntp_ts *ts)
+{
+	*ts=stub_clock_now;
+}
+
+int32_t clock_ntp_diff(const struct ntp_ts *a, const struct ntp_ts *b)
+{
+	int32_t sec;
+
+	sec=a->sec-b->sec;
+	if (sec>0x7ffe) return(INT32_MAX);
+	if (sec<-0x7ffe) return(-INT32_MAX);
+	return((sec<<16)+(int32_t)a->frac-(int32_t)b->frac);
+}
+
+void clock_ntp_add(struct ntp_ts *ts, int32_t d)
+{
+	uint32_t frac;
+
+	frac=(uint32_t)ts->frac+(d & 0xffff);
+	ts->frac=frac;
+	ts->sec+=(d>>16)+(frac>>16);
+}
+
+uint8_t clock_set_ntp_time(const struct ntp_ts *local, const struct ntp_ts *ref)
+{
+	stub_clock_offset=clock_ntp_diff(ref,local);
+	stub_clock_sets++;
+	return(0);
+}
+
+uint32_t stub_clock_ms=0;
+
+void clock_init(void (*tick_callback)(void))
+{
+}
+
+void clock_get_stamp(struct clock_stamp *s)
+{
+	s->t=stub_clock_now.sec;
+	s->ticks=0;
+}
+
+int32_t clock_to_ms(int32_t d)
+{
+	return((d>>16)*1000+(((d & 0xffff)*1000)>>16));
+}
+
+uint32_t clock_get_ms(void)
+{
+	return(stub_clock_ms);
+}
+
+void clock_set_wakeup(uint16_t ms)
+{
+}
+
+int32_t clock_get_drift(void)
+{
+	return(0);
+}
+
+int32_t clock_get_freq(void)
+{
+	return(0);
+}
+
+void clock_restore(time_t t, int32_t freq)
+{
+}
+
+const struct tm *clock_localtime(void)
+{
+	time_t t;
+
+	t=time(NULL);
+	return(localtime(&t));
+}
+
+void clock_localtime_invalidate(void)
+{
+}
+
+void clock_set_dst(int (*dst)(const time_t *timer, int32_t *z), time_t (*next_switch)(time_t t))
+{
+	set_dst(dst);
+}
@@ -0,0 +1,27 @@
+/*
+ * dht.c
+ *
+ * Created: 15-10-2026 14:10:48
+ *  Author: Tim Dorssers
+ *
+ * Sensor that returns the values in stub_dht_temperature and
+ * stub_dht_humidity with the status in stub_dht_status.
+ */
+
+#include "dht.h"
+#include "stub.h"
+
+int8_t stub_dht_temperature=21;
+int8_t stub_dht_humidity=50;
+int8_t stub_dht_status=0;
+
+void dht_start(void)
+{
+}
+
+int8_t dht_gettemperaturehumidity(int8_t *temperature, int8_t *humidity)
+{
+	*temperature=stub_dht_temperature;
+	*humidity=stub_dht_humidity;
+	return(stub_dht_status);
+}
@@ -0,0 +1,69 @@
+/*
+ * eeprom.c
+ *
+ * Created: 15-10-2026 10:18:05
+ *  Author: Tim Dorssers
+ *
+ * The EEMEM variables are kept in the eeprom section of the host program,
+ * so they survive a restart of the modules that use them.
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "eewrite.h"
+#include "stub.h"
+
+// start and end of the eeprom section, provided by the linker
+extern uint8_t __start_eeprom[];
+extern uint8_t __stop_eeprom[];
+
+uint16_t stub_eeprom_writes=0;
+uint8_t stub_eewrite_busy=0;
+
+void stub_eeprom_erase(void)
+{
+	memset(__start_eeprom,0xff,__stop_eeprom-__start_eeprom);
+}
+
+// addresses up to E2END are offsets into the section, the old config is
+// at a fixed address
+static uint8_t *stub_eeprom_addr(const void *p)
+{
+	if ((uintptr_t)p<=E2END) return(__start_eeprom+(uintptr_t)p);
+	return((uint8_t *)p);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	memcpy(dst,stub_eeprom_addr(src),n);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	const uint8_t *s=src;
+	uint8_t *d=stub_eeprom_addr(dst);
+
+	while(n){
+		if (*d!=*s){
+			*d=*s;
+			stub_eeprom_writes++;
+		}
+		s++;
+		d++;
+		n--;
+	}
+}
+
+// written at once, the ram can be reused right away
+uint8_t eewrite(void *ee, const void *ram, uint8_t len)
+{
+	if (stub_eewrite_busy) return(0);
+	eeprom_update_block(ram,ee,len);
+	return(1);
+}
+
+uint8_t eewrite_busy(void)
+{
+	return(stub_eewrite_busy);
+}
@@ -0,0 +1,145 @@
+/*
+ * enc28j60.c
+ *
+ * Created: 15-10-2026 10:20:44
+ *  Author: Tim Dorssers
+ *
+ * Replaces the driver with a queue of received packets and a copy of the
+ * last sent packet, so traffic can be replayed through packetloop. The rx
+ * filter is applied to the queued packets like the driver does.
+ */
+
+#include <string.h>
+#include "enc28j60.h"
+#include "clock.h"
+#include "stub.h"
+
+// number of packets that can be queued
+#define STUB_RX_QUEUE 64
+
+static uint8_t stub_rx[STUB_RX_QUEUE][STUB_PACKET_SIZE];
+static uint16_t stub_rx_len[STUB_RX_QUEUE];
+static uint8_t stub_rx_head=0;
+static uint8_t stub_rx_count=0;
+uint8_t stub_enc28j60_tx[STUB_PACKET_SIZE];
+uint16_t stub_enc28j60_tx_len=0;
+uint16_t stub_enc28j60_tx_count=0;
+uint8_t stub_enc28j60_link=1;
+uint8_t stub_enc28j60_broadcast=0;
+uint16_t stub_enc28j60_rx_rejected=0;
+void (*stub_enc28j60_tx_hook)(const uint8_t *packet, uint16_t len)=NULL;
+static uint8_t (*stub_rx_filter)(uint8_t *buf,uint16_t len)=NULL;
+
+void stub_enc28j60_reset(void)
+{
+	stub_rx_head=0;
+	stub_rx_count=0;
+	stub_enc28j60_tx_len=0;
+	stub_enc28j60_tx_count=0;
+	stub_enc28j60_link=1;
+	stub_enc28j60_rx_rejected=0;
+}
+
+void stub_enc28j60_rx(const uint8_t *packet, uint16_t len)
+{
+	uint8_t i;
+
+	if (stub_rx_count==STUB_RX_QUEUE || len>STUB_PACKET_SIZE) return;
+	i=(stub_rx_head+stub_rx_count)%STUB_RX_QUEUE;
+	memcpy(stub_rx[i],packet,len);
+	stub_rx_len[i]=len;
+	stub_rx_count++;
+}
+
+uint8_t enc28j60hasRxPkt(void)
+{
+	return(stub_rx_count!=0);
+}
+
+uint16_t enc28j60PacketReceive(uint16_t maxlen, uint8_t* packet)
+{
+	uint16_t len;
+	uint8_t *p;
+
+	while(stub_rx_count){
+		p=stub_rx[stub_rx_head];
+		len=stub_rx_len[stub_rx_head];
+		stub_rx_head=(stub_rx_head+1)%STUB_RX_QUEUE;
+		stub_rx_count--;
+		// the filter sees only the headers
+		if (stub_rx_filter && len>=ENC28J60_HEADER_LEN && !(*stub_rx_filter)(p,len)){
+			stub_enc28j60_rx_rejected++;
+			continue;
+		}
+		if (len>maxlen-1) len=maxlen-1;
+		memcpy(packet,p,len);
+		return(len);
+	}
+	return(0);
+}
+
+void enc28j60PacketSend(uint16_t len, uint8_t* packet)
+{
+	enc28j60PacketSendP(len,packet,0,NULL);
+}
+
+void enc28j60PacketSendP(uint16_t len, uint8_t* packet, uint16_t len_p, const char *data_p)
+{
+	if (len+len_p>STUB_PACKET_SIZE) return;
+	memcpy(stub_enc28j60_tx,packet,len);
+	if (len_p) memcpy(&stub_enc28j60_tx[len],data_p,len_p);
+	stub_enc28j60_tx_len=len+len_p;
+	stub_enc28j60_tx_count++;
+	if (stub_enc28j60_tx_hook) (*stub_enc28j60_tx_hook)(stub_enc28j60_tx,stub_enc28j60_tx_len);
+}
+
+void enc28j60Init(uint8_t* macaddr)
+{
+	stub_enc28j60_reset();
+}
+
+void enc28j60setmac(uint8_t* macaddr)
+{
+}
+
+uint8_t enc28j60getrev(void)
+{
+	return(6);
+}
+
+void enc28j60SetRxFilter(uint8_t (*filter)(uint8_t *buf,uint16_t len))
+{
+	stub_rx_filter=filter;
+}
+
+// the pattern match of the chip is left to the rx filter
+void enc28j60SetArpFilter(uint8_t *ip)
+{
+}
+
+void enc28j60EnableBroadcast(void)
+{
+	stub_enc28j60_broadcast=1;
+}
+
+void enc28j60DisableBroadcast(void)
+{
+	stub_enc28j60_broadcast=0;
+}
+
+// both time stamps are the current time of the clock stub
+void enc28j60GetRxStamp(struct clock_stamp *s)
+{
+	s->t=stub_clock_now.sec;
+	s->ticks=0;
+}
+
+void enc28j60GetTxStamp(struct clock_stamp *s)
+{
+	enc28j60GetRxStamp(s);
+}
+
+uint8_t enc28j60linkup(void)
+{
+	return(stub_enc28j60_link);
+}
@@ -0,0 +1,36 @@
+/*
+ * hdlx2416.c
+ *
+ * Created: 15-10-2026 14:10:02
+ *  Author: Tim Dorssers
+ *
+ * Keeps the characters shown on the display in stub_display.
+ */
+
+#include <string.h>
+#include "hdlx2416.h"
+#include "stub.h"
+
+char stub_display[9];
+uint8_t stub_display_intensity=0;
+
+void hdlx2416_init(void)
+{
+	memset(stub_display,' ',8);
+	stub_display[8]='\0';
+}
+
+void hdlx2416_intensity(uint8_t i)
+{
+	stub_display_intensity=i;
+}
+
+void hdlx2416_puts_p(const char *progmem_s)
+{
+	strncpy(stub_display,progmem_s,8);
+}
+
+void hdlx2416_flush(const char *fb)
+{
+	memcpy(stub_display,fb,8);
+}
@@ -0,0 +1,12 @@
+/*
+ * io.c
+ *
+ * Created: 15-10-2026 14:02:37
+ *  Author: Tim Dorssers
+ */
+
+#include <avr/io.h>
+
+volatile uint8_t MCUSR=0;
+volatile uint8_t DDRC=0;
+volatile uint8_t PORTC=0;
@@ -0,0 +1,24 @@
+/*
+ * jitter.c
+ *
+ * Created: 15-10-2026 14:12:09
+ *  Author: Tim Dorssers
+ *
+ * No randomness, so that the tests repeat.
+ */
+
+#include "jitter.h"
+
+void jitter_init(const uint8_t *mac)
+{
+}
+
+uint32_t jitter_below(uint32_t n)
+{
+	return(0);
+}
+
+uint32_t jitter_spread(uint32_t t)
+{
+	return(t);
+}
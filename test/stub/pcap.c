@@ -0,0 +1,111 @@
+/*
+ * pcap.c
+ *
+ * Created: 15-10-2026 14:14:33
+ *  Author: Tim Dorssers
+ *
+ * Reads and writes captures in the classic libpcap format with Ethernet
+ * link type, so traffic can be taken with tcpdump and replayed through the
+ * firmware, or the firmware's traffic opened in wireshark.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "stub.h"
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define PCAP_LINKTYPE_ETHERNET 1
+
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_packet_header {
+	uint32_t sec;
+	uint32_t usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static FILE *stub_pcap_out=NULL;
+static uint32_t stub_pcap_count=0;
+
+static uint32_t swap32(uint32_t x)
+{
+	return((x>>24) | ((x>>8) & 0xff00) | ((x<<8) & 0xff0000) | (x<<24));
+}
+
+uint8_t stub_pcap_open(const char *path)
+{
+	struct pcap_file_header h={PCAP_MAGIC,2,4,0,0,STUB_PACKET_SIZE,PCAP_LINKTYPE_ETHERNET};
+
+	if (stub_pcap_out){
+		fclose(stub_pcap_out);
+		stub_pcap_out=NULL;
+	}
+	if (path==NULL) return(1);
+	stub_pcap_out=fopen(path,"wb");
+	if (stub_pcap_out==NULL) return(0);
+	fwrite(&h,sizeof(h),1,stub_pcap_out);
+	stub_pcap_count=0;
+	return(1);
+}
+
+// the packets are 1 ms apart, the stub clock does not run
+void stub_pcap_write(const uint8_t *packet, uint16_t len)
+{
+	struct pcap_packet_header h;
+
+	if (stub_pcap_out==NULL) return;
+	h.sec=stub_pcap_count/1000;
+	h.usec=stub_pcap_count%1000*1000;
+	h.caplen=len;
+	h.len=len;
+	fwrite(&h,sizeof(h),1,stub_pcap_out);
+	fwrite(packet,len,1,stub_pcap_out);
+	stub_pcap_count++;
+}
+
+int32_t stub_pcap_replay(const char *path, void (*run)(void))
+{
+	static uint8_t packet[STUB_PACKET_SIZE];
+	struct pcap_file_header fh;
+	struct pcap_packet_header h;
+	uint8_t swapped;
+	int32_t n=0;
+	uint32_t len;
+	FILE *f;
+
+	f=fopen(path,"rb");
+	if (f==NULL) return(-1);
+	if (fread(&fh,sizeof(fh),1,f)!=1 || (fh.magic!=PCAP_MAGIC && fh.magic!=PCAP_MAGIC_SWAPPED)){
+		fclose(f);
+		return(-1);
+	}
+	swapped=fh.magic==PCAP_MAGIC_SWAPPED;
+	if ((swapped ? swap32(fh.linktype) : fh.linktype)!=PCAP_LINKTYPE_ETHERNET){
+		fclose(f);
+		return(-1);
+	}
+	while(fread(&h,sizeof(h),1,f)==1){
+		len=swapped ? swap32(h.caplen) : h.caplen;
+		// longer packets than the driver takes are cut
+		if (len>STUB_PACKET_SIZE){
+			if (fread(packet,STUB_PACKET_SIZE,1,f)!=1) break;
+			fseek(f,len-STUB_PACKET_SIZE,SEEK_CUR);
+			len=STUB_PACKET_SIZE;
+		}else if (len && fread(packet,len,1,f)!=1) break;
+		stub_enc28j60_rx(packet,len);
+		(*run)();
+		n++;
+	}
+	fclose(f);
+	return(n);
+}
@@ -0,0 +1,36 @@
+/*
+ * prof.c
+ *
+ * Created: 15-10-2026 14:11:30
+ *  Author: Tim Dorssers
+ *
+ * There are no cpu cycles to count on the host, nothing is measured.
+ */
+
+#include "prof.h"
+
+void prof_begin(void)
+{
+}
+
+void prof_stop(void)
+{
+}
+
+void prof_end(uint8_t phase)
+{
+}
+
+void prof_hold(uint8_t hold)
+{
+}
+
+uint8_t prof_get(uint8_t phase, uint32_t *min, uint32_t *avg, uint32_t *max)
+{
+	return(0);
+}
+
+const char *prof_get_name_p(uint8_t phase)
+{
+	return("");
+}
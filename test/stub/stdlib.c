@@ -0,0 +1,52 @@
+/*
+ * stdlib.c
+ *
+ * Created: 15-10-2026 10:24:02
+ *  Author: Tim Dorssers
+ */
+
+#include <stdlib.h>
+
+char *ultoa(unsigned long val, char *s, int radix)
+{
+	char *p=s;
+	char *q=s;
+	char c;
+	unsigned long u=val;
+
+	do{
+		c=u%radix;
+		*p++=c<10 ? '0'+c : 'a'+c-10;
+		u/=radix;
+	}while(u);
+	*p--='\0';
+	// the digits came out backwards
+	while(q<p){
+		c=*q;
+		*q++=*p;
+		*p--=c;
+	}
+	return(s);
+}
+
+char *ltoa(long val, char *s, int radix)
+{
+	if (val<0 && radix==10){
+		*s='-';
+		ultoa(-(unsigned long)val,s+1,radix);
+		return(s);
+	}
+	return(ultoa(val,s,radix));
+}
+
+char *itoa(int val, char *s, int radix)
+{
+	// like avr-libc, other radixes show the bits of a negative int
+	if (radix!=10) return(ultoa((unsigned int)val,s,radix));
+	return(ltoa(val,s,radix));
+}
+
+char *utoa(unsigned int val, char *s, int radix)
+{
+	return(ultoa(val,s,radix));
+}
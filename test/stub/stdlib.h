@@ -0,0 +1,20 @@
+/*
+ * stdlib.h
+ *
+ * Created: 15-10-2026 10:14:50
+ *  Author: Tim Dorssers
+ *
+ * Adds the non standard conversions of avr-libc to the host <stdlib.h>.
+ */
+
+#ifndef STUB_STDLIB_H_
+#define STUB_STDLIB_H_
+
+#include_next <stdlib.h>
+
+extern char *itoa(int val, char *s, int radix);
+extern char *ltoa(long val, char *s, int radix);
+extern char *utoa(unsigned int val, char *s, int radix);
+extern char *ultoa(unsigned long val, char *s, int radix);
+
+#endif /* STUB_STDLIB_H_ */
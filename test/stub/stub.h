@@ -0,0 +1,82 @@
+/*
+ * stub.h
+ *
+ * Created: 15-10-2026 10:16:37
+ *  Author: Tim Dorssers
+ *
+ * Host replacements of the hardware drivers that the tested modules call,
+ * with the hooks the tests use to feed and inspect them.
+ */
+
+#ifndef STUB_H_
+#define STUB_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "../../ip_arp_udp_tcp.h"
+
+// largest packet the enc28j60 stub keeps
+#define STUB_PACKET_SIZE 1518
+
+// fills all EEMEM variables with 0xff, like an erased eeprom
+extern void stub_eeprom_erase(void);
+// number of eeprom bytes that eewrite changed
+extern uint16_t stub_eeprom_writes;
+// makes eewrite report busy and refuse writes
+extern uint8_t stub_eewrite_busy;
+
+// queues a packet that enc28j60PacketReceive returns
+extern void stub_enc28j60_rx(const uint8_t *packet, uint16_t len);
+// the last packet that was sent and its length, 0 if none since the reset
+extern uint8_t stub_enc28j60_tx[STUB_PACKET_SIZE];
+extern uint16_t stub_enc28j60_tx_len;
+// number of packets sent since the reset
+extern uint16_t stub_enc28j60_tx_count;
+// link state that enc28j60linkup returns, 1 after the reset
+extern uint8_t stub_enc28j60_link;
+// forgets the queued and sent packets
+extern void stub_enc28j60_reset(void);
+// broadcast reception of the driver, 0 after the reset
+extern uint8_t stub_enc28j60_broadcast;
+// queued packets that the rx filter dropped since the reset
+extern uint16_t stub_enc28j60_rx_rejected;
+// called with every packet that is sent, may be NULL
+extern void (*stub_enc28j60_tx_hook)(const uint8_t *packet, uint16_t len);
+
+// writes packets to a capture file in pcap format, returns 0 if the file
+// cannot be created. A NULL path closes the file.
+extern uint8_t stub_pcap_open(const char *path);
+// appends a packet to the capture file if it is open
+extern void stub_pcap_write(const uint8_t *packet, uint16_t len);
+// queues the packets of a capture file one by one and calls run after each
+// of them, returns the number of packets or -1 if the file is no capture
+extern int32_t stub_pcap_replay(const char *path, void (*run)(void));
+
+// local time that the clock returns, also used for the packet time stamps
+extern struct ntp_ts stub_clock_now;
+// correction of the last clock_set_ntp_time call, ref minus local
+extern int32_t stub_clock_offset;
+// number of clock_set_ntp_time calls
+extern uint8_t stub_clock_sets;
+// milliseconds that clock_get_ms returns
+extern uint32_t stub_clock_ms;
+
+// time that time() returns, in seconds since 2000 like avr-libc
+extern time_t stub_time;
+
+// values of the next sensor read out and its status
+extern int8_t stub_dht_temperature;
+extern int8_t stub_dht_humidity;
+extern int8_t stub_dht_status;
+
+// characters on the display and its intensity
+extern char stub_display[9];
+extern uint8_t stub_display_intensity;
+
+// characters sent to the uart, terminated with '\0'
+#define STUB_UART_SIZE 4096
+extern char stub_uart[STUB_UART_SIZE];
+// forgets the characters sent to the uart
+extern void stub_uart_clear(void);
+
+#endif /* STUB_H_ */
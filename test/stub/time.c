@@ -0,0 +1,44 @@
+/*
+ * time.c
+ *
+ * Created: 15-10-2026 14:06:52
+ *  Author: Tim Dorssers
+ */
+
+#include <time.h>
+#include "stub.h"
+
+time_t stub_time=0;
+static int32_t stub_zone=0;
+static int (*stub_dst)(const time_t *timer, int32_t *z)=NULL;
+
+time_t stub_time_get(time_t *timer)
+{
+	if (timer) *timer=stub_time;
+	return(stub_time);
+}
+
+// the host gmtime_r does the calendar, the zone and dst are added first
+struct tm *stub_localtime(const time_t *timer)
+{
+	static struct tm tm;
+	time_t t;
+	int32_t z=stub_zone;
+	int dst=0;
+
+	if (stub_dst) dst=(*stub_dst)(timer,&z);
+	t=*timer+stub_zone+dst+UNIX_OFFSET;
+	gmtime_r(&t,&tm);
+	tm.tm_isdst=dst!=0;
+	return(&tm);
+}
+
+void set_zone(int32_t z)
+{
+	stub_zone=z;
+}
+
+void set_dst(int (*dst)(const time_t *timer, int32_t *z))
+{
+	stub_dst=dst;
+}
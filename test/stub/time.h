@@ -0,0 +1,30 @@
+/*
+ * time.h
+ *
+ * Created: 15-10-2026 14:04:25
+ *  Author: Tim Dorssers
+ *
+ * Adds the avr-libc extensions to the host <time.h>. time() and localtime()
+ * count from 2000 like avr-libc, time() returns stub_time.
+ */
+
+#ifndef STUB_TIME_H_
+#define STUB_TIME_H_
+
+#include_next <time.h>
+#include <stdint.h>
+
+#define UNIX_OFFSET 946684800
+#define NTP_OFFSET 3155673600
+#define ONE_HOUR 3600
+#define ONE_DAY 86400
+
+#define time(timer) stub_time_get(timer)
+#define localtime(timer) stub_localtime(timer)
+
+extern time_t stub_time_get(time_t *timer);
+extern struct tm *stub_localtime(const time_t *timer);
+extern void set_zone(int32_t z);
+extern void set_dst(int (*dst)(const time_t *timer, int32_t *z));
+
+#endif /* STUB_TIME_H_ */
@@ -0,0 +1,44 @@
+/*
+ * uart.c
+ *
+ * Created: 15-10-2026 14:09:15
+ *  Author: Tim Dorssers
+ *
+ * Collects what is sent to the uart in stub_uart, nothing is received.
+ */
+
+#include "uart.h"
+#include "stub.h"
+
+char stub_uart[STUB_UART_SIZE];
+static uint16_t stub_uart_len=0;
+
+void stub_uart_clear(void)
+{
+	stub_uart_len=0;
+	stub_uart[0]='\0';
+}
+
+void uart0_init(uint16_t baudrate)
+{
+	stub_uart_clear();
+}
+
+uint16_t uart0_getc(void)
+{
+	return(UART_NO_DATA);
+}
+
+// characters that do not fit are dropped
+void uart0_putc(uint8_t data)
+{
+	if (stub_uart_len==STUB_UART_SIZE-1) return;
+	stub_uart[stub_uart_len++]=data;
+	stub_uart[stub_uart_len]='\0';
+}
+
+// the buffer is emptied at once
+uint16_t uart0_tx_free(void)
+{
+	return(UART_TX0_BUFFER_SIZE-1);
+}
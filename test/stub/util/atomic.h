@@ -0,0 +1,17 @@
+/*
+ * atomic.h
+ *
+ * Created: 15-10-2026 10:14:22
+ *  Author: Tim Dorssers
+ *
+ * Host replacement of <util/atomic.h>, there are no interrupts.
+ */
+
+#ifndef STUB_ATOMIC_H_
+#define STUB_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for(uint8_t _atomic_once=1;_atomic_once;_atomic_once=0)
+
+#endif /* STUB_ATOMIC_H_ */
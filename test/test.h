@@ -0,0 +1,32 @@
+/*
+ * test.h
+ *
+ * Created: 15-10-2026 14:20:11
+ *  Author: Tim Dorssers
+ *
+ * Shared by the test files, the checks are counted in test_main.c.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdint.h>
+
+#define CHECK(cond) check((cond),#cond,__FILE__,__LINE__)
+
+// in ip_arp_udp_tcp.c, it has no prototype in the header
+extern uint16_t checksum(uint8_t *buf, uint16_t len,uint8_t type);
+
+extern void check(int ok, const char *cond, const char *file, int line);
+// monotonic host time in nanoseconds
+extern uint64_t test_ns(void);
+
+// test_pages.c, which builds main.c of the firmware
+extern void test_pages(void);
+// prints the size and host time of every page
+extern void bench_pages(void);
+// feeds a capture to the firmware, its replies are written to out unless
+// it is NULL. Returns 1 if path could not be read.
+extern int replay_pages(const char *path, const char *out);
+
+#endif /* TEST_H_ */
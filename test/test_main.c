@@ -0,0 +1,699 @@
+/*
+ * test_main.c
+ *
+ * Created: 15-10-2026 10:31:47
+ *  Author: Tim Dorssers
+ *
+ * Host tests of the modules that do not touch the hardware. The drivers
+ * they call are replaced by the stubs in stub/, see stub.h. Build and run
+ * with make -C test, the exit status is 1 if a check failed. The web pages
+ * of main.c are tested in test_pages.c.
+ *
+ * test_main -b prints the host time per call of the parsers and per page,
+ * test_main -r in.pcap [-w out.pcap] feeds a capture to the firmware. The
+ * times are of the host cpu, on the ATmega328p the profiler of prof.c
+ * gives the cycles.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "ip_arp_udp_tcp.h"
+#include "websrv_help_functions.h"
+#include "dht_log.h"
+#include "nvstate.h"
+#include "ntp_client.h"
+#include "dhcp_client.h"
+#include "dnslkup.h"
+#include "clock.h"
+#include "enc28j60.h"
+#include "stub.h"
+#include "test.h"
+
+// same as in ip_arp_udp_tcp.c
+#define NTP_ORIGINATE_TS_P (UDP_DATA_P+24)
+#define NTP_RECEIVE_TS_P (UDP_DATA_P+32)
+#define NTP_TRANSMIT_TS_P (UDP_DATA_P+40)
+
+static uint16_t checks=0;
+static uint16_t failures=0;
+static uint8_t buf[STUB_PACKET_SIZE+1];
+
+static uint8_t mymac[6]={0x54,0x55,0x58,0x10,0x00,0x29};
+static uint8_t myip[4]={192,168,1,10};
+static uint8_t mynetmask[4]={255,255,255,0};
+static uint8_t peermac[6]={0x00,0x11,0x22,0x33,0x44,0x55};
+static uint8_t peerip[4]={192,168,1,20};
+
+void check(int ok, const char *cond, const char *file, int line)
+{
+	checks++;
+	if (!ok){
+		failures++;
+		printf("%s:%d: check failed: %s\n",file,line,cond);
+	}
+}
+
+uint64_t test_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return((uint64_t)ts.tv_sec*1000000000+ts.tv_nsec);
+}
+
+static void test_checksum(void)
+{
+	// an ip header without its checksum, which is 0xb861
+	uint8_t hdr[20]={0x45,0x00,0x00,0x73,0x00,0x00,0x40,0x00,0x40,0x11,0x00,0x00,0xc0,0xa8,0x00,0x01,0xc0,0xa8,0x00,0xc7};
+	uint8_t odd[3]={0x01,0x02,0x03};
+
+	CHECK(checksum(hdr,20,0)==0xb861);
+	hdr[10]=0xb8;
+	hdr[11]=0x61;
+	CHECK(checksum(hdr,20,0)==0);
+	// the last byte is padded with zero
+	CHECK(checksum(odd,3,0)==0xfbfd);
+}
+
+static void test_find_key_val(void)
+{
+	char url[]="pg=3&s=abc&tz=60 HTTP/1.1\r\n";
+	char val[8];
+
+	CHECK(find_key_val(url,val,sizeof(val),"s")==1 && strcmp(val,"abc")==0);
+	CHECK(find_key_val(url,val,sizeof(val),"pg")==1 && strcmp(val,"3")==0);
+	CHECK(find_key_val(url,val,sizeof(val),"tz")==1 && strcmp(val,"60")==0);
+	// a key that only ends like one that is there
+	CHECK(find_key_val(url,val,sizeof(val),"z")==0);
+	CHECK(find_key_val(url,val,sizeof(val),"x")==0);
+	// the value is cut to fit
+	CHECK(find_key_val(url,val,3,"s")==1 && strcmp(val,"ab")==0);
+}
+
+static void test_urldecode(void)
+{
+	char s1[]="hello%20joe";
+	char s2[]="hello+joe%3a%3D";
+
+	urldecode(s1);
+	CHECK(strcmp(s1,"hello joe")==0);
+	urldecode(s2);
+	CHECK(strcmp(s2,"hello joe:=")==0);
+}
+
+static void test_base64_decode(void)
+{
+	char s1[]="YWRtaW46c2VjcmV0";
+	char s2[]="YWRtaW46cHc=";
+	char s3[]="";
+
+	base64_decode(s1);
+	CHECK(strcmp(s1,"admin:secret")==0);
+	base64_decode(s2);
+	CHECK(strcmp(s2,"admin:pw")==0);
+	base64_decode(s3);
+	CHECK(s3[0]=='\0');
+}
+
+static const char PROGMEM test_keys[][KEY_VAL_KEY_SIZE]={"ma","nt","tz"};
+static char test_vals[3][24];
+static uint8_t test_calls;
+
+static void test_key_val(uint8_t key, char *val)
+{
+	strncpy(test_vals[key],val,sizeof(test_vals[key])-1);
+	test_calls++;
+}
+
+static void test_parse_key_vals(void)
+{
+	char body[]="nt=pool.ntp.org&xx=1&tz=UTC%2B01%3A00&ma=&novalue&nt=x+y HTTP/1.1\r\n";
+
+	memset(test_vals,0,sizeof(test_vals));
+	test_calls=0;
+	parse_key_vals(body,test_keys,3,test_key_val);
+	// unknown keys and pairs without a value are skipped
+	CHECK(test_calls==4);
+	CHECK(strcmp(test_vals[0],"")==0);
+	CHECK(strcmp(test_vals[1],"x y")==0);
+	CHECK(strcmp(test_vals[2],"UTC+01:00")==0);
+	// the scan stops at the end of the url
+	test_calls=0;
+	parse_key_vals(" nt=a",test_keys,3,test_key_val);
+	CHECK(test_calls==0);
+}
+
+static void test_dht_log(void)
+{
+	struct dht_log_pos pos;
+	struct dht_log_stat stat;
+	time_t t=1000L*DHT_LOG_INTERVAL;
+	uint16_t i;
+
+	dht_log_clear();
+	CHECK(dht_log_get_count()==0);
+	CHECK(dht_log_seek(&pos,0)==0);
+	dht_log_add(t,20,50);
+	// the first reading of an interval is kept
+	dht_log_add(t+10,25,55);
+	CHECK(dht_log_get_count()==1);
+	dht_log_add(t+DHT_LOG_INTERVAL+10,21,48);
+	CHECK(dht_log_get_count()==2);
+	CHECK(dht_log_seek(&pos,0)==1 && pos.t==t && pos.temperature==20 && pos.humidity==50);
+	CHECK(dht_log_next(&pos)==1 && pos.t==t+DHT_LOG_INTERVAL && pos.temperature==21 && pos.humidity==48);
+	CHECK(dht_log_next(&pos)==0);
+	// missed intervals repeat the previous sample
+	dht_log_add(t+4*DHT_LOG_INTERVAL,22,48);
+	CHECK(dht_log_get_count()==5);
+	CHECK(dht_log_seek(&pos,3)==1 && pos.temperature==21);
+	CHECK(dht_log_next(&pos)==1 && pos.temperature==22);
+	// a large change is stored as the values
+	dht_log_add(t+5*DHT_LOG_INTERVAL,40,40);
+	CHECK(dht_log_seek(&pos,5)==1 && pos.temperature==40 && pos.humidity==40);
+	dht_log_add(t+6*DHT_LOG_INTERVAL,40,40);
+	CHECK(dht_log_seek(&pos,6)==1 && pos.temperature==40);
+	// the difference of the escape byte is stored as the values too
+	dht_log_add(t+7*DHT_LOG_INTERVAL,32,40);
+	CHECK(dht_log_next(&pos)==1 && pos.temperature==32 && pos.humidity==40);
+	dht_log_add(t+8*DHT_LOG_INTERVAL,31,41);
+	CHECK(dht_log_next(&pos)==1 && pos.temperature==31 && pos.humidity==41);
+	CHECK(dht_log_get_free()==DHT_LOG_SIZE-13);
+	CHECK(dht_log_get_stat(&stat)==9);
+	CHECK(stat.low_temp==20 && stat.low_temp_t==t);
+	CHECK(stat.high_temp==40 && stat.high_temp_t==t+5*DHT_LOG_INTERVAL);
+	CHECK(stat.low_hum==40 && stat.high_hum==50);
+	// a full ring drops the oldest samples
+	dht_log_clear();
+	i=0;
+	while(i<DHT_LOG_SIZE+10){
+		dht_log_add(t+(time_t)i*DHT_LOG_INTERVAL,i%8,50);
+		i++;
+	}
+	CHECK(dht_log_get_count()==DHT_LOG_SIZE && dht_log_get_free()==0);
+	CHECK(dht_log_seek(&pos,0)==1 && pos.t==t+10L*DHT_LOG_INTERVAL && pos.temperature==2);
+	CHECK(dht_log_seek(&pos,DHT_LOG_SIZE-1)==1 && pos.temperature==(DHT_LOG_SIZE+9)%8);
+	// an escaped sample drops as many one byte samples as it needs
+	dht_log_add(t+(time_t)i*DHT_LOG_INTERVAL,40,50);
+	CHECK(dht_log_get_count()==DHT_LOG_SIZE-2 && dht_log_get_free()==0);
+	CHECK(dht_log_seek(&pos,0)==1 && pos.t==t+13L*DHT_LOG_INTERVAL && pos.temperature==5);
+	CHECK(dht_log_seek(&pos,DHT_LOG_SIZE-3)==1 && pos.temperature==40 && pos.humidity==50);
+	// and a ring of escaped samples holds a third of them
+	i=0;
+	while(i<DHT_LOG_SIZE){
+		dht_log_add(t+(time_t)(DHT_LOG_SIZE+11+i)*DHT_LOG_INTERVAL,(i & 1) ? 40 : 0,(i & 1) ? 0 : 90);
+		i++;
+	}
+	CHECK(dht_log_get_count()==DHT_LOG_SIZE/DHT_LOG_MAX_LEN);
+	CHECK(dht_log_seek(&pos,0)==1 && pos.temperature==0 && pos.humidity==90);
+	CHECK(dht_log_next(&pos)==1 && pos.temperature==40 && pos.humidity==0);
+	CHECK(dht_log_seek(&pos,DHT_LOG_SIZE/DHT_LOG_MAX_LEN-1)==1 && pos.temperature==40);
+	CHECK(pos.t==t+(time_t)(2*DHT_LOG_SIZE+10)*DHT_LOG_INTERVAL);
+	// setting the clock back by more than the span starts over
+	dht_log_add(t-(time_t)DHT_LOG_SIZE*DHT_LOG_INTERVAL,20,50);
+	CHECK(dht_log_get_count()==1);
+}
+
+static void test_nvstate(void)
+{
+	struct nvstate s;
+	uint8_t i;
+
+	stub_eeprom_erase();
+	nvstate_init();
+	CHECK(nvstate_get_count()==0);
+	CHECK(nvstate_read(0,&s)==0);
+	memset(&s,0,sizeof(s));
+	i=1;
+	while(i<=3){
+		s.t=i*NVSTATE_INTERVAL;
+		s.freq=i;
+		CHECK(nvstate_write(&s)==1);
+		i++;
+	}
+	CHECK(nvstate_get_count()==3);
+	// the ring is found back after a reset
+	nvstate_init();
+	CHECK(nvstate_get_count()==3);
+	CHECK(nvstate_read(0,&s)==1 && s.freq==1);
+	CHECK(nvstate_read(2,&s)==1 && s.freq==3 && s.t==3*NVSTATE_INTERVAL);
+	CHECK(nvstate_read(3,&s)==0);
+	// nothing is written while eeprom is busy
+	stub_eewrite_busy=1;
+	CHECK(nvstate_write(&s)==0);
+	stub_eewrite_busy=0;
+	// wrapping around keeps the newest slots
+	i=4;
+	while(i<=NVSTATE_SLOTS+5){
+		s.freq=i;
+		CHECK(nvstate_write(&s)==1);
+		i++;
+	}
+	nvstate_init();
+	CHECK(nvstate_get_count()==NVSTATE_SLOTS);
+	CHECK(nvstate_read(0,&s)==1 && s.freq==6);
+	CHECK(nvstate_read(NVSTATE_SLOTS-1,&s)==1 && s.freq==NVSTATE_SLOTS+5);
+}
+
+// stores a time stamp in network byte order
+static void put_ntp_ts(uint8_t *p, const struct ntp_ts *ts)
+{
+	p[0]=ts->sec>>24;
+	p[1]=ts->sec>>16;
+	p[2]=ts->sec>>8;
+	p[3]=ts->sec;
+	p[4]=ts->frac>>8;
+	p[5]=ts->frac;
+	p[6]=0;
+	p[7]=0;
+}
+
+// answers the request that was sent at org from server ip on port_l, the
+// server clock is offset ahead and the round trip takes delay. Both are in
+// units of 1/65536 second. Moves the clock to the arrival of the answer.
+static uint8_t ntp_answer(const uint8_t *ip, uint8_t port_l, const struct ntp_ts *org, int32_t offset, int32_t delay)
+{
+	struct ntp_ts ts;
+
+	memset(buf,0,UDP_DATA_P+48);
+	memcpy(&buf[IP_SRC_P],ip,4);
+	memcpy(&buf[IP_DST_P],myip,4);
+	buf[UDP_SRC_PORT_L_P]=0x7b;
+	buf[UDP_DST_PORT_H_P]=10;
+	buf[UDP_DST_PORT_L_P]=port_l;
+	buf[UDP_LEN_L_P]=56;
+	buf[UDP_DATA_P]=0x24; // version 4, server
+	buf[UDP_DATA_P+1]=1; // stratum
+	put_ntp_ts(&buf[NTP_ORIGINATE_TS_P],org);
+	ts=*org;
+	clock_ntp_add(&ts,delay/2+offset);
+	put_ntp_ts(&buf[NTP_RECEIVE_TS_P],&ts);
+	put_ntp_ts(&buf[NTP_TRANSMIT_TS_P],&ts);
+	stub_clock_now=*org;
+	clock_ntp_add(&stub_clock_now,delay);
+	return(ntp_client_process_answer(buf));
+}
+
+static void test_ntp_client(void)
+{
+	uint8_t ip[NTP_MAX_SERVERS][4]={{10,0,0,1},{10,0,0,2},{10,0,0,3},{10,0,0,4}};
+	struct ntp_ts org;
+	uint8_t peer[4];
+	int32_t offset,delay,jitter;
+	uint8_t i,j;
+
+	stub_enc28j60_reset();
+	ntp_client_init();
+	i=0;
+	while(i<NTP_MAX_SERVERS){
+		CHECK(ntp_client_add_server(ip[i])==1);
+		i++;
+	}
+	CHECK(ntp_client_add_server(ip[0])==1);
+	CHECK(ntp_client_add_server(peerip)==0);
+	CHECK(ntp_client_get_peer()==NULL);
+	CHECK(ntp_client_waiting()==0);
+	stub_clock_now.sec=3900000000UL;
+	stub_clock_now.frac=0;
+	// the first answer sets a clock that is far off
+	org=stub_clock_now;
+	ntp_client_request(buf,20,peermac);
+	CHECK(stub_enc28j60_tx_count==NTP_MAX_SERVERS);
+	CHECK(ntp_client_waiting()==1);
+	CHECK(ntp_answer(ip[0],20,&org,2000L*65536,1000)==2);
+	CHECK(stub_clock_sets==1);
+	CHECK(ntp_client_waiting()==0);
+	// three servers agree on a quarter second, the fourth is a falseticker
+	j=0;
+	while(j<NTP_SAMPLES){
+		org=stub_clock_now;
+		ntp_client_request(buf,20,peermac);
+		i=0;
+		while(i<NTP_MAX_SERVERS){
+			CHECK(ntp_answer(ip[i],20+i,&org,i==3 ? 3L*65536 : 16384+8*i+j,1000+100*i+50*j)==1);
+			i++;
+		}
+		j++;
+	}
+	CHECK(ntp_client_update(peer,&offset,&delay,&jitter)==3);
+	CHECK(memcmp(peer,ip[0],4)==0 && ntp_client_get_peer()!=NULL);
+	CHECK(offset==16384 && delay==1000);
+	CHECK(jitter==2);
+	CHECK(stub_clock_sets==2 && stub_clock_offset==16384);
+	// an answer is accepted once and only from its server
+	org=stub_clock_now;
+	ntp_client_request(buf,20,peermac);
+	CHECK(ntp_answer(ip[1],20,&org,0,1000)==0);
+	CHECK(ntp_answer(ip[1],21,&org,0,1000)==1);
+	CHECK(ntp_answer(ip[1],21,&org,0,1000)==0);
+	// once synchronized large offsets are rejected
+	CHECK(ntp_answer(ip[2],22,&org,2000L*65536,1000)==0);
+	CHECK(ntp_client_update(peer,&offset,&delay,&jitter)==1);
+	CHECK(ntp_client_update(peer,&offset,&delay,&jitter)==0);
+}
+
+// arp request of the peer for ip
+static uint16_t make_arp_request(const uint8_t *ip)
+{
+	memset(buf,0,42);
+	memset(&buf[ETH_DST_MAC],0xff,6);
+	memcpy(&buf[ETH_SRC_MAC],peermac,6);
+	buf[ETH_TYPE_H_P]=ETHTYPE_ARP_H_V;
+	buf[ETH_TYPE_L_P]=ETHTYPE_ARP_L_V;
+	buf[ETH_ARP_P+1]=1; // ethernet
+	buf[ETH_ARP_P+2]=0x08; // ip
+	buf[ETH_ARP_P+4]=6;
+	buf[ETH_ARP_P+5]=4;
+	buf[ETH_ARP_OPCODE_L_P]=ETH_ARP_OPCODE_REQ_L_V;
+	memcpy(&buf[ETH_ARP_SRC_MAC_P],peermac,6);
+	memcpy(&buf[ETH_ARP_SRC_IP_P],peerip,4);
+	memcpy(&buf[ETH_ARP_DST_IP_P],ip,4);
+	return(42);
+}
+
+// ping of the peer to ip with 32 data bytes
+static uint16_t make_echo_request(const uint8_t *ip)
+{
+	uint16_t ck;
+
+	memset(buf,0,ICMP_DATA_P+32);
+	memcpy(&buf[ETH_DST_MAC],mymac,6);
+	memcpy(&buf[ETH_SRC_MAC],peermac,6);
+	buf[ETH_TYPE_H_P]=ETHTYPE_IP_H_V;
+	buf[ETH_TYPE_L_P]=ETHTYPE_IP_L_V;
+	buf[IP_HEADER_LEN_VER_P]=0x45;
+	buf[IP_TOTLEN_L_P]=20+8+32;
+	buf[IP_TTL_P]=64;
+	buf[IP_PROTO_P]=IP_PROTO_ICMP_V;
+	memcpy(&buf[IP_SRC_P],peerip,4);
+	memcpy(&buf[IP_DST_P],ip,4);
+	ck=checksum(&buf[IP_P],IP_HEADER_LEN,0);
+	buf[IP_CHECKSUM_P]=ck>>8;
+	buf[IP_CHECKSUM_P+1]=ck;
+	buf[ICMP_TYPE_P]=ICMP_TYPE_ECHOREQUEST_V;
+	buf[ICMP_IDENT_L_P]=1;
+	memset(&buf[ICMP_DATA_P],PINGPATTERN,32);
+	ck=checksum(&buf[ICMP_TYPE_P],8+32,0);
+	buf[ICMP_CHECKSUM_H_P]=ck>>8;
+	buf[ICMP_CHECKSUM_L_P]=ck;
+	return(ICMP_DATA_P+32);
+}
+
+// hands every queued packet to packetloop like the main loop does
+static void replay(void)
+{
+	uint16_t plen;
+
+	while((plen=enc28j60PacketReceive(sizeof(buf),buf))){
+		packetloop_arp_icmp_tcp(buf,plen);
+	}
+}
+
+static void test_packetloop(void)
+{
+	uint8_t otherip[4]={192,168,1,11};
+	uint8_t *tx=stub_enc28j60_tx;
+	uint8_t i;
+
+	stub_enc28j60_reset();
+	init_udp_or_www_server(mymac,myip);
+	client_ifconfig(myip,mynetmask);
+	// an arp request is answered
+	stub_enc28j60_rx(buf,make_arp_request(myip));
+	replay();
+	CHECK(stub_enc28j60_tx_count==1 && stub_enc28j60_tx_len==42);
+	CHECK(memcmp(&tx[ETH_DST_MAC],peermac,6)==0 && memcmp(&tx[ETH_SRC_MAC],mymac,6)==0);
+	CHECK(tx[ETH_ARP_OPCODE_L_P]==ETH_ARP_OPCODE_REPLY_L_V);
+	CHECK(memcmp(&tx[ETH_ARP_SRC_MAC_P],mymac,6)==0 && memcmp(&tx[ETH_ARP_SRC_IP_P],myip,4)==0);
+	CHECK(memcmp(&tx[ETH_ARP_DST_IP_P],peerip,4)==0);
+	// the sender was learned
+	CHECK(arp_cache_lookup(peerip)!=NULL && memcmp(arp_cache_lookup(peerip),peermac,6)==0);
+	// a ping gets a pong with valid checksums
+	stub_enc28j60_reset();
+	stub_enc28j60_rx(buf,make_echo_request(myip));
+	replay();
+	CHECK(stub_enc28j60_tx_count==1 && stub_enc28j60_tx_len==ICMP_DATA_P+32);
+	CHECK(tx[ICMP_TYPE_P]==ICMP_TYPE_ECHOREPLY_V);
+	CHECK(memcmp(&tx[IP_DST_P],peerip,4)==0 && memcmp(&tx[IP_SRC_P],myip,4)==0);
+	CHECK(checksum(&tx[IP_P],IP_HEADER_LEN,0)==0);
+	CHECK(checksum(&tx[ICMP_TYPE_P],8+32,0)==0);
+	// a storm of packets for other hosts gets no answer, it goes through a
+	// capture file like traffic taken with tcpdump
+	stub_enc28j60_reset();
+	CHECK(stub_pcap_open("test_storm.pcap")==1);
+	i=0;
+	while(i<40){
+		stub_pcap_write(buf,make_arp_request(otherip));
+		stub_pcap_write(buf,make_echo_request(otherip));
+		i++;
+	}
+	stub_pcap_open(NULL);
+	CHECK(stub_pcap_replay("test_storm.pcap",replay)==80);
+	CHECK(stub_enc28j60_tx_count==0);
+	CHECK(stub_pcap_replay("test_main.c",replay)==-1);
+}
+
+// answer of the dns server to the request in the tx buffer: flags, a
+// CNAME and two A records with their time to live
+static uint16_t dns_answer(uint8_t flags)
+{
+	const uint8_t cname[12]={0xc0,0x0c,0,5,0,1,0,0,0x0e,0x10,0,2};
+	const uint8_t a[2][10]={{0xc0,0x0c,0,1,0,1,0,0,0x01,0x2c},{0xc0,0x0c,0,1,0,1,0,0,0,0x78}};
+	uint16_t plen;
+
+	memcpy(buf,stub_enc28j60_tx,stub_enc28j60_tx_len);
+	buf[UDP_DST_PORT_H_P]=buf[UDP_SRC_PORT_H_P];
+	buf[UDP_DST_PORT_L_P]=buf[UDP_SRC_PORT_L_P];
+	buf[UDP_SRC_PORT_H_P]=0;
+	buf[UDP_SRC_PORT_L_P]=53;
+	buf[UDP_DATA_P+2]=0x81;
+	buf[UDP_DATA_P+3]=flags;
+	buf[UDP_DATA_P+7]=3;
+	plen=UDP_DATA_P+12+buf[UDP_DATA_P];
+	memcpy(&buf[plen],cname,12);
+	plen+=14; // the name is a pointer too
+	buf[plen-2]=0xc0;
+	buf[plen-1]=0x0c;
+	memcpy(&buf[plen],a[0],10);
+	buf[plen+10]=0;
+	buf[plen+11]=4;
+	memcpy(&buf[plen+12],"\x0a\x00\x00\x05",4);
+	plen+=16;
+	memcpy(&buf[plen],a[1],10);
+	buf[plen+10]=0;
+	buf[plen+11]=4;
+	memcpy(&buf[plen+12],"\x0a\x00\x00\x06",4);
+	return(plen+16);
+}
+
+static void test_dnslkup(void)
+{
+	uint8_t dns[4]={192,168,1,1};
+	uint8_t ip[4];
+	uint8_t *tx=stub_enc28j60_tx;
+
+	stub_enc28j60_reset();
+	init_udp_or_www_server(mymac,myip);
+	init_dnslkup(dns);
+	CHECK(dnslkup_request(buf,"time.example.org",peermac)==0);
+	CHECK(stub_enc28j60_tx_count==1 && memcmp(&tx[IP_DST_P],dns,4)==0 && tx[UDP_DST_PORT_L_P]==53);
+	CHECK(tx[UDP_DATA_P+12]==4 && memcmp(&tx[UDP_DATA_P+13],"time",4)==0 && tx[UDP_DATA_P+17]==7);
+	CHECK(dnslkup_haveanswer()==0);
+	CHECK(udp_client_check_for_dns_answer(buf,dns_answer(0x80))==1);
+	CHECK(dnslkup_haveanswer()==1 && dnslkup_get_error_info()==0);
+	CHECK(dnslkup_get_ip_count()==2);
+	dnslkup_get_ip(ip);
+	CHECK(memcmp(ip,"\x0a\x00\x00\x05",4)==0);
+	dnslkup_get_ip_n(1,ip);
+	CHECK(memcmp(ip,"\x0a\x00\x00\x06",4)==0);
+	// the lowest time to live of the addresses, not that of the CNAME
+	CHECK(dnslkup_get_ttl()==120);
+	// an error of the server
+	CHECK(dnslkup_request(buf,"nothing.example.org",peermac)==0);
+	CHECK(udp_client_check_for_dns_answer(buf,dns_answer(0x83))==0);
+	CHECK(dnslkup_haveanswer()==0 && dnslkup_get_error_info()==1);
+	// an answer to an older request
+	CHECK(dnslkup_request(buf,"time.example.org",peermac)==0);
+	dns_answer(0x80);
+	CHECK(dnslkup_request(buf,"time.example.org",peermac)==0);
+	CHECK(udp_client_check_for_dns_answer(buf,90)==0);
+	// no request when the link is down
+	stub_enc28j60_link=0;
+	CHECK(dnslkup_request(buf,"time.example.org",peermac)==1 && dnslkup_get_error_info()==4);
+	stub_enc28j60_link=1;
+}
+
+// reply of the dhcp server of the given message type to the request in the
+// tx buffer, with a lease of 20 seconds
+static uint16_t dhcp_reply(uint8_t type)
+{
+	const uint8_t options[]={53,1,0, 1,4,255,255,255,0, 3,4,192,168,1,1, 6,4,192,168,1,2, 51,4,0,0,0,20, 54,4,192,168,1,1, 255};
+	uint8_t *p;
+
+	memcpy(buf,stub_enc28j60_tx,UDP_DATA_P+240);
+	buf[UDP_SRC_PORT_L_P]=67;
+	buf[UDP_DST_PORT_L_P]=68;
+	buf[UDP_DATA_P]=2;
+	memcpy(&buf[UDP_DATA_P+16],myip,4);
+	p=&buf[UDP_DATA_P+240];
+	memcpy(p,options,sizeof(options));
+	p[2]=type;
+	return(UDP_DATA_P+240+sizeof(options));
+}
+
+// returns the value of a dhcp option in the tx buffer, NULL if it is not there
+static const uint8_t *dhcp_option(uint8_t code)
+{
+	uint16_t i=UDP_DATA_P+240;
+
+	while(i<stub_enc28j60_tx_len && stub_enc28j60_tx[i]!=255){
+		if (stub_enc28j60_tx[i]==code) return(&stub_enc28j60_tx[i+2]);
+		i+=2+stub_enc28j60_tx[i+1];
+	}
+	return(NULL);
+}
+
+static void test_dhcp(void)
+{
+	uint8_t noip[4]={0,0,0,0};
+	uint8_t ip[4],mask[4],gw[4],dns[4],server[4];
+	uint32_t lease;
+	uint8_t *tx=stub_enc28j60_tx;
+	uint8_t i;
+
+	stub_enc28j60_reset();
+	init_udp_or_www_server(mymac,noip);
+	init_dhcp(mymac[5]);
+	// discover, offer, request and ack
+	CHECK(packetloop_dhcp_initial_ip_assignment(buf,0)==0);
+	CHECK(stub_enc28j60_tx_count==1 && dhcp_get_info(NULL,NULL)==1 && stub_enc28j60_broadcast==1);
+	CHECK(tx[UDP_DST_PORT_L_P]==67 && dhcp_option(53) && *dhcp_option(53)==1);
+	CHECK(memcmp(&tx[UDP_DATA_P+28],mymac,6)==0);
+	CHECK(packetloop_dhcp_initial_ip_assignment(buf,dhcp_reply(2))==0);
+	CHECK(stub_enc28j60_tx_count==2 && dhcp_get_info(NULL,NULL)==2);
+	CHECK(dhcp_option(53) && *dhcp_option(53)==3);
+	CHECK(dhcp_option(50) && memcmp(dhcp_option(50),myip,4)==0);
+	CHECK(dhcp_option(54) && memcmp(dhcp_option(54),"\xc0\xa8\x01\x01",4)==0);
+	CHECK(packetloop_dhcp_initial_ip_assignment(buf,dhcp_reply(5))==1);
+	CHECK(dhcp_get_info(server,&lease)==3 && lease==20 && stub_enc28j60_broadcast==0);
+	CHECK(memcmp(server,"\xc0\xa8\x01\x01",4)==0);
+	dhcp_get_my_ip(ip,mask,gw,dns);
+	CHECK(memcmp(ip,myip,4)==0 && memcmp(mask,mynetmask,4)==0);
+	CHECK(memcmp(gw,"\xc0\xa8\x01\x01",4)==0 && memcmp(dns,"\xc0\xa8\x01\x02",4)==0);
+	// renewal at half the lease
+	i=0;
+	while(i<9){
+		dhcp_tick();
+		i++;
+	}
+	CHECK(packetloop_dhcp_renewhandler(buf,0)==0 && stub_enc28j60_tx_count==2);
+	dhcp_tick();
+	CHECK(packetloop_dhcp_renewhandler(buf,0)==0 && stub_enc28j60_tx_count==3);
+	CHECK(dhcp_get_info(NULL,NULL)==4 && stub_enc28j60_broadcast==1);
+	CHECK(memcmp(&tx[IP_SRC_P],myip,4)==0 && memcmp(&tx[UDP_DATA_P+12],myip,4)==0);
+	CHECK(packetloop_dhcp_renewhandler(buf,dhcp_reply(5))==0);
+	CHECK(dhcp_get_info(NULL,NULL)==3 && stub_enc28j60_broadcast==0);
+	// other packets are left to the caller
+	CHECK(packetloop_dhcp_renewhandler(buf,make_arp_request(myip))==42);
+	// a renewal that is refused starts over
+	i=0;
+	while(i<10){
+		dhcp_tick();
+		i++;
+	}
+	CHECK(packetloop_dhcp_renewhandler(buf,0)==0 && dhcp_get_info(NULL,NULL)==4);
+	CHECK(packetloop_dhcp_renewhandler(buf,dhcp_reply(6))==0 && dhcp_get_info(NULL,NULL)==0);
+}
+
+static void bench(void)
+{
+	char url[]="pg=3&s=abc&tz=60 HTTP/1.1\r\n";
+	char body[]="nt=pool.ntp.org&up=3600&ma=54-10-EC-00-28-60&st=on&tz=UTC%2B01%3A00 HTTP/1.1\r\n";
+	char s[sizeof(body)];
+	char val[16];
+	uint64_t t;
+	uint32_t n;
+
+	printf("%-24s %10s\n","function","ns/call");
+	memset(buf,0x5a,1500);
+	t=test_ns();
+	n=0;
+	while(n<100000){
+		checksum(buf,1500,0);
+		n++;
+	}
+	t=test_ns()-t;
+	printf("%-24s %10llu %.1f MB/s\n","checksum 1500 bytes",(unsigned long long)t/n,1500.0*n*1000/t);
+	t=test_ns();
+	n=0;
+	while(n<1000000){
+		find_key_val(url,val,sizeof(val),"tz");
+		n++;
+	}
+	printf("%-24s %10llu\n","find_key_val",(unsigned long long)(test_ns()-t)/n);
+	// the copy of the string is included
+	t=test_ns();
+	n=0;
+	while(n<1000000){
+		memcpy(s,body,sizeof(body));
+		urldecode(s);
+		n++;
+	}
+	printf("%-24s %10llu\n","urldecode",(unsigned long long)(test_ns()-t)/n);
+	t=test_ns();
+	n=0;
+	while(n<1000000){
+		strcpy(s,"YWRtaW46c2VjcmV0");
+		base64_decode(s);
+		n++;
+	}
+	printf("%-24s %10llu\n","base64_decode",(unsigned long long)(test_ns()-t)/n);
+	t=test_ns();
+	n=0;
+	while(n<1000000){
+		memcpy(s,body,sizeof(body));
+		parse_key_vals(s,test_keys,3,test_key_val);
+		n++;
+	}
+	printf("%-24s %10llu\n","parse_key_vals",(unsigned long long)(test_ns()-t)/n);
+	printf("\n");
+	bench_pages();
+}
+
+int main(int argc, char **argv)
+{
+	const char *in=NULL;
+	const char *out=NULL;
+	int i=1;
+
+	while(i<argc){
+		if (strcmp(argv[i],"-b")==0){
+			bench();
+			return(0);
+		}else if (strcmp(argv[i],"-r")==0 && i+1<argc){
+			in=argv[++i];
+		}else if (strcmp(argv[i],"-w")==0 && i+1<argc){
+			out=argv[++i];
+		}else{
+			printf("usage: %s [-b | -r in.pcap [-w out.pcap]]\n",argv[0]);
+			return(2);
+		}
+		i++;
+	}
+	if (in) return(replay_pages(in,out));
+	test_checksum();
+	test_find_key_val();
+	test_urldecode();
+	test_base64_decode();
+	test_parse_key_vals();
+	test_dht_log();
+	test_nvstate();
+	test_ntp_client();
+	test_packetloop();
+	test_dnslkup();
+	test_dhcp();
+	test_pages();
+	printf("%u checks, %u failed\n",checks,failures);
+	return(failures!=0);
+}
@@ -0,0 +1,492 @@
+/*
+ * test_pages.c
+ *
+ * Created: 15-10-2026 14:31:08
+ *  Author: Tim Dorssers
+ *
+ * Builds main.c of the firmware with its statics in reach and talks to it
+ * through net_run() like a browser and a monitor would: every request goes
+ * from the SYN to the FIN, each reply segment is acked and its IP and TCP
+ * checksums are verified.
+ */
+
+#include <stdio.h>
+#include "stub.h"
+#include "test.h"
+
+// the firmware has its own main and a start up function for .init3
+#define main firmware_main
+#define naked used
+#include "../main.c"
+#undef main
+
+// longest reply that is collected, the whole history csv fits
+#define REPLY_SIZE 16384
+#define PEER_PORT 40000
+
+static uint8_t pkt[STUB_PACKET_SIZE];
+static uint8_t peermac[6]={0x00,0x11,0x22,0x33,0x44,0x55};
+static uint8_t peerip[4]={192,168,1,20};
+static uint8_t fwip[4]={192,168,1,10};
+static uint8_t fwmask[4]={255,255,255,0};
+
+// reply of the last request: the tcp data of the segments in order
+static char reply[REPLY_SIZE+1];
+static uint16_t reply_len;
+static uint16_t reply_segments;
+static uint32_t reply_next; // seq number of the next data byte
+static uint8_t reply_fin;
+static uint16_t bad_checksums;
+
+static uint32_t get32(const uint8_t *p)
+{
+	return(((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|p[3]);
+}
+
+static void put32(uint8_t *p, uint32_t n)
+{
+	p[0]=n>>24;
+	p[1]=n>>16;
+	p[2]=n>>8;
+	p[3]=n;
+}
+
+static uint16_t ip_len(const uint8_t *p)
+{
+	return(((uint16_t)p[IP_TOTLEN_H_P]<<8)|p[IP_TOTLEN_L_P]);
+}
+
+// checks every packet the firmware sends and collects the web server data
+static void collect(const uint8_t *p, uint16_t len)
+{
+	uint16_t tcplen,hlen,dlen;
+	uint32_t seq;
+
+	if (p[ETH_TYPE_H_P]!=ETHTYPE_IP_H_V || p[ETH_TYPE_L_P]!=ETHTYPE_IP_L_V) return;
+	if (checksum((uint8_t *)&p[IP_P],IP_HEADER_LEN,0)!=0) bad_checksums++;
+	if (p[IP_PROTO_P]!=IP_PROTO_TCP_V) return;
+	tcplen=ip_len(p)-IP_HEADER_LEN;
+	if (checksum((uint8_t *)&p[IP_SRC_P],8+tcplen,2)!=0) bad_checksums++;
+	if (p[TCP_SRC_PORT_H_P]!=0 || p[TCP_SRC_PORT_L_P]!=80) return;
+	hlen=(p[TCP_HEADER_LEN_P]>>4)*4;
+	dlen=tcplen-hlen;
+	seq=get32(&p[TCP_SEQ_H_P]);
+	// a part that is sent again is not collected twice
+	if (dlen && seq==reply_next && reply_len+dlen<=REPLY_SIZE){
+		memcpy(&reply[reply_len],&p[IP_P+IP_HEADER_LEN+hlen],dlen);
+		reply_len+=dlen;
+		reply[reply_len]='\0';
+		reply_next+=dlen;
+		reply_segments++;
+	}
+	if (p[TCP_FLAGS_P] & TCP_FLAGS_FIN_V) reply_fin=1;
+}
+
+// tcp segment of the peer to the web server
+static uint16_t make_tcp(uint8_t flags, uint32_t seq, uint32_t ack, const char *data, uint16_t len)
+{
+	uint16_t ck;
+
+	memset(pkt,0,TCP_OPTIONS_P);
+	memcpy(&pkt[ETH_DST_MAC],config.mymac,6);
+	memcpy(&pkt[ETH_SRC_MAC],peermac,6);
+	pkt[ETH_TYPE_H_P]=ETHTYPE_IP_H_V;
+	pkt[ETH_TYPE_L_P]=ETHTYPE_IP_L_V;
+	pkt[IP_HEADER_LEN_VER_P]=0x45;
+	pkt[IP_TOTLEN_H_P]=(IP_HEADER_LEN+TCP_HEADER_LEN_PLAIN+len)>>8;
+	pkt[IP_TOTLEN_L_P]=IP_HEADER_LEN+TCP_HEADER_LEN_PLAIN+len;
+	pkt[IP_TTL_P]=64;
+	pkt[IP_PROTO_P]=IP_PROTO_TCP_V;
+	memcpy(&pkt[IP_SRC_P],peerip,4);
+	memcpy(&pkt[IP_DST_P],fwip,4);
+	ck=checksum(&pkt[IP_P],IP_HEADER_LEN,0);
+	pkt[IP_CHECKSUM_P]=ck>>8;
+	pkt[IP_CHECKSUM_P+1]=ck;
+	pkt[TCP_SRC_PORT_H_P]=PEER_PORT>>8;
+	pkt[TCP_SRC_PORT_L_P]=PEER_PORT & 0xff;
+	pkt[TCP_DST_PORT_L_P]=80;
+	put32(&pkt[TCP_SEQ_H_P],seq);
+	put32(&pkt[TCP_SEQACK_H_P],ack);
+	pkt[TCP_HEADER_LEN_P]=0x50;
+	pkt[TCP_FLAGS_P]=flags;
+	pkt[TCP_WIN_SIZE]=0x40;
+	if (len) memcpy(&pkt[TCP_OPTIONS_P],data,len);
+	ck=checksum(&pkt[IP_SRC_P],8+TCP_HEADER_LEN_PLAIN+len,2);
+	pkt[TCP_CHECKSUM_H_P]=ck>>8;
+	pkt[TCP_CHECKSUM_L_P]=ck;
+	return(TCP_OPTIONS_P+len);
+}
+
+// udp datagram of the peer from port sport to port dport
+static uint16_t make_udp(uint16_t sport, uint16_t dport, const char *data, uint16_t len)
+{
+	uint16_t ck;
+
+	memset(pkt,0,UDP_DATA_P);
+	memcpy(&pkt[ETH_DST_MAC],config.mymac,6);
+	memcpy(&pkt[ETH_SRC_MAC],peermac,6);
+	pkt[ETH_TYPE_H_P]=ETHTYPE_IP_H_V;
+	pkt[ETH_TYPE_L_P]=ETHTYPE_IP_L_V;
+	pkt[IP_HEADER_LEN_VER_P]=0x45;
+	pkt[IP_TOTLEN_L_P]=IP_HEADER_LEN+UDP_HEADER_LEN+len;
+	pkt[IP_TTL_P]=64;
+	pkt[IP_PROTO_P]=IP_PROTO_UDP_V;
+	memcpy(&pkt[IP_SRC_P],peerip,4);
+	memcpy(&pkt[IP_DST_P],fwip,4);
+	ck=checksum(&pkt[IP_P],IP_HEADER_LEN,0);
+	pkt[IP_CHECKSUM_P]=ck>>8;
+	pkt[IP_CHECKSUM_P+1]=ck;
+	pkt[UDP_SRC_PORT_H_P]=sport>>8;
+	pkt[UDP_SRC_PORT_L_P]=sport;
+	pkt[UDP_DST_PORT_H_P]=dport>>8;
+	pkt[UDP_DST_PORT_L_P]=dport;
+	pkt[UDP_LEN_L_P]=UDP_HEADER_LEN+len;
+	if (len) memcpy(&pkt[UDP_DATA_P],data,len);
+	return(UDP_DATA_P+len);
+}
+
+// hands the queued packets to the firmware one by one
+static void run(void)
+{
+	while(enc28j60hasRxPkt()){
+		net_run();
+	}
+}
+
+// sends a request as one segment and acks the reply until its FIN,
+// returns the length of the reply
+static uint16_t http(const char *request)
+{
+	uint32_t seq=1000;
+	uint32_t ack;
+	uint16_t n=0;
+
+	reply_len=0;
+	reply_segments=0;
+	reply_fin=0;
+	reply[0]='\0';
+	stub_enc28j60_tx_len=0;
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_SYN_V,seq++,0,NULL,0));
+	run();
+	if (stub_enc28j60_tx_len==0 || stub_enc28j60_tx[TCP_FLAGS_P]!=TCP_FLAGS_SYNACK_V) return(0);
+	ack=get32(&stub_enc28j60_tx[TCP_SEQ_H_P])+1;
+	reply_next=ack;
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V,seq,ack,request,strlen(request)));
+	seq+=strlen(request);
+	run();
+	// a page in parts needs an ack for every part
+	while(!reply_fin && n<100){
+		stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_ACK_V,seq,reply_next,NULL,0));
+		run();
+		n++;
+	}
+	// the FIN takes a seq number, acking it ends a stream
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_ACK_V,seq,reply_next+1,NULL,0));
+	run();
+	return(reply_len);
+}
+
+// firmware state after the start up, with a fixed ip instead of DHCP
+static void firmware_init(void)
+{
+	stub_eeprom_erase();
+	// the host pads struct config, which config_flush does not write, so
+	// the eeprom starts as a copy to let the check byte match after a save
+	config.sum=config_sum(&config);
+	eeprom_update_block(&config,&nv_config,sizeof(config));
+	stub_time=845380800; // 15-10-2026 12:00 UTC
+	config_load();
+	log_init();
+	hdlx2416_init();
+	enc28j60Init(config.mymac);
+	enc28j60SetRxFilter(packet_header_filter);
+	init_mac(config.mymac);
+	build_id=0x1234;
+	if (config.enable_eu_dst) {
+		clock_set_dst(eu_dst,eu_dst_next);
+	}
+	set_zone((int32_t)config.mins_offset_to_utc * 60);
+	if (net_task==0 && init_task==0) {
+		net_task=sched_add(net_run);
+		init_task=sched_add(init_run);
+		link_task=sched_add(link_run);
+		dht_task=sched_add(dht_run);
+		display_task=sched_add(display_run);
+	}
+	memcpy(myip,fwip,4);
+	memcpy(netmask,fwmask,4);
+	client_ifconfig(myip,netmask);
+	init_state=5;
+	ntp_state=1;
+	stub_enc28j60_tx_hook=collect;
+}
+
+static void test_get_pages(void)
+{
+	uint8_t i;
+
+	CHECK(http("GET / HTTP/1.1\r\n\r\n")>0);
+	CHECK(strncmp(reply,"HTTP/1.0 200 OK\r\n",17)==0 && strstr(reply,"</html>")!=NULL);
+	CHECK(reply_segments==1);
+	// the config pages need the password
+	CHECK(http("GET /?pg=1 HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 401",12)==0);
+	CHECK(http("GET /?pg=1 HTTP/1.1\r\nAuthorization: Basic YWRtaW46d3Jvbmc=\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 401",12)==0);
+	CHECK(http("GET /?pg=1 HTTP/1.1\r\nAuthorization: Basic YWRtaW46c2VjcmV0\r\n\r\n")>0);
+	CHECK(strncmp(reply,"HTTP/1.0 200",12)==0 && strstr(reply,"value=time.apple.com>")!=NULL);
+	CHECK(strstr(reply,"name=ma value=54:10:ec:0:28:60>")!=NULL);
+	CHECK(http("GET /?pg=5 HTTP/1.1\r\nAuthorization: Basic YWRtaW46c2VjcmV0\r\n\r\n")>0 && strstr(reply,"name=pw")!=NULL);
+	CHECK(http("GET /?pg=2 HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(http("GET /?pg=6 HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(http("GET /nothing HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 404",12)==0);
+	CHECK(http("PUT / HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 501",12)==0);
+	// the pages in parts
+	dht_log_clear();
+	i=0;
+	while(i<100){
+		dht_log_add(stub_time-(time_t)(100-i)*DHT_LOG_INTERVAL,20+i%5,50-i%7);
+		i++;
+	}
+	CHECK(http("GET /?pg=3 HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(reply_segments>1 && strstr(reply,"</html>")!=NULL);
+	CHECK(http("GET /?pg=4 HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(reply_segments>1 && strstr(reply,"</html>")!=NULL);
+	CHECK(http("GET /h.csv HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200 OK\r\nContent-Type: text/csv",39)==0);
+	// a line per sample after the head line
+	i=0;
+	reply_len=0;
+	while(reply[reply_len]){
+		if (reply[reply_len]=='\n') i++;
+		reply_len++;
+	}
+	CHECK(i>=100);
+	CHECK(www_server_stream_busy()==0);
+	CHECK(bad_checksums==0);
+}
+
+// a part that is not acked is sent again, a reset ends the page
+static void test_stream(void)
+{
+	const char request[]="GET /?pg=4 HTTP/1.1\r\n\r\n";
+	uint32_t ack;
+	uint32_t seq;
+	uint16_t count;
+
+	reply_len=0;
+	reply_segments=0;
+	reply_fin=0;
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_SYN_V,5000,0,NULL,0));
+	run();
+	ack=get32(&stub_enc28j60_tx[TCP_SEQ_H_P])+1;
+	reply_next=ack;
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V,5001,ack,request,sizeof(request)-1));
+	run();
+	CHECK(reply_segments==1 && www_server_stream_busy()==1);
+	seq=get32(&stub_enc28j60_tx[TCP_SEQ_H_P]);
+	count=stub_enc28j60_tx_count;
+	// nothing is sent again before the timeout
+	www_server_tick();
+	net_run();
+	CHECK(stub_enc28j60_tx_count==count);
+	www_server_tick();
+	net_run();
+	CHECK(stub_enc28j60_tx_count==count+1 && get32(&stub_enc28j60_tx[TCP_SEQ_H_P])==seq);
+	CHECK(reply_segments==1);
+	// an ack of the part brings the next
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_ACK_V,5001+sizeof(request)-1,reply_next,NULL,0));
+	run();
+	CHECK(reply_segments==2 && stub_enc28j60_tx_count==count+2);
+	stub_enc28j60_rx(pkt,make_tcp(TCP_FLAGS_RST_V,5001+sizeof(request)-1,0,NULL,0));
+	run();
+	CHECK(www_server_stream_busy()==0);
+	CHECK(bad_checksums==0);
+}
+
+static void test_files(void)
+{
+	char request[128];
+	char *etag;
+	char *e;
+
+	// the files are sent from flash behind the headers
+	CHECK(http("GET /s.css HTTP/1.1\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(strstr(reply,"\r\n\r\n")!=NULL && strcmp(strstr(reply,"\r\n\r\n")+4,s1css)==0);
+	CHECK(http("GET /tz.js HTTP/1.1\r\n\r\n")>0 && strstr(reply,"function tzi()")!=NULL);
+	// a browser that has the file gets a 304
+	etag=strstr(reply,"ETag: ");
+	CHECK(etag!=NULL);
+	if (etag==NULL) return;
+	etag+=6;
+	e=strchr(etag,'\r');
+	snprintf(request,sizeof(request),"GET /tz.js HTTP/1.1\r\nIf-None-Match: %.*s\r\n\r\n",(int)(e-etag),etag);
+	CHECK(http(request)>0 && strncmp(reply,"HTTP/1.0 304",12)==0);
+	CHECK(strstr(reply,"function")==NULL);
+	CHECK(http("GET /tz.js HTTP/1.1\r\nIf-None-Match: \"0-0\"\r\n\r\n")>0 && strncmp(reply,"HTTP/1.0 200",12)==0);
+	CHECK(bad_checksums==0);
+}
+
+static void test_forms(void)
+{
+	struct config c;
+
+	c=config;
+	// a rejected form keeps nothing, a valid time zone included
+	CHECK(http("POST /cu HTTP/1.1\r\n\r\nnt=pool.ntp.org&up=600&ma=zz&tz=UTC%2B02%3A00") && strstr(reply,"Error")!=NULL);
+	CHECK(memcmp(&c,&config,sizeof(c))==0);
+	CHECK(config_dirty==0);
+	// the display form
+	CHECK(http("POST /du HTTP/1.1\r\n\r\nhh=on&in=2")>0 && strncmp(reply,"HTTP/1.0 302",12)==0);
+	CHECK(config.display_24hclock==1 && config.display_temperature==0 && config.intensity==2);
+	CHECK(stub_display_intensity==2);
+	// the config is saved and found back
+	c=config;
+	config.intensity=7;
+	config_load();
+	CHECK(memcmp(&c,&config,sizeof(c))==0);
+	CHECK(http("POST /xx HTTP/1.1\r\n\r\na=b")>0 && strncmp(reply,"HTTP/1.0 500",12)==0);
+	CHECK(bad_checksums==0);
+}
+
+// the old firmware kept separate blocks at address 0
+static void test_config_migration(void)
+{
+	struct old_config o;
+	struct config c;
+
+	c=config;
+	stub_eeprom_erase();
+	memset(&o,0xff,sizeof(o));
+	o.magic_config=0x55;
+	memcpy(o.mymac,"\x54\x10\xec\x00\x28\x61",6);
+	strcpy(o.ntphostname,"ntp.example.org");
+	o.mins_offset_to_utc=-300;
+	o.enable_eu_dst=0;
+	o.ntp_update_period=7200;
+	o.magic_alarm=0xcc;
+	o.alarm_enabled=1;
+	o.alarm_hour=7;
+	o.alarm_min=30;
+	eeprom_update_block(&o,(void *)(uintptr_t)OLD_CONFIG_ADDR,sizeof(o));
+	config_load();
+	CHECK(config.mymac[5]==0x61 && strcmp(config.ntphostname,"ntp.example.org")==0);
+	CHECK(config.mins_offset_to_utc==-300 && config.enable_eu_dst==0 && config.ntp_update_period==7200);
+	CHECK(config.alarm_enabled==1 && config.alarm_hour==7 && config.alarm_min==30);
+	// the blocks without their magic number keep what was there
+	CHECK(strcmp(config.password,c.password)==0 && config.intensity==c.intensity);
+	// saved in the new layout
+	CHECK(config.sum==config_sum(&config));
+}
+
+static void test_status_query(void)
+{
+	uint16_t count;
+
+	stub_enc28j60_tx_hook=NULL;
+	count=stub_enc28j60_tx_count;
+	stub_enc28j60_rx(pkt,make_udp(40001,STATUS_PORT,"S",1));
+	run();
+	CHECK(stub_enc28j60_tx_count==count+1);
+	CHECK(stub_enc28j60_tx_len==UDP_DATA_P+92 && stub_enc28j60_tx[UDP_DATA_P]==STATUS_VERSION);
+	CHECK(stub_enc28j60_tx[UDP_DST_PORT_H_P]==(40001>>8) && stub_enc28j60_tx[UDP_DST_PORT_L_P]==(40001 & 0xff));
+	// no query byte, a status packet and a query of another clock
+	stub_enc28j60_rx(pkt,make_udp(40001,STATUS_PORT,NULL,0));
+	stub_enc28j60_rx(pkt,make_udp(40001,STATUS_PORT,"\x03",1));
+	stub_enc28j60_rx(pkt,make_udp(STATUS_PORT,STATUS_PORT,"S",1));
+	run();
+	CHECK(stub_enc28j60_tx_count==count+1);
+	stub_enc28j60_tx_hook=collect;
+}
+
+void test_pages(void)
+{
+	firmware_init();
+	test_get_pages();
+	test_stream();
+	test_files();
+	test_forms();
+	test_status_query();
+	test_config_migration();
+	stub_enc28j60_tx_hook=NULL;
+}
+
+void bench_pages(void)
+{
+	static const char *const requests[]={
+		"GET / HTTP/1.1\r\n\r\n",
+		"GET /?pg=1 HTTP/1.1\r\nAuthorization: Basic YWRtaW46c2VjcmV0\r\n\r\n",
+		"GET /?pg=2 HTTP/1.1\r\n\r\n",
+		"GET /?pg=3 HTTP/1.1\r\n\r\n",
+		"GET /?pg=4 HTTP/1.1\r\n\r\n",
+		"GET /?pg=6 HTTP/1.1\r\n\r\n",
+		"GET /h.csv HTTP/1.1\r\n\r\n",
+		"GET /s.css HTTP/1.1\r\n\r\n",
+		NULL
+	};
+	uint64_t t;
+	uint16_t n;
+	uint16_t i;
+
+	firmware_init();
+	i=0;
+	while(i<DHT_LOG_SIZE){
+		dht_log_add(stub_time-(time_t)(DHT_LOG_SIZE-i)*DHT_LOG_INTERVAL,20+i%5,50-i%7);
+		i++;
+	}
+	printf("%-24s %6s %8s %10s\n","page","bytes","segments","ns/request");
+	i=0;
+	while(requests[i]){
+		t=test_ns();
+		n=0;
+		while(n<200){
+			http(requests[i]);
+			n++;
+		}
+		t=(test_ns()-t)/n;
+		printf("%-24.*s %6u %8u %10llu\n",(int)(strstr(requests[i]," HTTP")-requests[i]),requests[i],reply_len,reply_segments,(unsigned long long)t);
+		i++;
+	}
+	stub_enc28j60_tx_hook=NULL;
+}
+
+static uint32_t replay_replies;
+static uint32_t replay_bytes;
+static uint64_t replay_worst;
+
+static void replay_collect(const uint8_t *p, uint16_t len)
+{
+	replay_replies++;
+	replay_bytes+=len;
+	stub_pcap_write(p,len);
+}
+
+static void replay_run(void)
+{
+	uint64_t t;
+
+	while(enc28j60hasRxPkt()){
+		t=test_ns();
+		net_run();
+		t=test_ns()-t;
+		if (t>replay_worst) replay_worst=t;
+	}
+}
+
+int replay_pages(const char *path, const char *out)
+{
+	int32_t n;
+
+	firmware_init();
+	stub_enc28j60_tx_hook=replay_collect;
+	if (out && !stub_pcap_open(out)){
+		printf("cannot create %s\n",out);
+		return(1);
+	}
+	n=stub_pcap_replay(path,replay_run);
+	stub_pcap_open(NULL);
+	stub_enc28j60_tx_hook=NULL;
+	if (n<0){
+		printf("cannot read %s\n",path);
+		return(1);
+	}
+	printf("%ld packets, %lu taken by the rx filter, %lu replies of %lu bytes, longest net_run %lu ns\n",(long)n,(unsigned long)stub_enc28j60_rx_rejected,(unsigned long)replay_replies,(unsigned long)replay_bytes,(unsigned long)replay_worst);
+	return(0);
+}
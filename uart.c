@@ -737,6 +737,23 @@ void uart0_flush(void)
 	}
 } /* uart0_flush */
 
+/*************************************************************************
+Function: uart0_tx_free()
+Purpose:  Determine the number of bytes that uart0_putc() can write
+          without waiting
+Input:    None
+Returns:  Integer number of free bytes in the transmit buffer
+**************************************************************************/
+uint16_t uart0_tx_free(void)
+{
+	uint16_t ret;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ret = (UART_TX0_BUFFER_SIZE + UART_TxTail - UART_TxHead - 1) & UART_TX0_BUFFER_MASK;
+	}
+	return ret;
+} /* uart0_tx_free */
+
 #endif
 
 #endif /* defined(USART0_ENABLED) */
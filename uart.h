@@ -100,6 +100,10 @@ were adapted from the Arduino HardwareSerial.h library by Tim Sharpe on
 
 /* Set size of receive and transmit buffers */
 
+/* NTP clock: only log commands are received, the log is sent */
+#define UART_RX0_BUFFER_SIZE 16
+#define UART_TX0_BUFFER_SIZE 256
+
 #ifndef UART_RX0_BUFFER_SIZE
 	#define UART_RX0_BUFFER_SIZE 128 /**< Size of the circular receive buffer, must be power of 2 */
 #endif
@@ -346,6 +350,12 @@ extern uint16_t uart0_available(void);
  */
 extern void uart0_flush(void);
 
+/**
+ *  @brief   Return number of bytes that fit in the transmit buffer
+ *  @return  free bytes in the transmit buffer
+ */
+extern uint16_t uart0_tx_free(void);
+
 
 /** @brief  Initialize USART1 (only available on selected ATmegas) @see uart_init */
 extern void uart1_init(uint16_t baudrate);
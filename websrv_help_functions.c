@@ -7,6 +7,8 @@
  * - Added support for search string without a question mark to find_key_val()
  * - Added find_key_val_p() for keys stored in progmem space
  * - Optimized h2int() for size
+ * - Added parse_key_vals() that handles all keys in one pass
+ * - Added base64_decode()
  *
  * Some common utilities needed for IP and web applications.
  * The defines below are controlled via ip_config.h. By choosing
@@ -19,6 +21,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "ip_config.h"
+#include "websrv_help_functions.h"
 
 #ifdef FROMDECODE_websrv_help
 // search for a string of the form key=value in
@@ -41,7 +44,7 @@ uint8_t find_key_val(char *str,char *strbuf, uint8_t maxlen,char *key)
 			// if this is the start of the key otherwise we will
 			// match on 'foobar' when only looking for 'bar', by andras tucsni
 			// support for search string without a question mark, by Tim Dorssers
-			if (kp==key &&  ! ( *(str-1) == '?' || *(str-1) == '&' || sp == str ) ) goto NEXT;
+			if (kp==key &&  ! ( sp == str || *(str-1) == '?' || *(str-1) == '&' ) ) goto NEXT;
 			kp++;
 			if (*kp == '\0'){
 				str++;
@@ -149,6 +152,88 @@ void urldecode(char *urlbuf)
 	*dst = '\0';
 }
 
+// decodes a base64-encoded string
+void base64_decode(char *str) {
+	char *out = str;
+	char stream[4];
+	while (strlen(str) >= 4) {
+		for (uint8_t i = 0; i < 4; ++i) {
+			if (*str >= 'A' && *str <= 'Z') {
+				stream[i] = *str - 'A';
+			}
+			else if (*str >= 'a' && *str <= 'z') {
+				stream[i] = *str - 'a' + 26;
+			}
+			else if (*str >= '0' && *str <= '9') {
+				stream[i] = *str - '0' + 52;
+			}
+			else if (*str == '+') {
+				stream[i] = 62;
+			}
+			else if (*str == '/') {
+				stream[i] = 63;
+			}
+			else if (*str == '=') {
+				stream[i] = 0;
+			}
+			++str;
+		}
+		*out++ = stream[0] << 2 | stream[1] >> 4;
+		*out++ = stream[1] << 4 | stream[2] >> 2;
+		*out++ = stream[2] << 6 | stream[3] >> 0;
+	}
+	*out = '\0';
+}
+
+// walk once through a string that looks like xyz=abc&uvw=defgh HTTP/1.1\r\n
+// and call handler for every key that is in keys, a table in progmem space
+// of nkeys keys. The value is url decoded in place and terminated with '\0'.
+// The character after the value is put back when handler returns, so the
+// rest of the string can still be searched.
+void parse_key_vals(char *str,const char (*keys)[KEY_VAL_KEY_SIZE],uint8_t nkeys,void (*handler)(uint8_t key,char *val))
+{
+	char *key;
+	char *val;
+	char *dst;
+	char c;
+	uint8_t i;
+
+	while(*str && *str!=' ' && *str!='\r'){
+		key=str;
+		while(*str && *str!='=' && *str!='&' && *str!=' ' && *str!='\r'){
+			str++;
+		}
+		i=nkeys;
+		if (*str=='='){
+			c=*str;
+			*str='\0';
+			i=0;
+			while(i<nkeys && strcmp_P(key,keys[i])!=0){
+				i++;
+			}
+			*str=c;
+			str++;
+		}
+		// decode the value
+		val=dst=str;
+		while((c=*str) && c!='&' && c!=' ' && c!='\r'){
+			if (c == '+') c = ' ';
+			if (c == '%' && isxdigit(str[1]) && isxdigit(str[2])) {
+				c = (h2int(str[1]) << 4) | h2int(str[2]);
+				str+=2;
+			}
+			*dst=c;
+			dst++;
+			str++;
+		}
+		c=*dst;
+		*dst='\0';
+		if (i<nkeys) (*handler)(i,val);
+		*dst=c;
+		if (*str=='&') str++;
+	}
+}
+
 #endif //  FROMDECODE_websrv_help
 
 #ifdef URLENCODE_websrv_help
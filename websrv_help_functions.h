@@ -5,6 +5,8 @@
  *
  * Modified by: Tim Dorssers
  * - Added find_key_val_p()
+ * - Added parse_key_vals()
+ * - Added base64_decode()
  *
  * Some common utilities needed for IP and web applications.
  * The defines below are controlled via ip_config.h. By choosing
@@ -22,6 +24,10 @@
 extern uint8_t find_key_val(char *str,char *strbuf, uint8_t maxlen,char *key);
 extern uint8_t find_key_val_p(char *str,char *strbuf, uint8_t maxlen,const char *progmem_key);
 extern void urldecode(char *urlbuf); // decode a url string e.g "hello%20joe" or "hello+joe" becomes "hello joe"
+extern void base64_decode(char *str); // decode a base64 string in place, the result is terminated with '\0'
+// parse_key_vals calls handler with the index in keys and the decoded value of every key=value pair that is in keys, scanning the string once:
+#define KEY_VAL_KEY_SIZE 3 // longest key plus '\0'
+extern void parse_key_vals(char *str,const char (*keys)[KEY_VAL_KEY_SIZE],uint8_t nkeys,void (*handler)(uint8_t key,char *val));
 #endif
 #ifdef URLENCODE_websrv_help
 extern void urlencode(const char *str,char *urlbuf); // result goes into urlbuf. There must be enough space in urlbuf. In the worst case that would be 3 times the length of str.